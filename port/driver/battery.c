@@ -22,6 +22,8 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define LOG_MODULE POWER
+
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
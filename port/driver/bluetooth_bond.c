@@ -0,0 +1,360 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Bond storage for a single peer, the last one which paired.
+ * The flash page is written through the SoftDevice, which schedules the
+ * operation between radio events and reports the result as a SoC event.
+ */
+
+#define LOG_MODULE BLE
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "ble.h"
+#include "nrf_nvic.h"
+#include "nrf_soc.h"
+#include "nrfx_log.h"
+
+#include "driver/bluetooth_bond.h"
+
+#define ASSERT  NRFX_ASSERT
+
+#define BLE_BOND_MAGIC              0x424F4E44  // "BOND"
+#define BLE_BOND_PAGE_SIZE          4096
+#define BLE_BOND_SYS_ATTR_MAX       64
+
+/**
+ * Everything needed to reconnect to the peer without pairing nor discovery.
+ */
+typedef struct
+{
+    uint32_t magic;                         // BLE_BOND_MAGIC if the rest is valid
+    ble_gap_addr_t peer_addr;               // Identity address of the peer
+    ble_gap_enc_key_t own_enc;              // Key given to the peer, which it asks back on every reconnection
+    ble_gap_id_key_t peer_id;               // Identity key of the peer, for resolving its private addresses
+    bool has_peer_id;                       // Whether the peer distributed its identity key
+    uint16_t sys_attr_len;                  // Length of the cached GATT attributes
+    uint8_t sys_attr[BLE_BOND_SYS_ATTR_MAX];// GATT attributes such as the notifications enabled by the peer
+} ble_bond_t;
+
+/** Page reserved by the linker script, in the area kept by the bootloader across updates. */
+extern uint32_t _bond_start;
+
+/** Copy of the bond in RAM. */
+static ble_bond_t ble_bond;
+
+/** Snapshot of the bond being written, as the SoftDevice reads it until the write is done. */
+static ble_bond_t ble_bond_flash_copy __attribute__((aligned(4)));
+
+/** Keys exchanged while pairing, written directly in the bond. */
+static ble_gap_sec_keyset_t ble_bond_keys = {
+    .keys_own.p_enc_key = &ble_bond.own_enc,
+    .keys_peer.p_id_key = &ble_bond.peer_id,
+};
+
+/** Progress of the flash write, which happens in two asynchronous steps. */
+static enum {
+    BLE_BOND_FLASH_IDLE,
+    BLE_BOND_FLASH_ERASE,
+    BLE_BOND_FLASH_WRITE,
+} ble_bond_flash_state;
+
+/** Set when the bond in RAM differs from the one in flash. */
+static bool ble_bond_dirty;
+
+/** Set when the device identities known by the SoftDevice need an update. */
+static bool ble_bond_identities_dirty;
+
+/** Set by ble_bond_clear() for the SoftDevice event interrupt to forget the bond. */
+static volatile bool ble_bond_clear_pending;
+
+/**
+ * Start writing the bond to flash unless a write is already ongoing.
+ */
+static void ble_bond_flash_next(void)
+{
+    uint32_t err;
+
+    if (ble_bond_flash_state != BLE_BOND_FLASH_IDLE || !ble_bond_dirty)
+        return;
+
+    err = sd_flash_page_erase((uint32_t)&_bond_start / BLE_BOND_PAGE_SIZE);
+    if (err == NRF_ERROR_BUSY)
+        return;
+    ASSERT(!err);
+
+    // Later changes of the bond go to the next write
+    ble_bond_flash_copy = ble_bond;
+    ble_bond_dirty = false;
+    ble_bond_flash_state = BLE_BOND_FLASH_ERASE;
+}
+
+/**
+ * Let the flash write progress. Called for every SoC flash event.
+ * @param success Whether the last flash operation succeeded.
+ */
+void ble_bond_flash_event(bool success)
+{
+    uint32_t err;
+
+    switch (ble_bond_flash_state)
+    {
+    case BLE_BOND_FLASH_ERASE:
+    {
+        if (!success)
+        {
+            ble_bond_dirty = true;
+            ble_bond_flash_state = BLE_BOND_FLASH_IDLE;
+            break;
+        }
+        err = sd_flash_write(&_bond_start, (uint32_t *)&ble_bond_flash_copy, sizeof(ble_bond_flash_copy) / 4);
+        ASSERT(!err);
+        ble_bond_flash_state = BLE_BOND_FLASH_WRITE;
+        return;
+    }
+
+    case BLE_BOND_FLASH_WRITE:
+    {
+        LOG("bond %s", success ? "saved" : "not saved, retrying");
+        if (!success)
+            ble_bond_dirty = true;
+        ble_bond_flash_state = BLE_BOND_FLASH_IDLE;
+        break;
+    }
+
+    default:
+    {
+        // Flash operation from someone else
+        break;
+    }
+    }
+
+    ble_bond_flash_next();
+}
+
+/**
+ * Queue the bond for being written to flash.
+ */
+static void ble_bond_store(void)
+{
+    ble_bond_dirty = true;
+    ble_bond_flash_next();
+}
+
+/**
+ * Reload the bond from flash, dropping any change made in RAM.
+ */
+static void ble_bond_load(void)
+{
+    ble_bond_t const *flash = (ble_bond_t const *)&_bond_start;
+
+    if (flash->magic == BLE_BOND_MAGIC && flash->sys_attr_len <= BLE_BOND_SYS_ATTR_MAX)
+        memcpy(&ble_bond, flash, sizeof(ble_bond));
+    else
+        memset(&ble_bond, 0, sizeof(ble_bond));
+}
+
+/**
+ * @return The identity address of the bonded peer, or NULL if there is none.
+ */
+ble_gap_addr_t const *ble_bond_peer(void)
+{
+    return ble_bond.magic == BLE_BOND_MAGIC ? &ble_bond.peer_addr : NULL;
+}
+
+/**
+ * Tell if an address is the one of the bonded peer.
+ * @param addr Address of a peer, resolved to its identity by the SoftDevice if it could.
+ */
+bool ble_bond_is_peer(ble_gap_addr_t const *addr)
+{
+    ble_gap_addr_t const *peer = ble_bond_peer();
+
+    return peer != NULL && peer->addr_type == addr->addr_type &&
+           memcmp(peer->addr, addr->addr, BLE_GAP_ADDR_LEN) == 0;
+}
+
+/**
+ * Get the buffers to give to the SoftDevice for receiving the keys of a new
+ * pairing. The former bond is forgotten until ble_bond_save().
+ */
+ble_gap_sec_keyset_t *ble_bond_keyset(void)
+{
+    ble_bond.magic = 0;
+    return &ble_bond_keys;
+}
+
+/**
+ * Keep the keys of the pairing that just completed, or restore the former
+ * bond if it failed.
+ * @param peer_addr Address of the peer, or NULL if the pairing failed.
+ * @param peer_id_key Whether the peer distributed its identity key.
+ */
+void ble_bond_save(ble_gap_addr_t const *peer_addr, bool peer_id_key)
+{
+    if (peer_addr == NULL)
+    {
+        ble_bond_load();
+        return;
+    }
+
+    // Peers using private addresses are recognized by their identity address
+    ble_bond.peer_addr = peer_id_key ? ble_bond.peer_id.id_addr_info : *peer_addr;
+    ble_bond.has_peer_id = peer_id_key;
+    ble_bond.sys_attr_len = 0;
+    ble_bond.magic = BLE_BOND_MAGIC;
+    ble_bond_identities_dirty = true;
+    ble_bond_store();
+}
+
+/**
+ * Look up the key to encrypt the link with a peer reconnecting.
+ * @param master_id Identification of the key sent by the peer.
+ * @return The key, or NULL if it is not the bonded peer.
+ */
+ble_gap_enc_info_t const *ble_bond_enc_info(ble_gap_master_id_t const *master_id)
+{
+    if (ble_bond.magic != BLE_BOND_MAGIC)
+        return NULL;
+    if (master_id->ediv != ble_bond.own_enc.master_id.ediv)
+        return NULL;
+    if (memcmp(master_id->rand, ble_bond.own_enc.master_id.rand, BLE_GAP_SEC_RAND_LEN) != 0)
+        return NULL;
+    return &ble_bond.own_enc.enc_info;
+}
+
+/**
+ * Restore the GATT attributes of the bonded peer, such as which notifications
+ * it enabled, or start with the default ones.
+ * @param conn_handle Connection of the bonded peer.
+ */
+void ble_bond_load_sys_attr(uint16_t conn_handle)
+{
+    uint32_t err;
+
+    if (ble_bond.magic == BLE_BOND_MAGIC && ble_bond.sys_attr_len > 0)
+    {
+        err = sd_ble_gatts_sys_attr_set(conn_handle, ble_bond.sys_attr,
+                ble_bond.sys_attr_len, BLE_GATTS_SYS_ATTR_FLAG_USR_SRVCS);
+        if (err == NRF_SUCCESS)
+            return;
+        LOG_WARNING("stale attributes, err=0x%X", err);
+    }
+
+    err = sd_ble_gatts_sys_attr_set(conn_handle, NULL, 0, 0);
+    ASSERT(!err);
+}
+
+/**
+ * Cache the GATT attributes of the bonded peer for the next connection.
+ * Must be called before the connection handle becomes invalid.
+ * @param conn_handle Connection of the bonded peer.
+ */
+void ble_bond_save_sys_attr(uint16_t conn_handle)
+{
+    uint32_t err;
+    uint8_t buf[BLE_BOND_SYS_ATTR_MAX];
+    uint16_t len = sizeof(buf);
+
+    if (ble_bond.magic != BLE_BOND_MAGIC)
+        return;
+
+    err = sd_ble_gatts_sys_attr_get(conn_handle, buf, &len, BLE_GATTS_SYS_ATTR_FLAG_USR_SRVCS);
+    if (err != NRF_SUCCESS)
+    {
+        LOG_WARNING("no attributes cached, err=0x%X", err);
+        return;
+    }
+
+    // Avoid wearing the flash if nothing changed
+    if (len == ble_bond.sys_attr_len && memcmp(buf, ble_bond.sys_attr, len) == 0)
+        return;
+
+    memcpy(ble_bond.sys_attr, buf, len);
+    ble_bond.sys_attr_len = len;
+    ble_bond_store();
+}
+
+/**
+ * Let the SoftDevice resolve the private addresses of the bonded peer.
+ * Only possible while neither advertising nor connected.
+ */
+void ble_bond_update_identities(void)
+{
+    uint32_t err;
+    ble_gap_id_key_t const *id_keys[] = { &ble_bond.peer_id };
+
+    if (!ble_bond_identities_dirty)
+        return;
+
+    if (ble_bond.magic == BLE_BOND_MAGIC && ble_bond.has_peer_id)
+        err = sd_ble_gap_device_identities_set(id_keys, NULL, 1);
+    else
+        err = sd_ble_gap_device_identities_set(NULL, NULL, 0);
+
+    if (err == NRF_ERROR_INVALID_STATE || err == BLE_ERROR_GAP_DEVICE_IDENTITIES_IN_USE)
+        return;
+    ASSERT(!err);
+    ble_bond_identities_dirty = false;
+}
+
+/**
+ * Forget the bonded peer, which will have to pair again. Done from the
+ * SoftDevice event interrupt, which owns the bond, as it may be called from
+ * thread context.
+ */
+void ble_bond_clear(void)
+{
+    uint32_t err;
+
+    ble_bond_clear_pending = true;
+    err = sd_nvic_SetPendingIRQ(SD_EVT_IRQn);
+    ASSERT(!err);
+}
+
+/**
+ * Carry out the requests made from thread context. Called from the SoftDevice
+ * event interrupt after every batch of events.
+ */
+void ble_bond_run(void)
+{
+    if (!ble_bond_clear_pending)
+        return;
+    ble_bond_clear_pending = false;
+
+    memset(&ble_bond, 0, sizeof(ble_bond));
+    ble_bond_identities_dirty = true;
+    ble_bond_store();
+}
+
+/**
+ * Load the bond saved in flash, to be called before advertising.
+ */
+void ble_bond_init(void)
+{
+    ble_bond_load();
+    ble_bond_identities_dirty = true;
+    ble_bond_update_identities();
+}
@@ -0,0 +1,39 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Bond with the last connected peer, kept in a page of the internal flash,
+ * for encrypting the link again and restoring its GATT attributes without
+ * any new discovery.
+ */
+
+void ble_bond_init(void);
+void ble_bond_clear(void);
+ble_gap_sec_keyset_t *ble_bond_keyset(void);
+void ble_bond_save(ble_gap_addr_t const *peer_addr, bool peer_id_key);
+ble_gap_enc_info_t const *ble_bond_enc_info(ble_gap_master_id_t const *master_id);
+ble_gap_addr_t const *ble_bond_peer(void);
+bool ble_bond_is_peer(ble_gap_addr_t const *addr);
+void ble_bond_load_sys_attr(uint16_t conn_handle);
+void ble_bond_save_sys_attr(uint16_t conn_handle);
+void ble_bond_update_identities(void);
+void ble_bond_flash_event(bool success);
+void ble_bond_run(void);
@@ -23,29 +23,45 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define LOG_MODULE DATA
+
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 #include <string.h>
 
 #include "ble.h"
+#include "nrf.h"
 #include "nrfx_log.h"
 
 #include "driver/bluetooth_data_protocol.h"
 #include "driver/bluetooth_low_energy.h"
+#include "driver/capture_queue.h"
+#include "driver/flash.h"
+#include "driver/fpga.h"
+#include "driver/microphone.h"
 #include "driver/timer.h"
 
+#define ASSERT  NRFX_ASSERT
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+
 /**
  * @brief List of states for the data operations state machine.
  */
 typedef enum data_state_t
 {
     DATA_STATE_IDLE,
-    DATA_STATE_GET_CAM_METADATA,
-    DATA_STATE_BLE_CAM_SMALL_PAYLOAD,
+    DATA_STATE_GET_PREVIEW_METADATA,
+    DATA_STATE_GET_QUEUED_METADATA,
+    DATA_STATE_GET_STREAM_METADATA,
+    DATA_STATE_BLE_CAM_INFO,
     DATA_STATE_BLE_CAM_DATA_START,
     DATA_STATE_BLE_CAM_DATA_MIDDLE,
-    DATA_STATE_BLE_CAM_DATA_END,
+    DATA_STATE_BLE_CAM_WAIT_ACK,
+    DATA_STATE_BLE_MIC_DATA,
+    DATA_STATE_PAUSED,
 } data_state_t;
 
 /**
@@ -55,43 +71,85 @@ struct data_state_space_t
 {                                                             // ------------------------------------
     struct data_input                                         // Inputs
     {                                                         // ------------------------------------
-        bool camera_capture_flag;                             // Setting this flag starts a single camera capture. It's automatically cleared when read
         bool camera_stream_flag;                              // Setting this flag starts a continuos camera capture. It's not automatically cleared, stop must be used
         bool microphone_stream_flag;                          // Setting this flag starts a continuos microphone capture. It's not automatically cleared, stop must be used
         bool firmware_download_flag;                          // Setting this flag starts a firmware update. It's automatically cleared when read
         bool bitstream_download_flag;                         // Setting this flag starts a bitstream update. It's automatically cleared when read
-        bool stop_flag;                                       // Setting this flag stops one of the above transfers
+        bool camera_stop_flag;                                // Setting this flag stops the camera stream and the file being sent. It's automatically cleared when read
+        bool microphone_stop_flag;                            // Setting this flag stops the microphone stream. It's automatically cleared when read
+        bool resume_flag;                                     // Set by the host to restart the current file from resume_offset. It's automatically cleared when read
+        uint32_t resume_offset;                               // Offset requested by the host along with resume_flag
+        size_t preview_size;                                  // Size of the thumbnail to send ahead of the capture in progress, or 0
     } input;                                                  // ------------------------------------
     struct data_state                                         // Internal state variables
     {                                                         // ------------------------------------
         data_state_t current;                                 // Current state of the state machine. Set automatically within the state machine
         data_state_t next;                                    // Next state to go into. Set this value in the state switch() logic to change state
-        uint32_t seconds_elapsed;                             // How long we've been in the current state for. Set automatically within the state machine, and reset when a state changes
     } state;                                                  // ------------------------------------
+    struct data_stream                                        // Camera stream pacing, fed from the timer
+    {                                                         // ------------------------------------
+        uint32_t period_ms;                                   // Interval between two captures
+        uint32_t ticks_ms;                                    // Time since the last capture
+        uint32_t start_ms;                                    // Uptime at which the stream started
+        volatile bool capturing;                              // The FPGA is capturing a frame, until FPGA_EVENT_CAPTURE_DONE
+        volatile bool pending;                                // The FPGA holds a frame not sent yet, replaced by any newer capture
+        volatile bool sending;                                // The frame held by the FPGA is being sent, so no capture must overwrite it
+        uint16_t seq;                                         // Sequence number of the last frame captured
+        uint32_t captured_ms;                                 // Uptime at which it was captured
+        bluetooth_data_stream_stats_t stats;                  // Counters reported to the user
+    } stream;                                                 // ------------------------------------
     struct data_output                                        // Outputs
     {                                                         // ------------------------------------
         struct data_output_file                               // Metadata of the file to send
         {                                                     // ------------
             uint32_t size;                                    // File size
+            uint32_t crc32;                                   // CRC32 of the whole file, sent in the start frame
+            uint32_t acked_bytes;                             // How many bytes of the file the host acknowledged
+            uint32_t sent_ms;                                 // Uptime at which its last payload was prepared, for the acknowledgement to come
             char name[50];                                    // File name string. 50byte limit
+            uint8_t const *source;                            // Content of the file, unless queued or streamed
+            bool queued;                                      // Whether the file is a frame of the capture queue, read from the flash
+            uint8_t slot;                                     // Slot of that frame in the queue, or where to read the file from otherwise
+            bool preview;                                     // Whether the file is the thumbnail of the capture that follows
+            bool stream;                                      // Whether the file is a frame of the camera stream, read from the FPGA
+            uint16_t frame_seq;                               // Sequence number of that frame
+            uint32_t frame_ms;                                // Uptime at which that frame was captured
+            bool info;                                        // Whether frame_info is sent ahead of the file
+            bluetooth_data_frame_info_t frame_info;           // Metadata of the capture
         } file;                                               // ------------
         struct data_output_ble                                // Buffer payload and lengths for Bluetooth transfers
         {                                                     // ------------
-            uint8_t buffer[BLE_MAX_MTU_LENGTH];               // Buffer containing a single BLE payload
-            uint16_t mtu;                                     // MTU length - 3
-            uint16_t sent_bytes;                              // How many bytes of the current file have been sent so far
+            uint8_t *buffer;                                  // Buffer of the transport to fill with a single payload
+            uint16_t mtu;                                     // Room available in that buffer, which varies with the transport
+            uint16_t seq;                                     // Sequence number of the next chunk, reset on every start frame
+            uint32_t sent_bytes;                              // How many bytes of the current file have been sent so far
+            uint16_t len;                                     // Length of the payload in the buffer still waiting to be pulled, or 0
         } ble;                                                // ------------
+        bool host_acks;                                       // Whether the host sent an acknowledgement since it connected
         bool no_ble_error_flag;                               // Goes high if BLE is not connected ot enabled on the host. Must be cleared after read
         bool no_internet_error_flag;                          // Goes high if there is no internet connection. Must be cleared after read
     } output;                                                 // ------------------------------------
 } data = {
     .state.current = DATA_STATE_IDLE,
     .state.next = DATA_STATE_IDLE,
-    .state.seconds_elapsed = 0,
+    .stream.period_ms = 100,
 };
 
-// TODO remove this when no longer needed
-#include "dummy_data.h"
+static uint8_t data_preview[DATA_PREVIEW_MAX_SIZE];
+
+// Chunks not from a slot of the capture queue
+#define DATA_CHUNK_STREAM   0xFE                        // The frame held by the FPGA for the camera stream
+#define DATA_CHUNK_STATUS   0xFF                        // The capture status of the FPGA, with the size of that frame
+
+// Frames of the capture queue and of the camera stream are read one chunk at a time
+static struct
+{
+    uint8_t buf[4 + FLASH_ASYNC_READ_MAX];              // Data at buf[4], after the room for the read command
+    uint8_t slot;                                       // Slot of the queue the data is from, or DATA_CHUNK_*
+    uint32_t offset;                                    // Position of the data in that slot
+    size_t len;                                         // Length of the data, 0 if none
+    volatile bool loading;                              // The data is being read, until DATA_EVENT_SPI_DONE
+} data_chunk;
 
 static inline size_t strnlen(const char *s, size_t maxlen)
 {
@@ -117,6 +175,13 @@ static bool read_and_clear(bool *flag)
     return false;
 }
 
+static inline size_t data_encode_u16(uint8_t *buf, uint16_t u16)
+{
+    buf[0] = u16 >> 0;
+    buf[1] = u16 >> 8;
+    return 2;
+}
+
 static inline size_t data_encode_u32(uint8_t *buf, uint32_t u32)
 {
     buf[0] = u32 >> 0;
@@ -126,9 +191,9 @@ static inline size_t data_encode_u32(uint8_t *buf, uint32_t u32)
     return 4;
 }
 
-static inline size_t data_encode_str(uint8_t *buf, char *name)
+static inline size_t data_encode_str(uint8_t *buf, char *name, size_t maxlen)
 {
-    size_t len = strlen(name);
+    size_t len = strnlen(name, maxlen);
 
     buf[0] = len;
     memcpy(buf + 1, name, len);
@@ -141,223 +206,925 @@ static inline size_t data_encode_mem(uint8_t *buf, uint8_t const *mem, size_t le
     return len;
 }
 
+static inline uint32_t data_decode_u32(uint8_t const *buf)
+{
+    return buf[0] << 0 | buf[1] << 8 | buf[2] << 16 | buf[3] << 24;
+}
+
+/**
+ * @brief Update a CRC32 (IEEE 802.3, as used by zlib) with more data.
+ * @param crc The CRC of the data so far, 0 for the first call.
+ * @param buf The data to append.
+ * @param len Length of the data.
+ * @return The updated CRC.
+ */
+static uint32_t data_crc32(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    // Half-byte lookup table, to keep it small in flash
+    static const uint32_t tab[16] = {
+        0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+        0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+        0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+        0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C,
+    };
+
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++)
+    {
+        crc = tab[(crc ^ (buf[i] >> 0)) & 0x0F] ^ (crc >> 4);
+        crc = tab[(crc ^ (buf[i] >> 4)) & 0x0F] ^ (crc >> 4);
+    }
+    return ~crc;
+}
+
+/**
+ * @brief Queue the payload prepared in the output buffer for sending.
+ * @param len Length of the payload prepared in the buffer.
+ */
+static inline void data_queue_payload(size_t len)
+{
+    data.output.ble.len = len;
+}
+
+/**
+ * @brief The FPGA captured a new frame, which replaces the one not sent yet
+ *        if any. Called from the SPI interrupt.
+ */
+static void data_stream_capture_done(void)
+{
+    if (data.stream.pending)
+        data.stream.stats.dropped++;
+
+    data.stream.seq++;
+    data.stream.captured_ms = timer_get_uptime_ms();
+    data.stream.stats.captured++;
+    data.stream.pending = true;
+    data.stream.capturing = false;
+
+    bluetooth_data_event(DATA_EVENT_SPI_DONE);
+}
+
+/**
+ * @brief Handler of the FPGA events, from the GPIOTE or SPI interrupt.
+ */
+static void data_stream_event_handler(uint16_t events)
+{
+    if (events & FPGA_EVENT_CAPTURE_DONE && data.stream.capturing)
+        data_stream_capture_done();
+}
+
+/**
+ * @brief Capture a new frame at every period, unless the previous one is
+ *        still being sent, in which case this one is dropped: the stream
+ *        always sends the newest frame instead of accumulating a backlog.
+ */
+static void data_stream_timer_handler(void)
+{
+    if (!data.input.camera_stream_flag)
+        return;
+    if (data.stream.capturing)
+    {
+        // Do not stall the stream if the end of the capture was not signaled
+        if (++data.stream.ticks_ms >= DATA_STREAM_CAPTURE_TIMEOUT_MS)
+        {
+            data.stream.stats.capture_timeouts++;
+            data_stream_capture_done();
+        }
+        return;
+    }
+    if (++data.stream.ticks_ms < data.stream.period_ms)
+        return;
+
+    __disable_irq();
+    if (data.stream.sending)
+    {
+        // The link is slower than the capture
+        data.stream.stats.dropped++;
+        data.stream.ticks_ms = 0;
+    }
+    else
+    {
+        data.stream.capturing = true;
+    }
+    __enable_irq();
+
+    if (!data.stream.capturing)
+        return;
+
+    // Retry at the next tick if too many transactions wait for the bus, the
+    // end of the capture being signaled by FPGA_EVENT_CAPTURE_DONE
+    if (fpga_camera_capture_async(NULL))
+        data.stream.ticks_ms = 0;
+    else
+        data.stream.capturing = false;
+}
+
+/**
+ * @brief Take the latest frame captured for sending, preventing any new
+ *        capture from overwriting it until data_stream_frame_sent().
+ * @return True if there was a frame to send.
+ */
+static bool data_stream_take_frame(void)
+{
+    bool taken = false;
+
+    __disable_irq();
+    if (data.stream.pending && !data.stream.capturing)
+    {
+        data.stream.pending = false;
+        data.stream.sending = true;
+        taken = true;
+    }
+    __enable_irq();
+
+    if (taken)
+    {
+        data.output.file.stream = true;
+        data.output.file.frame_seq = data.stream.seq;
+        data.output.file.frame_ms = data.stream.captured_ms;
+    }
+    return taken;
+}
+
+/**
+ * @brief Stop capturing frames for the stream. A frame being sent is let go
+ *        by data_stream_frame_sent().
+ */
+static void data_stream_stop(void)
+{
+    data.input.camera_stream_flag = false;
+    timer_del_handler(data_stream_timer_handler);
+}
+
+/**
+ * @brief The current frame of the stream is sent, or abandoned if the stream
+ *        stopped: let the timer capture the next one.
+ * @param complete Whether the frame was sent up to the end.
+ */
+static void data_stream_frame_sent(bool complete)
+{
+    if (!data.output.file.stream)
+        return;
+
+    if (complete)
+    {
+        data.stream.stats.sent++;
+        data.stream.stats.latency_ms = timer_get_uptime_ms() - data.output.file.frame_ms;
+    }
+    data.output.file.stream = false;
+    data.stream.sending = false;
+}
+
+/**
+ * @brief A chunk of the capture queue was read from the flash. Called from
+ *        the SPI interrupt.
+ */
+static void data_chunk_loaded(void)
+{
+    data_chunk.loading = false;
+    bluetooth_data_event(DATA_EVENT_SPI_DONE);
+}
+
+/**
+ * @brief Get part of a slot of the capture queue, reading it from the flash
+ *        if it is not the chunk already in RAM, or the next part of the frame
+ *        of the stream, which the FPGA only gives in order.
+ * @param slot Slot of the queue, or DATA_CHUNK_STREAM.
+ * @param offset Position in the slot, or in the frame.
+ * @param want Number of bytes to read if a new chunk is needed.
+ * @param len Set to the number of bytes available from there.
+ * @return The data, or NULL while it is being read, until DATA_EVENT_SPI_DONE.
+ */
+static uint8_t const *data_chunk_get(uint8_t slot, uint32_t offset, size_t want, size_t *len)
+{
+    bool started;
+
+    if (data_chunk.loading)
+        return NULL;
+
+    if (data_chunk.len > 0 && data_chunk.slot == slot &&
+        offset >= data_chunk.offset && offset < data_chunk.offset + data_chunk.len)
+    {
+        *len = data_chunk.offset + data_chunk.len - offset;
+        return data_chunk.buf + 4 + offset - data_chunk.offset;
+    }
+
+    data_chunk.slot = slot;
+    data_chunk.offset = offset;
+    data_chunk.len = MIN(want, FLASH_ASYNC_READ_MAX);
+    data_chunk.loading = true;
+    if (slot == DATA_CHUNK_STREAM)
+    {
+        // The FPGA answers after the two bytes of the command, so the data also lands at buf[4]
+        started = fpga_capture_get_data_async(data_chunk.buf + 2, 2 + data_chunk.len,
+                data_chunk_loaded);
+    }
+    else
+    {
+        started = capture_queue_read_async(slot, offset, data_chunk.buf, data_chunk.len,
+                data_chunk_loaded);
+    }
+    ASSERT(started);
+    return NULL;
+}
+
+/**
+ * @brief Get the size of the frame of the stream held by the FPGA, which its
+ *        capture status tells in bytes.
+ * @param size Set to the size of the frame.
+ * @return False while the status is being read, until DATA_EVENT_SPI_DONE.
+ */
+static bool data_chunk_get_stream_size(uint32_t *size)
+{
+    bool started;
+
+    if (data_chunk.loading)
+        return false;
+
+    if (data_chunk.slot != DATA_CHUNK_STATUS)
+    {
+        data_chunk.slot = DATA_CHUNK_STATUS;
+        data_chunk.len = 0;
+        data_chunk.loading = true;
+        started = fpga_capture_get_status_async(data_chunk.buf, data_chunk_loaded);
+        ASSERT(started);
+        return false;
+    }
+
+    *size = data_chunk.buf[2] << 8 | data_chunk.buf[3] << 0;
+
+    // Nothing of the frame itself is read yet
+    data_chunk.slot = DATA_CHUNK_STREAM;
+    return true;
+}
+
+/**
+ * @brief Check the end of a frame of the stream, once its data reaches the
+ *        size from the capture status. That status is only 16 bits wide, so
+ *        the size of a frame of 64 KB or more wraps around, which then does
+ *        not end with the End Of Image marker of JPEG, 0xFF 0xD9.
+ * @param source Data about to be sent.
+ * @param len Length of that data.
+ * @return True if it ends the file without ending the frame.
+ */
+static bool data_stream_frame_cut(uint8_t const *source, size_t len)
+{
+    if (!data.output.file.stream || data.output.ble.sent_bytes + len < data.output.file.size)
+        return false;
+    if (source[len - 1] == 0xD9 && (len < 2 || source[len - 2] == 0xFF))
+        return false;
+
+    LOG_WARNING("frame seq=%d larger than its size=%d", data.output.file.frame_seq,
+            data.output.file.size);
+    data.stream.stats.oversized++;
+    return true;
+}
+
+/**
+ * @brief Get the content of the file being sent from a given offset.
+ * @param offset Position in the file.
+ * @param len Set to the number of bytes available from there.
+ * @return The data, or NULL while it is being read from the flash or the FPGA.
+ */
+static uint8_t const *data_file_data(uint32_t offset, size_t *len)
+{
+    if (data.output.file.queued)
+        return data_chunk_get(data.output.file.slot, CAPTURE_QUEUE_DATA_OFFSET + offset,
+                data.output.file.size - offset, len);
+    if (data.output.file.stream)
+        return data_chunk_get(DATA_CHUNK_STREAM, offset, data.output.file.size - offset, len);
+
+    *len = data.output.file.size - offset;
+    return data.output.file.source + offset;
+}
+
+/**
+ * @brief Tell if a file is being sent, or was cut before its end by the loss
+ *        of the link, as opposed to a file sent up to the end, which the
+ *        host may have received whole even without acknowledging it.
+ */
+static inline bool data_file_sending(void)
+{
+    switch (data.state.current)
+    {
+    case DATA_STATE_BLE_CAM_INFO:
+    case DATA_STATE_BLE_CAM_DATA_START:
+    case DATA_STATE_BLE_CAM_DATA_MIDDLE:
+    case DATA_STATE_BLE_CAM_WAIT_ACK:
+    case DATA_STATE_PAUSED:
+        return data.output.file.size > 0;
+
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Wake the state machine up once the frame of the queue sent last
+ *        waited long enough for its acknowledgement.
+ */
+static void data_ack_timer_handler(void)
+{
+    if ((uint32_t)timer_get_uptime_ms() - data.output.file.sent_ms < DATA_ACK_TIMEOUT_MS)
+        return;
+    timer_del_handler(data_ack_timer_handler);
+    bluetooth_data_event(DATA_EVENT_OPERATION);
+}
+
+/**
+ * @brief The last payload of the file is prepared: wait for the host to
+ *        acknowledge it if it is a frame of the queue.
+ * @return The state to go to next.
+ */
+static data_state_t data_file_sent(void)
+{
+    if (!data.output.file.queued)
+        return DATA_STATE_IDLE;
+
+    // Only a host that never acknowledged anything may never do it
+    data.output.file.sent_ms = timer_get_uptime_ms();
+    if (!data.output.host_acks)
+        timer_add_handler(data_ack_timer_handler);
+    return DATA_STATE_BLE_CAM_WAIT_ACK;
+}
+
 /**
  * @brief State machine which handles all data operations such as OTA and file
- *        transfers.
+ *        transfers. It is run from the SoftDevice event interrupt each time the
+ *        multiplexer pulls the media channel, and stepped until it prepares a
+ *        payload or cannot progress further.
+ * @return True if the state machine made progress and can be stepped again.
  */
-static void data_state_machine(void)
+static bool data_state_machine(void)
 {
-    // List of flags to append in the header when we send file chunks over BLE
+    // List of flags to append in the header when we send file chunks over BLE.
+    // The 0x10 bit tells the v2 framing, which carries a sequence number and offset.
     enum ble_file_flag
     {
-        BLE_FILE_SMALL_FLAG = 0,
-        BLE_FILE_START_FLAG = 1,
-        BLE_FILE_MIDDLE_FLAG = 2,
-        BLE_FILE_END_FLAG = 3,
+        BLE_FILE_SMALL_FLAG = 0x10,
+        BLE_FILE_START_FLAG = 0x11,
+        BLE_FILE_MIDDLE_FLAG = 0x12,
+        BLE_FILE_END_FLAG = 0x13,
+        BLE_FILE_STREAM_START_FLAG = 0x14,  // Start of a frame of the camera stream, with its sequence number and timestamp
+        BLE_FILE_STREAM_SMALL_FLAG = 0x15,  // Whole frame of the camera stream in a single payload
+        BLE_FILE_PREVIEW_START_FLAG = 0x16, // Start of the thumbnail sent ahead of a capture
+        BLE_FILE_PREVIEW_SMALL_FLAG = 0x17, // Whole thumbnail in a single payload
+        BLE_FILE_INFO_FLAG = 0x18,          // Metadata of the capture whose start frame follows
+    };
+
+    // Header of the compressed microphone frames, which never mix with files
+    enum ble_mic_flag
+    {
+        BLE_MIC_FLAG = 0x20,
     };
 
-    // // State machine logic
+    // If the link is lost in the middle of a file, keep it paused until the host resumes it
+    if (!ble_is_connected())
+    {
+        if (data.state.current != DATA_STATE_IDLE || data.input.camera_stream_flag)
+            data.output.no_ble_error_flag = true;
+
+        data.input.preview_size = 0;
+        data.output.ble.len = 0;
+        data.output.host_acks = false;
+
+        // A frame of the stream is already stale, do not resume it
+        data_stream_stop();
+        if (data.output.file.stream)
+        {
+            data_stream_frame_sent(false);
+            data.output.file.size = 0;
+        }
+
+        if (data_file_sending())
+        {
+            data.state.current = data.state.next = DATA_STATE_PAUSED;
+        }
+        else
+        {
+            data.output.file.size = 0;
+            data.state.current = data.state.next = DATA_STATE_IDLE;
+        }
+        return false;
+    }
+
+    // If the host asks to send the current file again from a given offset,
+    // which is ignored once the state machine moved on to something else,
+    // and for frames of the stream, which the FPGA only gives in order
+    if (read_and_clear(&data.input.resume_flag))
+    {
+        if (data_file_sending() && !data.output.file.stream &&
+            data.input.resume_offset <= data.output.file.size)
+        {
+            LOG("resume offset=%d", data.input.resume_offset);
+            data.output.ble.sent_bytes = data.input.resume_offset;
+            data.output.ble.len = 0;
+            data.state.current = DATA_STATE_BLE_CAM_DATA_START;
+        }
+    }
+
+    // State machine logic
     switch (data.state.current)
     {
+    case DATA_STATE_PAUSED:
     case DATA_STATE_IDLE:
-    LOG("DATA_STATE_IDLE");
     {
-        // If a stop is requested
-        if (read_and_clear(&data.input.stop_flag))
+        // If the microphone stream is stopped, which leaves any paused transfer
+        if (read_and_clear(&data.input.microphone_stop_flag))
+            data.input.microphone_stream_flag = false;
+
+        // If the camera stream is stopped
+        if (read_and_clear(&data.input.camera_stop_flag))
         {
-            // Clear the streaming flag
-            data.input.camera_stream_flag = false;
+            // Stop capturing, and drop the frame being sent
+            data_stream_stop();
+            data_stream_frame_sent(false);
+
+            // Forget about the paused transfer
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
         }
 
-        // If a camera capture or stream is requested
-        if (read_and_clear(&data.input.camera_capture_flag) ||
-            data.input.camera_stream_flag)
+        // If the thumbnail of a capture is ready
+        if (data.input.preview_size > 0)
         {
             // Go get the image metadata
-            data.state.next = DATA_STATE_GET_CAM_METADATA;
+            data.output.file.stream = false;
+            data.state.next = DATA_STATE_GET_PREVIEW_METADATA;
             break;
         }
 
-        // TODO microphone
+        // If the camera stream captured a new frame
+        if (data.input.camera_stream_flag && data_stream_take_frame())
+        {
+            // Its size is read again, as is any chunk of a previous frame
+            data_chunk.slot = DATA_CHUNK_STREAM;
+            data_chunk.len = 0;
+            data.state.next = DATA_STATE_GET_STREAM_METADATA;
+            break;
+        }
+
+        // If a microphone stream is requested
+        if (data.input.microphone_stream_flag)
+        {
+            // It replaces the paused transfer if any, as would a new file
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_BLE_MIC_DATA;
+            break;
+        }
+
+        // Send the captures from the queue, oldest first, so those taken while
+        // the host could not receive them come first, and again the one cut by
+        // the loss of the link, unless another file is paused
+        if ((data.state.current != DATA_STATE_PAUSED || data.output.file.queued) &&
+            capture_queue_next(&data.output.file.slot, &data.output.file.acked_bytes))
+        {
+            data.output.file.queued = true;
+
+            // The slot may have been reused since its last chunk was read
+            data_chunk.len = 0;
+            data.state.next = DATA_STATE_GET_QUEUED_METADATA;
+            break;
+        }
 
         // TODO firmware update
 
         // TODO bitstream update
 
-        // Stop the timer callback if there's nothing to do
-        timer_del_handler(&data_state_machine);
-        break;
+        // Nothing to do until the next event
+        return false;
     }
 
-    case DATA_STATE_GET_CAM_METADATA:
-    LOG("DATA_STATE_GET_CAM_METADATA");
+    case DATA_STATE_GET_PREVIEW_METADATA:
+    LOG_DEBUG("DATA_STATE_GET_PREVIEW_METADATA");
     {
-        // Get the file size
-        data.output.file.size = sizeof(dummy_jpeg_file); // TODO spi
-
-        // Get the filename
-        size_t len = snprintf(data.output.file.name, sizeof data.output.file.name, "test_file.jpg"); // TODO spi
-
-        // Set the MTU length
-        data.output.ble.mtu = ble_negotiated_mtu - 3;
+        // The thumbnail read ahead of the capture, sent while the capture is being taken,
+        // which then follows from the capture queue
+        data.output.file.queued = false;
+        data.output.file.preview = true;
+        data.output.file.info = false;
+        data.output.file.source = data_preview;
+        data.output.file.size = data.input.preview_size;
+        snprintf(data.output.file.name, sizeof data.output.file.name, "preview.jpg");
+        data.input.preview_size = 0;
+
+        // Checksum of the whole file, for the host to check it after reassembly
+        data.output.file.crc32 = data_crc32(0, data.output.file.source, data.output.file.size);
+
+        // Nothing received by the host yet
+        data.output.file.acked_bytes = 0;
 
         // Reset the number of sent bytes
         data.output.ble.sent_bytes = 0;
 
-        // If the payload is smaller than a single payload
-        if (data.output.file.size + len + 6 <= data.output.ble.mtu)
-        {
-            // Go to small payload state
-            data.state.next = DATA_STATE_BLE_CAM_SMALL_PAYLOAD;
-        }
-        else
+        // Send the first chunk along with the metadata
+        data.state.next = DATA_STATE_BLE_CAM_DATA_START;
+        break;
+    }
+
+    case DATA_STATE_GET_QUEUED_METADATA:
+    LOG_DEBUG("DATA_STATE_GET_QUEUED_METADATA");
+    {
+        capture_queue_entry_t entry;
+        uint8_t const *header;
+        size_t len;
+
+        // Wait for the header of the slot, with the metadata of the frame
+        header = data_chunk_get(data.output.file.slot, 0, CAPTURE_QUEUE_HEADER_SIZE, &len);
+        if (header == NULL)
+            return false;
+
+        if (len < CAPTURE_QUEUE_HEADER_SIZE || !capture_queue_decode(header, &entry))
         {
-            // Otherwise go to data start state
-            data.state.next = DATA_STATE_BLE_CAM_DATA_START;
+            capture_queue_skip(data.output.file.slot);
+            data.output.file.queued = false;
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
         }
+
+        // Named after its id, for the host to tell it if it gets it again
+        data.output.file.preview = false;
+        data.output.file.stream = false;
+        data.output.file.info = true;
+        data.output.file.frame_info = entry.info;
+        data.output.file.source = NULL;
+        data.output.file.size = entry.size;
+        data.output.file.crc32 = entry.crc32;
+        snprintf(data.output.file.name, sizeof data.output.file.name, "capture_%lu.jpg",
+                (unsigned long)entry.id);
+
+        // Resume from what the host acknowledged before, if anything
+        data.output.ble.sent_bytes = data.output.file.acked_bytes;
+
+        data.state.next = DATA_STATE_BLE_CAM_INFO;
         break;
     }
 
-    case DATA_STATE_BLE_CAM_SMALL_PAYLOAD:
-    LOG("DATA_STATE_BLE_CAM_SMALL_PAYLOAD");
+    case DATA_STATE_GET_STREAM_METADATA:
+    LOG_DEBUG("DATA_STATE_GET_STREAM_METADATA");
     {
-        size_t i = 0;
+        uint32_t size;
 
-        // Append the small file flag
-        data.output.ble.buffer[i++] = BLE_FILE_SMALL_FLAG;
+        // Wait for the size of the newest frame, read from the FPGA like its data
+        if (!data_chunk_get_stream_size(&size))
+            return false;
 
-        // Insert the filesize
-        i += data_encode_u32(data.output.ble.buffer + i, data.output.file.size);
+        if (size == 0)
+        {
+            data_stream_frame_sent(false);
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
+        }
 
-        // Add the file name
-        i += data_encode_str(data.output.ble.buffer + i, data.output.file.name);
+        // Frames of the stream are captured from an interrupt, without reading
+        // the sensor, and sent as they are read: no metadata packet, and no
+        // checksum, left to 0 for the host to skip it
+        data.output.file.queued = false;
+        data.output.file.preview = false;
+        data.output.file.info = false;
+        data.output.file.source = NULL;
+        data.output.file.size = size;
+        data.output.file.crc32 = 0;
+        data.output.file.acked_bytes = 0;
+        data.output.ble.sent_bytes = 0;
 
-        // Append the data into the remaining buffer space
-        i += data_encode_mem(data.output.ble.buffer + i, dummy_jpeg_file, data.output.file.size);
+        data.state.next = DATA_STATE_BLE_CAM_DATA_START;
+        break;
+    }
 
-        // Send the data
-        ble_raw_tx(data.output.ble.buffer, i);
+    case DATA_STATE_BLE_CAM_INFO:
+    LOG_DEBUG("DATA_STATE_BLE_CAM_INFO");
+    {
+        bluetooth_data_frame_info_t const *info = &data.output.file.frame_info;
+        size_t i = 0;
 
-        // Return to IDLE
-        data.state.next = DATA_STATE_IDLE;
+        // Fits in the smallest payload of GATT
+        ASSERT(data.output.ble.mtu >= 19);
+
+        data.output.ble.buffer[i++] = BLE_FILE_INFO_FLAG;
+        i += data_encode_u16(data.output.ble.buffer + i, info->seq);
+        i += data_encode_u32(data.output.ble.buffer + i, info->captured_ms);
+        i += data_encode_u32(data.output.ble.buffer + i, info->exposure);
+        i += data_encode_u16(data.output.ble.buffer + i, info->gain);
+        data.output.ble.buffer[i++] = info->luma;
+        data.output.ble.buffer[i++] = info->scale;
+        i += data_encode_u16(data.output.ble.buffer + i, info->width);
+        i += data_encode_u16(data.output.ble.buffer + i, info->height);
+
+        data.state.next = DATA_STATE_BLE_CAM_DATA_START;
+        data_queue_payload(i);
         break;
     }
 
     case DATA_STATE_BLE_CAM_DATA_START:
-    LOG("DATA_STATE_BLE_CAM_DATA_START");
+    LOG_DEBUG("DATA_STATE_BLE_CAM_DATA_START");
     {
-        size_t i = 0, len;
+        uint8_t const *source;
+        size_t i = 1, len;
 
-        // Append the start file flag
-        data.output.ble.buffer[i++] = BLE_FILE_START_FLAG;
+        // Wait for the data of the queued or streamed frames to be read
+        source = data_file_data(data.output.ble.sent_bytes, &len);
+        if (source == NULL)
+            return false;
 
-        // Insert the filesize
-        i += data_encode_u32(data.output.ble.buffer + i, data.output.file.size);
+        // Restart the sequence numbers
+        data.output.ble.seq = 0;
 
-        // Add the file name
-        i += data_encode_str(data.output.ble.buffer + i, data.output.file.name);
+        // Insert the chunk sequence number, always 0 in a start frame, so
+        // frames of the stream carry their own sequence number instead
+        i += data_encode_u16(data.output.ble.buffer + i, data.output.file.stream ?
+                data.output.file.frame_seq : data.output.ble.seq);
+        data.output.ble.seq++;
 
-        // Append the data into the remaining buffer space
-        len = data.output.ble.mtu - i;
-        i += data_encode_mem(data.output.ble.buffer + i, dummy_jpeg_file, len);
+        // Insert the offset
+        i += data_encode_u32(data.output.ble.buffer + i, data.output.ble.sent_bytes);
 
-        // Send the data. If not successful
-        ble_raw_tx(data.output.ble.buffer, i);
+        // Insert the filesize and checksum
+        i += data_encode_u32(data.output.ble.buffer + i, data.output.file.size);
+        i += data_encode_u32(data.output.ble.buffer + i, data.output.file.crc32);
+
+        // Frames of the stream have a capture time rather than a name
+        if (data.output.file.stream)
+        {
+            i += data_encode_u32(data.output.ble.buffer + i, data.output.file.frame_ms);
+        }
+        else
+        {
+            // Add the file name, leaving room for at least one byte of data
+            i += data_encode_str(data.output.ble.buffer + i, data.output.file.name,
+                    MIN(sizeof data.output.file.name, data.output.ble.mtu - i - 2));
+        }
+
+        // Append the data into the remaining buffer space, unless it ends a
+        // frame of the stream cut short, which the host then never gets whole
+        len = MIN(data.output.ble.mtu - i, len);
+        if (data_stream_frame_cut(source, len))
+        {
+            data_stream_frame_sent(false);
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
+        }
+        i += data_encode_mem(data.output.ble.buffer + i, source, len);
 
         // Increment the sent bytes
         data.output.ble.sent_bytes += len;
 
-        // If there is less than one MTU length worth of data length
-        if (1 + data.output.file.size - data.output.ble.sent_bytes <= data.output.ble.mtu)
+        // If the whole file fits in a single payload, or it is the continuation of one
+        if (data.output.ble.sent_bytes == data.output.file.size)
         {
-            // Go to the end data state
-            data.state.next = DATA_STATE_BLE_CAM_DATA_END;
+            data.output.ble.buffer[0] = data.output.file.stream ? BLE_FILE_STREAM_SMALL_FLAG :
+                    data.output.file.preview ? BLE_FILE_PREVIEW_SMALL_FLAG : BLE_FILE_SMALL_FLAG;
+            data_stream_frame_sent(true);
+            data.state.next = data_file_sent();
         }
         else
         {
-            // Otherwise go to middle data state
+            data.output.ble.buffer[0] = data.output.file.stream ? BLE_FILE_STREAM_START_FLAG :
+                    data.output.file.preview ? BLE_FILE_PREVIEW_START_FLAG : BLE_FILE_START_FLAG;
             data.state.next = DATA_STATE_BLE_CAM_DATA_MIDDLE;
         }
+
+        // Send the data
+        data_queue_payload(i);
         break;
     }
 
     case DATA_STATE_BLE_CAM_DATA_MIDDLE:
-    LOG("DATA_STATE_BLE_CAM_DATA_MIDDLE");
     {
-        size_t i = 0, len;
+        uint8_t const *source;
+        size_t i = 1, len;
 
-        // Append the middle of file flag
-        data.output.ble.buffer[i++] = BLE_FILE_MIDDLE_FLAG;
+        // If the user cancels the transfer, along with the camera stream
+        if (read_and_clear(&data.input.camera_stop_flag))
+        {
+            // Return to IDLE
+            data_stream_stop();
+            data_stream_frame_sent(false);
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
+        }
 
-        // Append the data into the remaining buffer space
-        len = data.output.ble.mtu - i;
-        i += data_encode_mem(data.output.ble.buffer + i,
-                dummy_jpeg_file + data.output.ble.sent_bytes,
-                len);
+        // Wait for the data of the queued or streamed frames to be read
+        source = data_file_data(data.output.ble.sent_bytes, &len);
+        if (source == NULL)
+            return false;
 
-        // Send the data. If not successful
-        ble_raw_tx(data.output.ble.buffer, i);
+        // Insert the chunk sequence number and offset
+        i += data_encode_u16(data.output.ble.buffer + i, data.output.ble.seq++);
+        i += data_encode_u32(data.output.ble.buffer + i, data.output.ble.sent_bytes);
+
+        // Append the data into the remaining buffer space, unless it ends a
+        // frame of the stream cut short, which the host then never gets whole
+        len = MIN(data.output.ble.mtu - i, len);
+        if (data_stream_frame_cut(source, len))
+        {
+            data_stream_frame_sent(false);
+            data.output.file.size = 0;
+            data.state.next = DATA_STATE_IDLE;
+            break;
+        }
+        i += data_encode_mem(data.output.ble.buffer + i, source, len);
 
         // Increment the sent bytes
         data.output.ble.sent_bytes += len;
 
-        // If the user cancels the transfer
-        if (data.input.stop_flag)
+        // If this was the last chunk, mark it as such and return to IDLE
+        if (data.output.ble.sent_bytes == data.output.file.size)
         {
-            // Return to IDLE
-            data.state.next = DATA_STATE_IDLE;
-            break;
+            LOG_DEBUG("DATA_STATE_BLE_CAM_DATA_MIDDLE: end of file");
+            data.output.ble.buffer[0] = BLE_FILE_END_FLAG;
+            data_stream_frame_sent(true);
+            data.state.next = data_file_sent();
+        }
+        else
+        {
+            data.output.ble.buffer[0] = BLE_FILE_MIDDLE_FLAG;
         }
 
-        // If there is less than one MTU length worth of data length
-        if (1 + data.output.file.size - data.output.ble.sent_bytes <=
-            data.output.ble.mtu)
+        // Send the data
+        data_queue_payload(i);
+        break;
+    }
+
+    case DATA_STATE_BLE_CAM_WAIT_ACK:
+    LOG_DEBUG("DATA_STATE_BLE_CAM_WAIT_ACK");
+    {
+        // A frame of the queue is only dropped once acknowledged, and sent
+        // again when the host resumes it or at the next connection otherwise
+        if (data.output.file.acked_bytes < data.output.file.size && !data.input.camera_stop_flag)
         {
-            // Go to the end data state
-            data.state.next = DATA_STATE_BLE_CAM_DATA_END;
-            break;
+            // A host that acknowledges may be slow, keep the frame until it does
+            if (data.output.host_acks)
+            {
+                timer_del_handler(data_ack_timer_handler);
+                return false;
+            }
+            if ((uint32_t)timer_get_uptime_ms() - data.output.file.sent_ms < DATA_ACK_TIMEOUT_MS)
+                return false;
+
+            // A host that never acknowledged on this connection got the whole
+            // frame, as the link stayed up
+            LOG_WARNING("no ack slot=%d", data.output.file.slot);
+            data.output.file.acked_bytes = data.output.file.size;
+            capture_queue_acked(data.output.file.slot, data.output.file.size, data.output.file.size);
         }
 
-        // Otherwise stay in the middle state
+        timer_del_handler(data_ack_timer_handler);
+        data.state.next = DATA_STATE_IDLE;
         break;
     }
 
-    case DATA_STATE_BLE_CAM_DATA_END:
-    LOG("DATA_STATE_BLE_CAM_DATA_END");
+    case DATA_STATE_BLE_MIC_DATA:
     {
-        size_t i = 0;
+        size_t len;
 
-        // Add the end flag
-        data.output.ble.buffer[i++] = BLE_FILE_END_FLAG;
+        // If the user stops the stream
+        if (read_and_clear(&data.input.microphone_stop_flag))
+        {
+            data.input.microphone_stream_flag = false;
+            data.state.next = DATA_STATE_IDLE;
+            break;
+        }
 
-        // Append the data into the remaining buffer space
-        i += data_encode_mem(data.output.ble.buffer + i,
-               dummy_jpeg_file + data.output.ble.sent_bytes, // TODO spi
-               data.output.file.size - data.output.ble.sent_bytes);
+        // The camera stream is stopped even though it cannot send while the
+        // microphone stream goes on
+        if (read_and_clear(&data.input.camera_stop_flag))
+            data_stream_stop();
 
-        // Send the data
-        ble_raw_tx(data.output.ble.buffer, i);
+        // Compress the samples read so far, or wait for DATA_EVENT_SPI_DONE
+        len = microphone_read_frame(data.output.ble.buffer + 1, data.output.ble.mtu - 1);
+        if (len == 0)
+            return false;
 
-        // Return to IDLE
-        data.state.next = DATA_STATE_IDLE;
+        data.output.ble.buffer[0] = BLE_MIC_FLAG;
+        data_queue_payload(1 + len);
         break;
     }
     }
 
-    // Increment the seconds timer
-    data.state.seconds_elapsed++;
+    // Set the current state to the next state ready for next entry
+    data.state.current = data.state.next;
 
-    // If we're changing states
-    if (data.state.current != data.state.next)
+    return true;
+}
+
+/**
+ * @brief Handle a command written by the host on the data service.
+ *        Called from the SoftDevice event interrupt.
+ * @param buf The data written by the host.
+ * @param len Length of that data.
+ */
+void bluetooth_data_rx(uint8_t const *buf, size_t len)
+{
+    // List of commands the host can send to the data service
+    enum ble_file_cmd
     {
-        // Reset the elapsed time in the current state
-        data.state.seconds_elapsed = 0;
+        BLE_FILE_CMD_RESUME = 0x01, // Send the current file again from the given offset
+        BLE_FILE_CMD_ACK = 0x02,    // Acknowledge reception of the file up to the given offset
+    };
 
-        // Set the current state to the next state ready for next entry
-        data.state.current = data.state.next;
+    if (len < 5)
+    {
+        LOG_WARNING("ignoring short command, len=%d", len);
+        return;
+    }
+
+    switch (buf[0])
+    {
+    case BLE_FILE_CMD_RESUME:
+    {
+        data.input.resume_offset = data_decode_u32(buf + 1);
+        data.input.resume_flag = true;
+        bluetooth_data_event(DATA_EVENT_OPERATION);
+        break;
+    }
+
+    case BLE_FILE_CMD_ACK:
+    {
+        uint32_t offset = data_decode_u32(buf + 1);
+
+        data.output.host_acks = true;
+        if (offset > data.output.file.acked_bytes && offset <= data.output.file.size)
+        {
+            data.output.file.acked_bytes = offset;
+
+            // Keep the progress of the queued frames across resets, and send the next one once complete
+            if (data.output.file.queued)
+            {
+                capture_queue_acked(data.output.file.slot, offset, data.output.file.size);
+                if (offset == data.output.file.size)
+                    bluetooth_data_event(DATA_EVENT_OPERATION);
+            }
+        }
+        break;
+    }
+
+    default:
+    {
+        LOG_WARNING("unknown command 0x%02X", buf[0]);
+        break;
+    }
     }
 }
 
+/**
+ * @brief Notify the state machine that something happened, so that it gets
+ *        stepped from the SoftDevice event interrupt. Can be called from any
+ *        context, except DATA_EVENT_DISCONNECTED which is raised from the
+ *        SoftDevice event interrupt itself.
+ * @param event The event that occurred.
+ */
+void bluetooth_data_event(data_event_t event)
+{
+    switch (event)
+    {
+    case DATA_EVENT_DISCONNECTED:
+    {
+        // The media channel is not pulled while disconnected: pause right away
+        data_state_machine();
+        return;
+    }
+
+    default:
+    {
+        break;
+    }
+    }
+
+    // Have the multiplexer pull the media channel
+    ble_channel_ready(BLE_CHANNEL_MEDIA);
+}
+
+/**
+ * @brief Step the state machine until it prepares a payload, and hand it
+ *        over to the multiplexer. Every payload carries its own offset, so its
+ *        size may change from one to the next, such as when the transport
+ *        switches between L2CAP and GATT. Called from the SoftDevice event
+ *        interrupt.
+ * @param buf Buffer to fill with the payload.
+ * @param len Maximum length of the payload.
+ * @return Length of the payload, or 0 if there is nothing left to send.
+ */
+size_t bluetooth_data_pull(uint8_t *buf, size_t len)
+{
+    // The payload is built directly in the buffer of the transport, GATT or L2CAP
+    data.output.ble.buffer = buf;
+    data.output.ble.mtu = len;
+
+    while (data.output.ble.len == 0 && data_state_machine())
+        continue;
+
+    len = data.output.ble.len;
+    data.output.ble.len = 0;
+    data.output.ble.buffer = NULL;
+    return len;
+}
+
 /**
  * @brief Starts/stops a data operation of a given type to the mobile over
  *        BLE, or WiFi to a server.
@@ -366,19 +1133,61 @@ static void data_state_machine(void)
  */
 bool bluetooth_data_operation(data_op_t op)
 {
-    if (data.state.current != DATA_STATE_IDLE)
+    // Stopping is always accepted, whatever is in progress, and only stops
+    // what it is for, so that the other stream goes on
+    switch (op)
+    {
+    case DATA_OP_CAMERA_STOP:
+    LOG("DATA_OP_CAMERA_STOP");
+    {
+        data.input.camera_stop_flag = true;
+        bluetooth_data_event(DATA_EVENT_OPERATION);
+        return true;
+    }
+
+    case DATA_OP_MICROPHONE_STOP:
+    LOG("DATA_OP_MICROPHONE_STOP");
+    {
+        data.input.microphone_stop_flag = true;
+        bluetooth_data_event(DATA_EVENT_OPERATION);
+        return true;
+    }
+
+    case DATA_OP_STOP:
+    LOG("DATA_OP_STOP");
+    {
+        data.input.camera_stop_flag = true;
+        data.input.microphone_stop_flag = true;
+        bluetooth_data_event(DATA_EVENT_OPERATION);
+        return true;
+    }
+
+    default:
+    {
+        break;
+    }
+    }
+
+    // A transfer paused by the loss of the link gives way to any new one
+    if (data.state.current != DATA_STATE_IDLE && data.state.current != DATA_STATE_PAUSED)
         return false;
 
     // Based on the requested action
     switch (op)
     {
-    // If a single camera capture
+    // If a capture was stored in the capture queue
     case DATA_OP_CAMERA_CAPTURE:
     LOG("DATA_OP_CAMERA_CAPTURE");
     {
-        // Initiate a capture
-        data.input.camera_capture_flag = true;
+        // Sent from the queue, after the captures queued before
+        break;
+    }
 
+    // If the thumbnail of a capture is ready, set with bluetooth_data_set_preview()
+    case DATA_OP_CAMERA_PREVIEW:
+    LOG("DATA_OP_CAMERA_PREVIEW");
+    {
+        // Sent as soon as the state machine picks it
         break;
     }
 
@@ -386,7 +1195,15 @@ bool bluetooth_data_operation(data_op_t op)
     case DATA_OP_CAMERA_STREAM:
     LOG("DATA_OP_CAMERA_STREAM");
     {
-        // Initiate a capture
+        // Start capturing at the configured pace
+        data.stream.ticks_ms = data.stream.period_ms;
+        data.stream.start_ms = timer_get_uptime_ms();
+        data.stream.capturing = false;
+        data.stream.pending = false;
+        data.stream.sending = false;
+        memset(&data.stream.stats, 0, sizeof data.stream.stats);
+        fpga_subscribe(FPGA_EVENT_CAPTURE_DONE, data_stream_event_handler);
+        timer_add_handler(data_stream_timer_handler);
         data.input.camera_stream_flag = true;
 
         break;
@@ -396,6 +1213,9 @@ bool bluetooth_data_operation(data_op_t op)
     case DATA_OP_MICROPHONE_STREAM:
     LOG("DATA_OP_MICROPHONE_STREAM");
     {
+        // Send the samples as they arrive, until stopped
+        data.input.microphone_stream_flag = true;
+
         break;
     }
 
@@ -413,20 +1233,58 @@ bool bluetooth_data_operation(data_op_t op)
         break;
     }
 
-    // If a stop command is requested
-    case DATA_OP_STOP:
-    LOG("DATA_OP_STOP");
-    {
-        data.input.stop_flag = true;
-        break;
-    }
-
     default:
         break;
     }
 
-    // Start the timer
-    timer_add_handler(&data_state_machine);
+    // Let the state machine pick the new request
+    bluetooth_data_event(DATA_EVENT_OPERATION);
 
     return true;
 }
+
+/**
+ * @brief Set the pace of the camera stream.
+ * @param period_ms Interval between two captures, in milliseconds.
+ */
+void bluetooth_data_stream_period(uint32_t period_ms)
+{
+    data.stream.period_ms = period_ms > 0 ? period_ms : 1;
+}
+
+/**
+ * @brief Get the statistics of the camera stream, since it last started.
+ * @param stats Filled with the counters.
+ */
+void bluetooth_data_stream_stats(bluetooth_data_stream_stats_t *stats)
+{
+    __disable_irq();
+    *stats = data.stream.stats;
+    __enable_irq();
+    stats->elapsed_ms = timer_get_uptime_ms() - data.stream.start_ms;
+}
+
+/**
+ * @brief Get the buffer in which to read the thumbnail of the next capture.
+ * @return The buffer of DATA_PREVIEW_MAX_SIZE bytes, or NULL if a transfer is
+ *         in progress, which may still be sending the previous thumbnail.
+ */
+uint8_t *bluetooth_data_get_preview_buffer(void)
+{
+    if ((data.state.current != DATA_STATE_IDLE && data.state.current != DATA_STATE_PAUSED) ||
+        data.input.preview_size > 0)
+        return NULL;
+    return data_preview;
+}
+
+/**
+ * @brief Have the thumbnail read in the buffer from
+ *        bluetooth_data_get_preview_buffer() sent with DATA_OP_CAMERA_PREVIEW,
+ *        as a separate file ahead of the capture.
+ * @param len Size of the thumbnail.
+ */
+void bluetooth_data_set_preview(size_t len)
+{
+    ASSERT(len <= DATA_PREVIEW_MAX_SIZE);
+    data.input.preview_size = len;
+}
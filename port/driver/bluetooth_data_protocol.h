@@ -31,16 +31,78 @@
 typedef enum data_op_t
 {
     // Types of transaction which may be selected
-    DATA_OP_CAMERA_CAPTURE,     // Capture a single image over Bluetooth or WiFi
+    DATA_OP_CAMERA_CAPTURE,     // Send a capture stored in the capture queue, after those before it
+    DATA_OP_CAMERA_PREVIEW,     // Send the thumbnail of the capture in progress, ahead of it
     DATA_OP_CAMERA_STREAM,      // Streams frames continuously over WiFi
     DATA_OP_MICROPHONE_STREAM,  // Continuously streams microphone data over Bluetooth or WiFi
     DATA_OP_FIRMWARE_DOWNLOAD,  // Downloads a firmware update over WiFi
     DATA_OP_BITSTREAM_DOWNLOAD, // Downloads an FPGA bitstream over WiFi
 
     // Stops an ongoing transaction
-    DATA_OP_STOP,
+    DATA_OP_CAMERA_STOP,        // Stops the camera stream, and the capture being sent
+    DATA_OP_MICROPHONE_STOP,    // Stops the microphone stream
+    DATA_OP_STOP,               // Stops both
 } data_op_t;
 
+/**
+ * Events that let the data operations state machine progress.
+ */
+typedef enum data_event_t
+{
+    DATA_EVENT_OPERATION,       // A new data operation was requested
+    DATA_EVENT_CONNECTED,       // The host subscribed to the data service, and can get the capture queue
+    DATA_EVENT_DISCONNECTED,    // The link was lost, raised from the SoftDevice event interrupt only
+    DATA_EVENT_SPI_DONE,        // A chunk of data was read from the FPGA or the flash
+} data_event_t;
+
+/**
+ * Room for a thumbnail sent ahead of a capture.
+ */
+#define DATA_PREVIEW_MAX_SIZE       2048
+
+/**
+ * Longest wait for the FPGA to signal the end of a capture of the stream.
+ */
+#define DATA_STREAM_CAPTURE_TIMEOUT_MS  200
+
+/**
+ * Longest wait for the host to acknowledge a frame of the capture queue sent
+ * whole. It is then taken as delivered, for hosts that never acknowledge:
+ * once the host acknowledged anything since it connected, the frame is kept
+ * until it does.
+ */
+#define DATA_ACK_TIMEOUT_MS             2000
+
+/**
+ * Statistics of the camera stream.
+ */
+typedef struct
+{
+    uint32_t captured;          // Frames captured by the FPGA
+    uint32_t sent;              // Frames sent completely
+    uint32_t dropped;           // Frames skipped or replaced by a newer one before being sent
+    uint32_t capture_timeouts;  // Captures whose end was not signaled by the FPGA
+    uint32_t oversized;         // Frames of 64 KB or more, not sent whole as their size does not fit the capture status
+    uint32_t latency_ms;        // Time from capture to the end of sending, for the last frame sent
+    uint32_t elapsed_ms;        // Time since the stream started
+} bluetooth_data_stream_stats_t;
+
+/**
+ * Metadata of a captured frame, sent in a packet of its own ahead of the
+ * frame, so that the host can reject bad frames before receiving them.
+ */
+typedef struct
+{
+    uint16_t seq;               // Sequence number of the capture
+    uint32_t captured_ms;       // Uptime at which the frame was captured
+    uint32_t exposure;          // Exposure time, in 1/16 of a line
+    uint16_t gain;              // Sensor gain, in 1/16
+    uint8_t luma;               // Average luminance measured by the sensor
+    uint8_t scale;              // Factor the frame was reduced by
+    uint16_t width;             // Size of the frame
+    uint16_t height;
+} bluetooth_data_frame_info_t;
+
 /**
  * Starts/stops a data operation of a given type to the mobile over BLE, or WiFi to a server.
  * @param channel: Type of operation to request.
@@ -48,3 +110,51 @@ typedef enum data_op_t
  * @return True if the operation is accepted, false if already in progress.
  */
 bool bluetooth_data_operation(data_op_t op);
+
+/**
+ * Raise an event for the state machine to be run again, from any context.
+ * @param event: Type of event that occurred.
+ */
+void bluetooth_data_event(data_event_t event);
+
+/**
+ * Handle a command sent by the host to the data service, such as resuming a
+ * transfer from a given offset.
+ * @param buf: Data written by the host.
+ * @param len: Length of the data.
+ */
+void bluetooth_data_rx(uint8_t const *buf, size_t len);
+
+/**
+ * Producer of the media channel: run the state machine until it prepares a packet.
+ * @param buf Buffer to fill with the packet.
+ * @param len Maximum length of the packet.
+ * @return Length of the packet, or 0 if there is nothing to send.
+ */
+size_t bluetooth_data_pull(uint8_t *buf, size_t len);
+
+/**
+ * Set the interval between two captures of the camera stream.
+ * @param period_ms: Interval in milliseconds.
+ */
+void bluetooth_data_stream_period(uint32_t period_ms);
+
+/**
+ * Get the statistics of the camera stream, since it last started.
+ * @param stats: Filled with the counters.
+ */
+void bluetooth_data_stream_stats(bluetooth_data_stream_stats_t *stats);
+
+/**
+ * Get the buffer in which to read the thumbnail of the next capture.
+ * @return The buffer of DATA_PREVIEW_MAX_SIZE bytes, or NULL if a transfer is in progress.
+ */
+uint8_t *bluetooth_data_get_preview_buffer(void);
+
+/**
+ * Have the thumbnail read in that buffer sent with DATA_OP_CAMERA_PREVIEW,
+ * ahead of the capture that follows.
+ * @param len: Size of the thumbnail.
+ */
+void bluetooth_data_set_preview(size_t len);
+
@@ -23,25 +23,41 @@
  */
 
 /**
- * Bluetooth Low Energy (BLE) driver with Nordic UART Service console.
+ * Bluetooth Low Energy (BLE) driver with Nordic UART Service console,
+ * and a multiplexer sharing the link between several logical channels.
  */
 
+#define LOG_MODULE BLE
+
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
 
 #include "ble.h"
 #include "nrf_clock.h"
+#include "nrf_nvic.h"
 #include "nrf_sdm.h"
 #include "nrfx_log.h"
 
+#include "driver/bluetooth_bond.h"
+#include "driver/bluetooth_data_protocol.h"
 #include "driver/bluetooth_low_energy.h"
 #include "driver/config.h"
+#include "driver/timer.h"
 
 #define BLE_ADV_MAX_SIZE            31
 #define BLE_UUID_COUNT              2
+#define BLE_HVN_TX_QUEUE_SIZE       4
+
+/** Dynamic LE PSM on which the host opens the L2CAP channel for bulk data. */
+#define BLE_L2CAP_PSM               0x0080
+/** Largest SDU sent over L2CAP, each one carrying a single data protocol payload. */
+#define BLE_L2CAP_SDU_LENGTH        256
+/** Number of SDUs queued at once, each needs its own buffer until BLE_L2CAP_EVT_CH_TX. */
+#define BLE_L2CAP_TX_QUEUE_SIZE     2
 
 #define ASSERT  NRFX_ASSERT
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
 
 /** Buffer sizes for REPL ring buffers; +45 allows a bytearray to be printed in one go. */
 #define RING_BUFFER_LENGTH (1024 + 45)
@@ -83,6 +99,18 @@ static uint32_t ram_start = (uint32_t)&_ram_start;
 /** MTU length obtained by the negotiation with the currently connected peer. */
 uint16_t ble_negotiated_mtu;
 
+/** Address of the connected peer, resolved to its identity address if it is bonded. */
+static ble_gap_addr_t ble_peer_addr;
+
+/** Set when the connected peer is the bonded one, and its attributes are cached. */
+static bool ble_peer_bonded;
+
+/** Set when the connected peer asked for the key of the bond. */
+static bool ble_peer_key_given;
+
+/** Set while advertising to the bonded peer only. */
+static bool ble_adv_directed;
+
 
 // Ring buffer library
 
@@ -125,12 +153,182 @@ static inline uint8_t ring_pop(ring_buf_t *ring)
     return byte;
 }
 
+// Connection parameters manager
+
+/** Time without traffic after which the link goes back to slow intervals. */
+static uint32_t ble_conn_idle_ms = 2000;
+
+/** Minimum time between two requests, to avoid flapping between states. */
+#define BLE_CONN_RETRY_MS           1000
+
+/**
+ * Parameters requested in each state: short intervals without latency during
+ * transfers, long intervals with slave latency to save power when idle.
+ */
+static ble_gap_conn_params_t const ble_conn_params[BLE_CONN_STATE_NUM] = {
+    [BLE_CONN_FAST] = {
+        .min_conn_interval = (7500) / 1250,
+        .max_conn_interval = (15 * 1000) / 1250,
+        .slave_latency = 0,
+        .conn_sup_timeout = (2000 * 1000) / 10000,
+    },
+    [BLE_CONN_SLOW] = {
+        .min_conn_interval = (100 * 1000) / 1250,
+        .max_conn_interval = (200 * 1000) / 1250,
+        .slave_latency = 4,
+        .conn_sup_timeout = (6000 * 1000) / 10000,
+    },
+};
+
+static struct {
+    ble_conn_state_t state;         // State last requested to the central
+    ble_conn_state_t applied;       // State of the parameters the central applied
+    volatile uint64_t activity_ms;  // Time of the last packet sent or received
+    uint64_t request_ms;            // Time of the last request sent to the central
+    uint64_t state_ms;              // Time at which the applied state was entered
+    ble_conn_stats_t stats;         // Counters exposed to the user
+} ble_conn;
+
+/**
+ * Tell which state some parameters chosen by the central belong to, as it may
+ * pick other values than those requested: no slower than the fast ones
+ * counts as fast.
+ */
+static ble_conn_state_t ble_conn_classify(ble_gap_conn_params_t const *params)
+{
+    if (params->max_conn_interval <= ble_conn_params[BLE_CONN_FAST].max_conn_interval &&
+        params->slave_latency == 0)
+        return BLE_CONN_FAST;
+    return BLE_CONN_SLOW;
+}
+
+/**
+ * Account the time spent with the parameters in use, and switch to those
+ * the central just applied.
+ */
+static void ble_conn_applied(ble_gap_conn_params_t const *params)
+{
+    uint64_t now = timer_get_uptime_ms();
+
+    ble_conn.stats.time_ms[ble_conn.applied] += now - ble_conn.state_ms;
+    ble_conn.state_ms = now;
+    ble_conn.applied = ble_conn_classify(params);
+    ble_conn.stats.count[ble_conn.applied]++;
+    ble_conn.stats.interval_us = params->max_conn_interval * 1250;
+    ble_conn.stats.latency = params->slave_latency;
+}
+
+/**
+ * Ask the central for the parameters of a new state.
+ */
+static void ble_conn_request(ble_conn_state_t state)
+{
+    uint32_t err;
+    uint64_t now = timer_get_uptime_ms();
+
+    if (now - ble_conn.request_ms < BLE_CONN_RETRY_MS)
+        return;
+    ble_conn.request_ms = now;
+
+    err = sd_ble_gap_conn_param_update(ble_conn_handle, &ble_conn_params[state]);
+
+    // A procedure is already ongoing, retry later
+    if (err == NRF_ERROR_BUSY || err == NRF_ERROR_INVALID_STATE)
+    {
+        ble_conn.stats.rejected++;
+        return;
+    }
+    ASSERT(!err);
+
+    // Accounted once the central applies it, with BLE_GAP_EVT_CONN_PARAM_UPDATE
+    ble_conn.state = state;
+}
+
+/**
+ * @return The state matching the recent traffic.
+ */
+static inline ble_conn_state_t ble_conn_wanted(void)
+{
+    uint64_t now = timer_get_uptime_ms();
+
+    return now - ble_conn.activity_ms < ble_conn_idle_ms ? BLE_CONN_FAST : BLE_CONN_SLOW;
+}
+
+/**
+ * Request new parameters if the traffic changed. Called from the SoftDevice event interrupt only.
+ */
+static void ble_conn_run(void)
+{
+    ble_conn_state_t state;
+
+    if (ble_conn_handle == BLE_CONN_HANDLE_INVALID)
+        return;
+
+    state = ble_conn_wanted();
+    if (state != ble_conn.state)
+        ble_conn_request(state);
+}
+
+/**
+ * Watch for the quiet period to expire, and have the parameters changed from
+ * the SoftDevice event interrupt.
+ */
+static void ble_conn_timer_handler(void)
+{
+    if (ble_conn_handle == BLE_CONN_HANDLE_INVALID)
+        return;
+
+    if (ble_conn_wanted() != ble_conn.state &&
+        timer_get_uptime_ms() - ble_conn.request_ms >= BLE_CONN_RETRY_MS)
+        sd_nvic_SetPendingIRQ(SD_EVT_IRQn);
+}
+
+/**
+ * Note that some traffic went through the link, which keeps the fast intervals.
+ */
+static inline void ble_conn_activity(void)
+{
+    ble_conn.activity_ms = timer_get_uptime_ms();
+}
+
+/**
+ * Set how long the link stays idle before going to slow intervals.
+ * @param ms Quiet period in milliseconds.
+ */
+void ble_conn_set_idle_ms(uint32_t ms)
+{
+    ble_conn_idle_ms = ms;
+}
+
+/**
+ * @return The quiet period in milliseconds.
+ */
+uint32_t ble_conn_get_idle_ms(void)
+{
+    return ble_conn_idle_ms;
+}
+
+/**
+ * Get the connection parameters statistics.
+ * @param stats Filled with a copy of the counters, including the time spent in the current state.
+ */
+void ble_conn_get_stats(ble_conn_stats_t *stats)
+{
+    __disable_irq();
+    *stats = ble_conn.stats;
+    stats->state = ble_conn.applied;
+    if (ble_conn_handle != BLE_CONN_HANDLE_INVALID)
+        stats->time_ms[ble_conn.applied] += timer_get_uptime_ms() - ble_conn.state_ms;
+    __enable_irq();
+}
+
 // Nordic UART Service service functions
 
 /**
- * Send a buffer out, retrying continuously until it goes to completion (with success or failure).
+ * Queue a buffer for sending, without waiting for the SoftDevice queue to have room.
+ * @return False if the queue is full, in which case BLE_GATTS_EVT_HVN_TX_COMPLETE tells when to retry.
  */
-static void ble_tx(ble_service_t *service, uint8_t const *buf, uint16_t len)
+static bool ble_tx_try(ble_service_t *service, uint8_t const *buf, uint16_t len)
 {
     uint32_t err;
     ble_gatts_hvx_params_t hvx_params = {
@@ -140,66 +338,372 @@ static void ble_tx(ble_service_t *service, uint8_t const *buf, uint16_t len)
         .type = BLE_GATT_HVX_NOTIFICATION,
     };
 
-    do {
-        ASSERT(ble_conn_handle != BLE_CONN_HANDLE_INVALID);
+    // Send the data
+    err = sd_ble_gatts_hvx(ble_conn_handle, &hvx_params);
 
-        // Send the data
-        err = sd_ble_gatts_hvx(ble_conn_handle, &hvx_params);
-
-    // Retry if resources are unavailable.
-    } while (err == NRF_ERROR_RESOURCES);
+    // No buffer left in the queue
+    if (err == NRF_ERROR_RESOURCES)
+        return false;
 
     // Ignore errors if not connected
     if (err == NRF_ERROR_INVALID_STATE || err == BLE_ERROR_INVALID_CONN_HANDLE)
-        return;
+        return true;
 
     // Catch other errors
     ASSERT(!err);
+    return true;
+}
+
+// Transfer multiplexer
+
+/**
+ * Number of notification buffers kept for the highest priority channels, so
+ * that bulk transfers never fill the SoftDevice queue completely and
+ * interactive output gets out on the next connection event.
+ */
+#define BLE_MUX_RESERVED_CREDITS    1
+
+/**
+ * Logical channel sharing the BLE link with the others.
+ */
+typedef struct {
+    ble_service_t *service;         // GATT service on which the packets are notified
+    ble_channel_pull_t *pull;       // Fills the next packet of the channel
+    uint8_t priority;               // Lower values are always served first
+    uint8_t weight;                 // Share of the link among channels of same priority
+    bool l2cap;                     // Sent over the L2CAP channel when the host opened one
+    int16_t current;                // Weighted round-robin counter
+    volatile bool ready;            // Set when the producer has something to send
+    uint64_t ready_ms;              // Timestamp of when the channel became ready
+    ble_channel_stats_t stats;      // Counters exposed to the user
+} ble_channel_state_t;
+
+static size_t ble_nus_pull(uint8_t *buf, size_t len);
+static inline void ble_conn_activity(void);
+
+static ble_channel_state_t ble_channels[BLE_CHANNEL_NUM] = {
+    [BLE_CHANNEL_REPL] = {
+        .service = &ble_nus_service, .pull = ble_nus_pull,
+        .priority = 0, .weight = 1,
+    },
+    [BLE_CHANNEL_MEDIA] = {
+        .service = &ble_raw_service, .pull = bluetooth_data_pull,
+        .priority = 1, .weight = 1, .l2cap = true,
+    },
+};
+
+/** Number of notifications the SoftDevice can still accept. */
+static uint8_t ble_tx_credits;
+
+/** Packet pulled from a channel, waiting for a free SoftDevice buffer. */
+static struct {
+    uint8_t buf[BLE_MAX_MTU_LENGTH];
+    uint16_t len;
+    ble_channel_t channel;
+} ble_mux_pending;
+
+/** L2CAP connection-oriented channel opened by the host, if any. */
+static struct {
+    uint16_t cid;                   // Local channel ID, or BLE_L2CAP_CID_INVALID
+    uint16_t tx_mtu;                // Largest SDU the host accepts
+    uint16_t tx_mps;                // Largest PDU, each consuming one credit
+    uint16_t credits;               // PDUs the host is ready to receive
+    uint16_t sdu_len[BLE_L2CAP_TX_QUEUE_SIZE];  // Length of the SDU in each buffer, 0 if free
+    uint8_t sdu_buf[BLE_L2CAP_TX_QUEUE_SIZE][BLE_L2CAP_SDU_LENGTH];
+} ble_l2cap = {
+    .cid = BLE_L2CAP_CID_INVALID,
+};
+
+/**
+ * Forget the L2CAP channel, after which its channels go back to GATT.
+ */
+static void ble_l2cap_reset(void)
+{
+    ble_l2cap.cid = BLE_L2CAP_CID_INVALID;
+    ble_l2cap.credits = 0;
+    memset(ble_l2cap.sdu_len, 0, sizeof ble_l2cap.sdu_len);
+}
+
+/**
+ * Release the SDU buffer returned by the SoftDevice.
+ */
+static void ble_l2cap_release(uint8_t const *p_data)
+{
+    for (size_t i = 0; i < BLE_L2CAP_TX_QUEUE_SIZE; i++)
+        if (ble_l2cap.sdu_buf[i] == p_data)
+            ble_l2cap.sdu_len[i] = 0;
+}
+
+/**
+ * @return A free SDU buffer index, or -1 if all are queued in the SoftDevice.
+ */
+static int ble_l2cap_free_sdu(void)
+{
+    for (size_t i = 0; i < BLE_L2CAP_TX_QUEUE_SIZE; i++)
+        if (ble_l2cap.sdu_len[i] == 0)
+            return i;
+    return -1;
+}
+
+/**
+ * @return The number of credits needed to send a SDU, split into PDUs with a 2-byte SDU length header.
+ */
+static inline uint16_t ble_l2cap_credits_for(uint16_t len)
+{
+    return (len + 2 + ble_l2cap.tx_mps - 1) / ble_l2cap.tx_mps;
+}
+
+/**
+ * Tell if the channel is sent over L2CAP rather than GATT notifications.
+ */
+static inline bool ble_channel_uses_l2cap(ble_channel_t ch)
+{
+    return ble_channels[ch].l2cap && ble_l2cap.cid != BLE_L2CAP_CID_INVALID;
+}
+
+/**
+ * Tell if the transport of a channel has room for one more packet.
+ */
+static bool ble_channel_can_send(ble_channel_t ch)
+{
+    // Keep the GATT packet free to fall back on if the L2CAP channel goes away
+    if (ble_channel_uses_l2cap(ch))
+        return ble_l2cap_free_sdu() >= 0 && ble_l2cap.credits > 0 && ble_mux_pending.len == 0;
+
+    // Keep a few buffers for the interactive channels
+    if (ble_channels[ch].priority > 0)
+        return ble_tx_credits > BLE_MUX_RESERVED_CREDITS;
+    return ble_tx_credits > 0;
 }
 
 /**
- * Sends all buffered data in the tx ring buffer over BLE.
+ * Choose the next channel to serve: the ready channel of highest priority,
+ * and among several of the same priority, a smooth weighted round-robin.
+ * @return The channel to serve, or BLE_CHANNEL_NUM if none can be served.
  */
-static void ble_nus_flush_tx(void)
+static ble_channel_t ble_mux_pick(void)
 {
-    // Local buffer for sending data
-    uint8_t buf[BLE_MAX_MTU_LENGTH] = "";
-    uint16_t len = 0;
+    ble_channel_t best = BLE_CHANNEL_NUM;
+    uint8_t priority = UINT8_MAX;
+    int16_t total = 0;
+
+    // Find the highest priority with something to send and room to send it
+    for (ble_channel_t ch = 0; ch < BLE_CHANNEL_NUM; ch++)
+        if (ble_channels[ch].ready && ble_channels[ch].priority < priority &&
+            ble_channel_can_send(ch))
+            priority = ble_channels[ch].priority;
+
+    // Every ready channel of that priority earns its weight, the richest wins
+    for (ble_channel_t ch = 0; ch < BLE_CHANNEL_NUM; ch++)
+    {
+        ble_channel_state_t *state = &ble_channels[ch];
+
+        if (!state->ready || state->priority != priority || !ble_channel_can_send(ch))
+            continue;
+        state->current += state->weight;
+        total += state->weight;
+        if (best == BLE_CHANNEL_NUM || state->current > ble_channels[best].current)
+            best = ch;
+    }
+
+    // The winner pays for all the others
+    if (best != BLE_CHANNEL_NUM)
+        ble_channels[best].current -= total;
+    return best;
+}
+
+/**
+ * Account a packet handed to the SoftDevice into the channel statistics.
+ */
+static void ble_mux_account(ble_channel_t ch, uint16_t len)
+{
+    ble_channel_state_t *state = &ble_channels[ch];
+
+    state->stats.bytes += len;
+    state->stats.packets++;
+    ble_conn_activity();
+
+    // The latency is measured for the first packet after the channel went ready
+    if (state->ready_ms != 0)
+    {
+        uint32_t latency_ms = timer_get_uptime_ms() - state->ready_ms;
+
+        state->stats.latency_sum_ms += latency_ms;
+        state->stats.latency_count++;
+        if (latency_ms > state->stats.latency_max_ms)
+            state->stats.latency_max_ms = latency_ms;
+        state->ready_ms = 0;
+    }
+}
+
+/**
+ * Send the GATT packet pulled earlier.
+ * @return False if the SoftDevice had no room left for it.
+ */
+static bool ble_mux_send_pending(void)
+{
+    // If the SoftDevice has no room left, retry after the next TX complete event
+    if (!ble_tx_try(ble_channels[ble_mux_pending.channel].service,
+            ble_mux_pending.buf, ble_mux_pending.len))
+    {
+        ble_tx_credits = 0;
+        return false;
+    }
 
-    // If not connected, do not flush.
+    ble_tx_credits--;
+    ble_mux_account(ble_mux_pending.channel, ble_mux_pending.len);
+    ble_mux_pending.len = 0;
+    return true;
+}
+
+/**
+ * Pull a SDU from a channel and queue it on the L2CAP channel.
+ * @return False if the channel had nothing to send.
+ */
+static bool ble_mux_send_l2cap(ble_channel_t ch)
+{
+    uint32_t err;
+    int i = ble_l2cap_free_sdu();
+    uint16_t len = BLE_L2CAP_SDU_LENGTH;
+
+    ASSERT(i >= 0);
+
+    // Do not pull more than the host can receive right now
+    len = MIN(len, ble_l2cap.tx_mtu);
+    len = MIN(len, ble_l2cap.credits * ble_l2cap.tx_mps - 2);
+
+    len = ble_channels[ch].pull(ble_l2cap.sdu_buf[i], len);
+    if (len == 0)
+        return false;
+
+    ble_data_t sdu = { .p_data = ble_l2cap.sdu_buf[i], .len = len };
+    err = sd_ble_l2cap_ch_tx(ble_conn_handle, ble_l2cap.cid, &sdu);
+
+    // If the channel is going away, fall back to GATT. The channel already moved
+    // past the payload, so it is sent as a notification if it fits in one, such
+    // as the microphone frames. Otherwise the data protocol resumes from the
+    // offset the host asks for.
+    if (err == NRF_ERROR_INVALID_STATE || err == NRF_ERROR_NOT_FOUND ||
+        err == BLE_ERROR_INVALID_CONN_HANDLE)
+    {
+        ble_l2cap_reset();
+        if (len > ble_negotiated_mtu)
+        {
+            LOG_WARNING("dropped len=%d larger than the MTU", len);
+            return true;
+        }
+        memcpy(ble_mux_pending.buf, ble_l2cap.sdu_buf[i], len);
+        ble_mux_pending.channel = ch;
+        ble_mux_pending.len = len;
+        if (ble_tx_credits > 0)
+            ble_mux_send_pending();
+        return true;
+    }
+    ASSERT(!err);
+
+    // The buffer stays with the SoftDevice until BLE_L2CAP_EVT_CH_TX
+    ble_l2cap.sdu_len[i] = len;
+    ble_l2cap.credits -= MIN(ble_l2cap.credits, ble_l2cap_credits_for(len));
+    ble_mux_account(ch, len);
+    return true;
+}
+
+/**
+ * Hand packets from the ready channels over to the SoftDevice, for as long
+ * as it has free buffers. Called from the SoftDevice event interrupt only.
+ */
+static void ble_mux_run(void)
+{
     if (ble_conn_handle == BLE_CONN_HANDLE_INVALID)
         return;
 
-    // If there's no data to send, simply return
-    if (ring_empty(&nus_tx))
-        return;
+    // A packet pulled earlier goes first, the data is already out of its channel.
+    // Until it is sent, there are no credits left for the other GATT channels.
+    if (ble_mux_pending.len > 0 && ble_tx_credits > 0)
+        ble_mux_send_pending();
 
-    // For all the remaining characters, i.e until the heads come back together
-    while (!ring_empty(&nus_tx))
+    while (1)
     {
-        // Copy over a character from the tail to the outgoing buffer
-        buf[len++] = ring_pop(&nus_tx);
+        ble_channel_t ch = ble_mux_pick();
+        if (ch == BLE_CHANNEL_NUM)
+            return;
 
-        // Break if we over-run the negotiated MTU size, send the rest later
-        if (len >= ble_negotiated_mtu)
-            break;
+        // Clear the flag first, so that a producer setting it meanwhile is not lost
+        ble_channels[ch].ready = false;
+
+        if (ble_channel_uses_l2cap(ch))
+        {
+            if (!ble_mux_send_l2cap(ch))
+                continue;
+        }
+        else
+        {
+            ble_mux_pending.channel = ch;
+            ble_mux_pending.len = ble_channels[ch].pull(ble_mux_pending.buf,
+                    ble_negotiated_mtu);
+            if (ble_mux_pending.len == 0)
+                continue;
+            ble_mux_send_pending();
+        }
+
+        // A channel is served until it has nothing more to pull
+        ble_channels[ch].ready = true;
     }
-    ble_tx(&ble_nus_service, buf, len);
 }
 
-int ble_nus_rx(void)
+/**
+ * Tell the multiplexer that a channel has data to send. Can be called from any context.
+ * @param ch The channel which has new data.
+ */
+void ble_channel_ready(ble_channel_t ch)
 {
-    while (ring_empty(&nus_rx))
-    {
-        // While waiting for incoming data, we can push outgoing data
-        ble_nus_flush_tx();
+    ASSERT(ch < BLE_CHANNEL_NUM);
+    ASSERT(ble_channels[ch].pull != NULL);
 
-        // If there's nothing to do
-        if (ring_empty(&nus_tx) && ring_empty(&nus_rx))
-            // Wait for events to save power
-            sd_app_evt_wait();
+    if (!ble_channels[ch].ready)
+    {
+        ble_channels[ch].ready_ms = timer_get_uptime_ms();
+        ble_channels[ch].ready = true;
     }
 
+    // Trigger the SoftDevice event interrupt, which runs the multiplexer
+    sd_nvic_SetPendingIRQ(SD_EVT_IRQn);
+}
+
+/**
+ * Get the transfer statistics of a channel.
+ * @param ch The channel to query.
+ * @param stats Filled with a copy of the counters.
+ */
+void ble_channel_get_stats(ble_channel_t ch, ble_channel_stats_t *stats)
+{
+    ASSERT(ch < BLE_CHANNEL_NUM);
+
+    __disable_irq();
+    *stats = ble_channels[ch].stats;
+    __enable_irq();
+}
+
+// Nordic UART Service service functions
+
+/**
+ * Pull characters from the REPL tx ring buffer, as the REPL channel producer.
+ */
+static size_t ble_nus_pull(uint8_t *buf, size_t len)
+{
+    size_t i;
+
+    for (i = 0; i < len && !ring_empty(&nus_tx); i++)
+        buf[i] = ring_pop(&nus_tx);
+    return i;
+}
+
+int ble_nus_rx(void)
+{
+    // Wait for events to save power, outgoing data is sent from the interrupt
+    while (ring_empty(&nus_rx))
+        sd_app_evt_wait();
+
     // Return next character from the RX buffer.
     return ring_pop(&nus_rx);
 }
@@ -209,9 +713,25 @@ void ble_nus_tx(char const *buf, size_t len)
     for (size_t i = 0; i < len; i++)
     {
         while (ring_full(&nus_tx))
-            ble_nus_flush_tx();
+        {
+            // Drop the output rather than block if nobody listens
+            if (ble_conn_handle == BLE_CONN_HANDLE_INVALID)
+                return;
+
+            // Let the multiplexer drain the ring buffer
+            ble_channel_ready(BLE_CHANNEL_REPL);
+            sd_app_evt_wait();
+        }
         ring_push(&nus_tx, buf[i]);
     }
+
+    // Send the whole string at once
+    ble_channel_ready(BLE_CHANNEL_REPL);
+}
+
+bool ble_is_connected(void)
+{
+    return ble_conn_handle != BLE_CONN_HANDLE_INVALID;
 }
 
 bool ble_nus_is_rx_pending(void)
@@ -256,15 +776,25 @@ static inline void ble_adv_add_uuid(ble_uuid_t *uuid)
     *p_adv_size += len;
 }
 
-static inline void ble_adv_start(void)
+/**
+ * Start advertising, to the bonded peer only if there is one and it is requested.
+ * High duty cycle directed advertising lasts 1.28 s at most, after which
+ * BLE_GAP_EVT_ADV_SET_TERMINATED tells to go back to undirected advertising.
+ * @param directed True for advertising to the bonded peer first.
+ */
+static void ble_adv_start(bool directed)
 {
     uint32_t err;
+    ble_gap_addr_t const *peer = ble_bond_peer();
 
     ble_gap_adv_data_t adv_data = {
         .adv_data.p_data = ble_adv_buf,
         .adv_data.len = ble_adv_len,
     };
 
+    // Let the SoftDevice recognize the bonded peer behind its private addresses
+    ble_bond_update_identities();
+
     // Set up advertising parameters
     ble_gap_adv_params_t adv_params = {0};
     adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_SCANNABLE_UNDIRECTED;
@@ -272,8 +802,18 @@ static inline void ble_adv_start(void)
     adv_params.secondary_phy = BLE_GAP_PHY_AUTO;
     adv_params.interval = (20 * 1000) / 625;
 
-    // Configure the advertising set
-    err = sd_ble_gap_adv_set_configure(&ble_adv_handle, &adv_data, &adv_params);
+    ble_adv_directed = directed && peer != NULL;
+    if (ble_adv_directed)
+    {
+        LOG("directed to the bonded peer");
+        adv_params.properties.type = BLE_GAP_ADV_TYPE_CONNECTABLE_NONSCANNABLE_DIRECTED_HIGH_DUTY_CYCLE;
+        adv_params.p_peer_addr = peer;
+        adv_params.duration = BLE_GAP_ADV_TIMEOUT_HIGH_DUTY_MAX;
+    }
+
+    // Configure the advertising set, directed advertising has no payload
+    err = sd_ble_gap_adv_set_configure(&ble_adv_handle,
+            ble_adv_directed ? NULL : &adv_data, &adv_params);
     ASSERT(!err);
 
     // Start the configured BLE advertisement
@@ -361,13 +901,6 @@ static void ble_configure_nus_service(ble_uuid_t *service_uuid)
     ble_service_add_characteristic_tx(service, &tx_uuid);
 }
 
-void ble_raw_tx(uint8_t const *buf, uint16_t len)
-{
-    LOG("0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X, 0x%02X...",
-         buf[0], buf[1], buf[2], buf[3], buf[4], buf[5], buf[6]);
-    ble_tx(&ble_raw_service, buf, len);
-}
-
 void ble_configure_raw_service(ble_uuid_t *service_uuid)
 {
     uint32_t err;
@@ -421,13 +954,24 @@ void ble_configure_softdevice(void)
     err = sd_ble_cfg_set(BLE_CONN_CFG_GATT, &cfg, ram_start);
     ASSERT(!err);
 
-    // Configure a single queued transfer
+    // Configure several queued transfers, so that more than one packet goes per connection event
     memset(&cfg, 0, sizeof(cfg));
     cfg.conn_cfg.conn_cfg_tag = 1;
-    cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = 1;
+    cfg.conn_cfg.params.gatts_conn_cfg.hvn_tx_queue_size = BLE_HVN_TX_QUEUE_SIZE;
     err = sd_ble_cfg_set(BLE_CONN_CFG_GATTS, &cfg, ram_start);
     ASSERT(!err);
 
+    // Allow one L2CAP channel, only used for sending
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.conn_cfg.conn_cfg_tag = 1;
+    cfg.conn_cfg.params.l2cap_conn_cfg.rx_mps = BLE_L2CAP_MPS_MIN;
+    cfg.conn_cfg.params.l2cap_conn_cfg.tx_mps = BLE_MAX_MTU_LENGTH;
+    cfg.conn_cfg.params.l2cap_conn_cfg.rx_queue_size = 1;
+    cfg.conn_cfg.params.l2cap_conn_cfg.tx_queue_size = BLE_L2CAP_TX_QUEUE_SIZE;
+    cfg.conn_cfg.params.l2cap_conn_cfg.ch_count = 1;
+    err = sd_ble_cfg_set(BLE_CONN_CFG_L2CAP, &cfg, ram_start);
+    ASSERT(!err);
+
     // Configure number of custom UUIDs
     memset(&cfg, 0, sizeof(cfg));
     cfg.common_cfg.vs_uuid_cfg.vs_uuid_count = 2;
@@ -472,14 +1016,14 @@ void SWI2_IRQHandler(void)
         case NRF_EVT_FLASH_OPERATION_SUCCESS:
         LOG("NRF_EVT_FLASH_OPERATION_SUCCESS");
         {
-            // TODO In case we add a filesystem in the future
+            ble_bond_flash_event(true);
             break;
         }
 
         case NRF_EVT_FLASH_OPERATION_ERROR:
-        LOG("NRF_EVT_FLASH_OPERATION_ERROR");
+        LOG_WARNING("NRF_EVT_FLASH_OPERATION_ERROR");
         {
-            // TODO In case we add a filesystem in the future
+            ble_bond_flash_event(false);
             break;
         }
 
@@ -521,17 +1065,39 @@ void SWI2_IRQHandler(void)
             // Set the connection service
             ble_conn_handle = ble_evt->evt.gap_evt.conn_handle;
 
-            // Update connection parameters
-            ble_gap_conn_params_t conn_params;
-
-            err = sd_ble_gap_ppcp_get(&conn_params);
-            ASSERT(!err);
-
-            err = sd_ble_gap_conn_param_update(ble_conn_handle, &conn_params);
-            ASSERT(!err);
+            // Until the peer asks for more, the default MTU is in use
+            ble_negotiated_mtu = BLE_GATT_ATT_MTU_DEFAULT - 3;
+
+            // All the notification buffers are free, and nothing is pending from before
+            ble_tx_credits = BLE_HVN_TX_QUEUE_SIZE;
+            ble_mux_pending.len = 0;
+            ble_l2cap_reset();
+
+            // Service discovery is about to start: begin with fast intervals
+            ble_conn.request_ms = 0;
+            ble_conn.state_ms = timer_get_uptime_ms();
+            ble_conn_applied(&ble_evt->evt.gap_evt.params.connected.conn_params);
+            ble_conn.state = ble_conn.applied;
+            ble_conn_activity();
+            ble_conn_request(BLE_CONN_FAST);
+
+            // The bonded peer finds its attributes as it left them, no discovery needed
+            ble_peer_addr = ble_evt->evt.gap_evt.params.connected.peer_addr;
+            ble_peer_bonded = ble_bond_is_peer(&ble_peer_addr);
+            ble_peer_key_given = false;
+            ble_adv_directed = false;
+            if (ble_peer_bonded)
+            {
+                ble_bond_load_sys_attr(ble_conn_handle);
 
-            err = sd_ble_gatts_sys_attr_set(ble_conn_handle, NULL, 0, 0);
-            ASSERT(!err);
+                // Already subscribed as it left, send what was captured meanwhile
+                bluetooth_data_event(DATA_EVENT_CONNECTED);
+            }
+            else
+            {
+                err = sd_ble_gatts_sys_attr_set(ble_conn_handle, NULL, 0, 0);
+                ASSERT(!err);
+            }
             break;
         }
 
@@ -541,12 +1107,30 @@ void SWI2_IRQHandler(void)
         {
             ASSERT(ble_evt->evt.gap_evt.conn_handle == ble_conn_handle);
 
+            // Keep the attributes of the bonded peer for the next time
+            if (ble_peer_bonded)
+                ble_bond_save_sys_attr(ble_conn_handle);
+
             // Clear the connection service
+            ble_conn.stats.time_ms[ble_conn.applied] += timer_get_uptime_ms() - ble_conn.state_ms;
             ble_conn_handle = BLE_CONN_HANDLE_INVALID;
+            ble_l2cap_reset();
 
-            // Start advertising
-            err = sd_ble_gap_adv_start(ble_adv_handle, 1);
-            ASSERT(!err);
+            // Pause the ongoing data transfers
+            bluetooth_data_event(DATA_EVENT_DISCONNECTED);
+
+            // Start advertising, to the last peer first for it to reconnect quickly
+            ble_adv_start(true);
+            break;
+        }
+
+        // Directed advertising timed out, let any other device connect
+        case BLE_GAP_EVT_ADV_SET_TERMINATED:
+        LOG("BLE_GAP_EVT_ADV_SET_TERMINATED");
+        {
+            if (ble_adv_directed && ble_evt->evt.gap_evt.params.adv_set_terminated.reason ==
+                    BLE_GAP_EVT_ADV_SET_TERMINATED_REASON_TIMEOUT)
+                ble_adv_start(false);
             break;
         }
 
@@ -587,26 +1171,135 @@ void SWI2_IRQHandler(void)
             break;
         }
 
+        // Keep track of the parameters chosen by the central, which count in the statistics
+        case BLE_GAP_EVT_CONN_PARAM_UPDATE:
+        LOG("BLE_GAP_EVT_CONN_PARAM_UPDATE");
+        {
+            ble_conn_applied(&ble_evt->evt.gap_evt.params.conn_param_update.conn_params);
+            break;
+        }
+
         // When data arrives, we can write it to the buffer
         case BLE_GATTS_EVT_WRITE:
         LOG("BLE_GATTS_EVT_WRITE");
         {
             ASSERT(ble_evt->evt.gap_evt.conn_handle == ble_conn_handle);
+            ble_gatts_evt_write_t const *write = &ble_evt->evt.gatts_evt.params.write;
+
+            // Incoming data hints that more traffic will follow
+            ble_conn_activity();
+
+            // Commands for the data service go to the data protocol
+            if (write->handle == ble_raw_service.rx_characteristic.value_handle)
+            {
+                bluetooth_data_rx(write->data, write->len);
+                break;
+            }
+
+            // The host subscribes to the data service, send what was captured meanwhile
+            if (write->handle == ble_raw_service.tx_characteristic.cccd_handle &&
+                write->len >= 1 && (write->data[0] & BLE_GATT_HVX_NOTIFICATION))
+            {
+                bluetooth_data_event(DATA_EVENT_CONNECTED);
+                break;
+            }
+
+            // Other than the REPL input, only descriptors are written
+            if (write->handle != ble_nus_service.rx_characteristic.value_handle)
+                break;
+
             // For the entire incoming string
-            for (uint16_t length = 0;
-                 length < ble_evt->evt.gatts_evt.params.write.len;
-                 length++)
+            for (uint16_t length = 0; length < write->len; length++)
             {
                 // Break if the ring buffer is full, we can't write more
                 if (ring_full(&nus_rx))
                     break;
 
                 // Copy a character into the ring buffer
-                ring_push(&nus_rx, ble_evt->evt.gatts_evt.params.write.data[length]);
+                ring_push(&nus_rx, write->data[length]);
             }
             break;
         }
 
+        // Notification buffers got freed, more data can be queued
+        case BLE_GATTS_EVT_HVN_TX_COMPLETE:
+        {
+            ble_tx_credits += ble_evt->evt.gatts_evt.params.hvn_tx_complete.count;
+            if (ble_tx_credits > BLE_HVN_TX_QUEUE_SIZE)
+                ble_tx_credits = BLE_HVN_TX_QUEUE_SIZE;
+            break;
+        }
+
+        // The host opens a L2CAP channel for a faster bulk transfer
+        case BLE_L2CAP_EVT_CH_SETUP_REQUEST:
+        LOG("BLE_L2CAP_EVT_CH_SETUP_REQUEST");
+        {
+            ble_l2cap_evt_t const *l2cap = &ble_evt->evt.l2cap_evt;
+            uint16_t cid = l2cap->local_cid;
+
+            // No data is received over L2CAP, the host sends commands over GATT
+            ble_l2cap_ch_setup_params_t params = {
+                .rx_params.rx_mtu = BLE_L2CAP_MTU_MIN,
+                .rx_params.rx_mps = BLE_L2CAP_MPS_MIN,
+                .rx_params.sdu_buf.p_data = NULL,
+                .status = BLE_L2CAP_CH_STATUS_CODE_SUCCESS,
+            };
+
+            if (l2cap->params.ch_setup_request.le_psm != BLE_L2CAP_PSM)
+                params.status = BLE_L2CAP_CH_STATUS_CODE_LE_PSM_NOT_SUPPORTED;
+            else if (ble_l2cap.cid != BLE_L2CAP_CID_INVALID)
+                params.status = BLE_L2CAP_CH_STATUS_CODE_NO_RESOURCES;
+
+            err = sd_ble_l2cap_ch_setup(ble_conn_handle, &cid, &params);
+            ASSERT(!err);
+            break;
+        }
+
+        case BLE_L2CAP_EVT_CH_SETUP:
+        LOG("BLE_L2CAP_EVT_CH_SETUP");
+        {
+            ble_l2cap_evt_t const *l2cap = &ble_evt->evt.l2cap_evt;
+
+            ble_l2cap_reset();
+            ble_l2cap.cid = l2cap->local_cid;
+            ble_l2cap.tx_mtu = l2cap->params.ch_setup.tx_params.tx_mtu;
+            ble_l2cap.tx_mps = l2cap->params.ch_setup.tx_params.tx_mps;
+            ble_l2cap.credits = l2cap->params.ch_setup.tx_params.credits;
+            break;
+        }
+
+        case BLE_L2CAP_EVT_CH_SETUP_REFUSED:
+        LOG("BLE_L2CAP_EVT_CH_SETUP_REFUSED");
+        {
+            break;
+        }
+
+        // Back to GATT notifications
+        case BLE_L2CAP_EVT_CH_RELEASED:
+        LOG("BLE_L2CAP_EVT_CH_RELEASED");
+        {
+            ble_l2cap_reset();
+            break;
+        }
+
+        case BLE_L2CAP_EVT_CH_CREDIT:
+        {
+            ble_l2cap.credits += ble_evt->evt.l2cap_evt.params.credit.credits;
+            break;
+        }
+
+        case BLE_L2CAP_EVT_CH_TX:
+        {
+            ble_l2cap_release(ble_evt->evt.l2cap_evt.params.tx.sdu_buf.p_data);
+            break;
+        }
+
+        case BLE_L2CAP_EVT_CH_SDU_BUF_RELEASED:
+        {
+            ble_l2cap_release(ble_evt->evt.l2cap_evt.params.ch_sdu_buf_released.sdu_buf.p_data);
+            break;
+        }
+
         // Disconnect on GATT Client timeout
         case BLE_GATTC_EVT_TIMEOUT:
         LOG("BLE_GATTC_EVT_TIMEOUT");
@@ -630,21 +1323,76 @@ void SWI2_IRQHandler(void)
         LOG("BLE_GATTS_EVT_SYS_ATTR_MISSING");
         {
             ASSERT(ble_evt->evt.gap_evt.conn_handle == ble_conn_handle);
-            err = sd_ble_gatts_sys_attr_set(ble_conn_handle, NULL, 0, 0);
-            ASSERT(!err);
+            if (ble_peer_bonded)
+            {
+                ble_bond_load_sys_attr(ble_conn_handle);
+
+                // Already subscribed as it left, send what was captured meanwhile
+                bluetooth_data_event(DATA_EVENT_CONNECTED);
+            }
+            else
+            {
+                err = sd_ble_gatts_sys_attr_set(ble_conn_handle, NULL, 0, 0);
+                ASSERT(!err);
+            }
             break;
         }
 
-        // We don't support pairing, so reply with that message
+        // Pair without user interaction and bond, for the peer to reconnect quickly
         case BLE_GAP_EVT_SEC_PARAMS_REQUEST:
         LOG("BLE_GAP_EVT_SEC_PARAMS_REQUEST");
         {
             ASSERT(ble_evt->evt.gap_evt.conn_handle == ble_conn_handle);
-            err = sd_ble_gap_sec_params_reply(ble_conn_handle, BLE_GAP_SEC_STATUS_PAIRING_NOT_SUPP, NULL, NULL);
+
+            ble_gap_sec_params_t sec_params = {
+                .bond = 1,
+                .mitm = 0,
+                .lesc = 0,
+                .io_caps = BLE_GAP_IO_CAPS_NONE,
+                .oob = 0,
+                .min_key_size = 7,
+                .max_key_size = 16,
+                .kdist_own.enc = 1,
+                .kdist_peer.id = 1,
+            };
+            err = sd_ble_gap_sec_params_reply(ble_conn_handle, BLE_GAP_SEC_STATUS_SUCCESS,
+                    &sec_params, ble_bond_keyset());
             ASSERT(!err);
             break;
         }
 
+        // Keep the keys if pairing succeeded
+        case BLE_GAP_EVT_AUTH_STATUS:
+        LOG("BLE_GAP_EVT_AUTH_STATUS");
+        {
+            ble_gap_evt_auth_status_t const *auth = &ble_evt->evt.gap_evt.params.auth_status;
+
+            if (auth->auth_status == BLE_GAP_SEC_STATUS_SUCCESS && auth->bonded)
+            {
+                ble_bond_save(&ble_peer_addr, auth->kdist_peer.id);
+                ble_peer_bonded = true;
+            }
+            else
+            {
+                ble_bond_save(NULL, false);
+                ble_peer_bonded = false;
+            }
+            break;
+        }
+
+        // The link is encrypted with the key of the bond: it is the bonded peer
+        case BLE_GAP_EVT_CONN_SEC_UPDATE:
+        LOG("BLE_GAP_EVT_CONN_SEC_UPDATE");
+        {
+            if (ble_peer_key_given && !ble_peer_bonded &&
+                ble_evt->evt.gap_evt.params.conn_sec_update.conn_sec.sec_mode.lv >= 2)
+            {
+                ble_peer_bonded = true;
+                ble_bond_load_sys_attr(ble_conn_handle);
+            }
+            break;
+        }
+
         case BLE_GAP_EVT_DATA_LENGTH_UPDATE_REQUEST:
         LOG("BLE_GAP_EVT_DATA_LENGTH_UPDATE_REQUEST");
         {
@@ -658,7 +1406,12 @@ void SWI2_IRQHandler(void)
         LOG("BLE_GAP_EVT_SEC_INFO_REQUEST");
         {
             ASSERT(ble_evt->evt.gap_evt.conn_handle == ble_conn_handle);
-            err = sd_ble_gap_sec_info_reply(ble_conn_handle, NULL, NULL, NULL);
+
+            // Give the key of the bond back, if this is the bonded peer
+            ble_gap_enc_info_t const *enc_info =
+                ble_bond_enc_info(&ble_evt->evt.gap_evt.params.sec_info_request.master_id);
+            ble_peer_key_given = enc_info != NULL;
+            err = sd_ble_gap_sec_info_reply(ble_conn_handle, enc_info, NULL, NULL);
             ASSERT(!err);
             break;
         }
@@ -681,13 +1434,18 @@ void SWI2_IRQHandler(void)
             break;
         }
 
-        case BLE_EVT_USER_MEM_REQUEST:
         case BLE_GAP_EVT_CONN_PARAM_UPDATE_REQUEST:
         {
             ASSERT(!"only expected on Bluetooth Centrals, not on Peripherals");
             break;
         }
 
+        case BLE_EVT_USER_MEM_REQUEST:
+        {
+            ASSERT(!"only expected on Bluetooth Centrals, not on Peripherals");
+            break;
+        }
+
         default:
         {
             // ignore unused events
@@ -695,6 +1453,15 @@ void SWI2_IRQHandler(void)
         }
         }
     }
+
+    // Let the channels send data with the buffers now available
+    ble_mux_run();
+
+    // Adapt the connection parameters to the traffic
+    ble_conn_run();
+
+    // Forget the bond if asked from thread context
+    ble_bond_run();
 }
 
 /**
@@ -705,6 +1472,8 @@ void SWI2_IRQHandler(void)
 void ble_init(void)
 {
     DRIVER("BLE");
+    timer_init();
+    timer_add_handler(&ble_conn_timer_handler);
 
     // Error code variable
     uint32_t err;
@@ -769,6 +1538,9 @@ void ble_init(void)
     // Add only the Nordic UART Service to the advertisement.
     ble_adv_add_uuid(&nus_service_uuid);
 
+    // Load the last peer to reconnect to it quickly
+    ble_bond_init();
+
     // Submit the adv now that it is complete.
-    ble_adv_start();
+    ble_adv_start(true);
 }
@@ -30,8 +30,69 @@
 
 extern uint16_t ble_negotiated_mtu;
 
+/**
+ * Logical channels sharing the link, from the most to the least interactive.
+ */
+typedef enum ble_channel_t
+{
+    BLE_CHANNEL_REPL,           // Console output, over the Nordic UART Service
+    BLE_CHANNEL_MEDIA,          // Camera and microphone data
+
+    BLE_CHANNEL_NUM,
+} ble_channel_t;
+
+/**
+ * Transfer statistics kept for every channel.
+ */
+typedef struct
+{
+    uint32_t bytes;             // Payload bytes handed to the SoftDevice
+    uint32_t packets;           // Notifications handed to the SoftDevice
+    uint32_t latency_max_ms;    // Longest wait between ble_channel_ready() and the first packet
+    uint32_t latency_sum_ms;    // Sum of all the waits, for computing an average
+    uint32_t latency_count;     // Number of waits summed up
+} ble_channel_stats_t;
+
+/**
+ * Producer of a channel, called by the multiplexer from the SoftDevice event
+ * interrupt whenever the channel can send a packet.
+ * @param buf Buffer to fill with the next packet.
+ * @param len Maximum length of the packet.
+ * @return Length of the packet, or 0 if there is nothing more to send.
+ */
+typedef size_t ble_channel_pull_t(uint8_t *buf, size_t len);
+
+/**
+ * Connection parameters requested depending on the traffic.
+ */
+typedef enum ble_conn_state_t
+{
+    BLE_CONN_FAST,              // Short intervals without latency, during transfers
+    BLE_CONN_SLOW,              // Long intervals with slave latency, when idle
+
+    BLE_CONN_STATE_NUM,
+} ble_conn_state_t;
+
+/**
+ * Statistics about the connection parameters.
+ */
+typedef struct
+{
+    ble_conn_state_t state;                 // State of the parameters applied by the central
+    uint32_t interval_us;                   // Connection interval chosen by the central
+    uint16_t latency;                       // Slave latency chosen by the central
+    uint32_t time_ms[BLE_CONN_STATE_NUM];   // Time spent in each state
+    uint32_t count[BLE_CONN_STATE_NUM];     // Number of times the central applied parameters of each state
+    uint32_t rejected;                      // Requests refused by the SoftDevice as busy
+} ble_conn_stats_t;
+
 void ble_init(void);
 void ble_nus_tx(char const *buf, size_t len);
-void ble_raw_tx(uint8_t const *buf, uint16_t len);
+bool ble_is_connected(void);
 int ble_nus_rx(void);
 bool ble_nus_is_rx_pending(void); 
+void ble_channel_ready(ble_channel_t ch);
+void ble_channel_get_stats(ble_channel_t ch, ble_channel_stats_t *stats);
+void ble_conn_set_idle_ms(uint32_t ms);
+uint32_t ble_conn_get_idle_ms(void);
+void ble_conn_get_stats(ble_conn_stats_t *stats);
@@ -0,0 +1,481 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Frames kept in the external flash until delivered to the host.
+ */
+
+#define LOG_MODULE CAMERA
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf.h"
+#include "nrfx_log.h"
+
+#include "driver/bluetooth_data_protocol.h"
+#include "driver/capture_queue.h"
+#include "driver/config.h"
+#include "driver/flash.h"
+
+#define ASSERT  NRFX_ASSERT
+
+#define CAPTURE_QUEUE_MAGIC         0x5041434D  // "MCAP"
+
+/** Frames queued are numbered from 1, so that 0 marks an empty slot. */
+#define CAPTURE_QUEUE_NO_ID         0
+
+typedef struct
+{
+    uint32_t id;                // Of the frame in the slot, or CAPTURE_QUEUE_NO_ID
+    uint8_t acked;              // Chunks acknowledged by the host
+    uint8_t persisted;          // Chunks whose acknowledgement is programmed in the flash
+    bool delivered;             // Acknowledged completely
+    bool delivered_persisted;   // And programmed so in the flash
+} capture_queue_slot_t;
+
+static capture_queue_slot_t capture_queue_slots[CAPTURE_QUEUE_SLOTS];
+static uint8_t capture_queue_newest;     // Slot of the frame queued last
+static uint32_t capture_queue_next_id;
+static uint32_t capture_queue_last_size; // Of the frame queued last, to skip the same again
+static uint32_t capture_queue_last_crc;
+static capture_queue_stats_t capture_queue_stats;
+
+// The flash operation of the interrupts, reads for the data protocol first,
+// progress updates when there is none waiting
+static struct
+{
+    volatile bool running;
+    bool read_waiting;
+    uint32_t read_addr;
+    uint8_t *read_buf;
+    size_t read_len;
+    void (*read_callback)(void);
+    int8_t progress_slot;       // Slot whose progress is being programmed, or -1
+    uint8_t progress[3];        // As programmed
+} capture_queue_io = { .progress_slot = -1 };
+
+static inline uint32_t capture_queue_u32(uint8_t const *p)
+{
+    return p[0] << 0 | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline uint16_t capture_queue_u16(uint8_t const *p)
+{
+    return p[0] << 0 | p[1] << 8;
+}
+
+static inline uint8_t *capture_queue_put_u32(uint8_t *p, uint32_t u)
+{
+    p[0] = u >> 0;
+    p[1] = u >> 8;
+    p[2] = u >> 16;
+    p[3] = u >> 24;
+    return p + 4;
+}
+
+static inline uint8_t *capture_queue_put_u16(uint8_t *p, uint16_t u)
+{
+    p[0] = u >> 0;
+    p[1] = u >> 8;
+    return p + 2;
+}
+
+static inline uint32_t capture_queue_slot_addr(uint8_t slot)
+{
+    return FLASH_CAPTURES_ADDR + slot * CAPTURE_QUEUE_SLOT_SIZE;
+}
+
+static uint32_t capture_queue_crc32(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    crc = ~crc;
+    while (len-- > 0)
+    {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/**
+ * Whether the acknowledgements of a slot are not all programmed in the flash yet.
+ */
+static inline bool capture_queue_dirty(uint8_t slot)
+{
+    capture_queue_slot_t const *s = &capture_queue_slots[slot];
+
+    return s->acked != s->persisted || s->delivered != s->delivered_persisted;
+}
+
+/**
+ * Decode the header of a slot.
+ * @param header The first CAPTURE_QUEUE_HEADER_SIZE bytes of the slot.
+ * @param entry Filled with the frame metadata.
+ * @return False if the slot holds no valid frame.
+ */
+bool capture_queue_decode(uint8_t const *header, capture_queue_entry_t *entry)
+{
+    uint8_t const *p = header + 16;
+
+    if (capture_queue_u32(header + 0) != CAPTURE_QUEUE_MAGIC ||
+        capture_queue_u32(header + CAPTURE_QUEUE_HEADER_SIZE - 4) !=
+            capture_queue_crc32(0, header, CAPTURE_QUEUE_HEADER_SIZE - 4))
+        return false;
+
+    entry->id = capture_queue_u32(header + 4);
+    entry->size = capture_queue_u32(header + 8);
+    entry->crc32 = capture_queue_u32(header + 12);
+    entry->info.seq = capture_queue_u16(p);
+    entry->info.captured_ms = capture_queue_u32(p + 2);
+    entry->info.exposure = capture_queue_u32(p + 6);
+    entry->info.gain = capture_queue_u16(p + 10);
+    entry->info.luma = p[12];
+    entry->info.scale = p[13];
+    entry->info.width = capture_queue_u16(p + 14);
+    entry->info.height = capture_queue_u16(p + 16);
+    return entry->id != CAPTURE_QUEUE_NO_ID && entry->size <= CAPTURE_QUEUE_MAX_SIZE;
+}
+
+static void capture_queue_encode(uint8_t *header, capture_queue_entry_t const *entry)
+{
+    uint8_t *p = header;
+
+    p = capture_queue_put_u32(p, CAPTURE_QUEUE_MAGIC);
+    p = capture_queue_put_u32(p, entry->id);
+    p = capture_queue_put_u32(p, entry->size);
+    p = capture_queue_put_u32(p, entry->crc32);
+    p = capture_queue_put_u16(p, entry->info.seq);
+    p = capture_queue_put_u32(p, entry->info.captured_ms);
+    p = capture_queue_put_u32(p, entry->info.exposure);
+    p = capture_queue_put_u16(p, entry->info.gain);
+    *p++ = entry->info.luma;
+    *p++ = entry->info.scale;
+    p = capture_queue_put_u16(p, entry->info.width);
+    p = capture_queue_put_u16(p, entry->info.height);
+    p = capture_queue_put_u16(p, 0);
+    capture_queue_put_u32(p, capture_queue_crc32(0, header, p - header));
+}
+
+/**
+ * Scan the headers of the slots, to find the frames not delivered yet.
+ */
+void capture_queue_init(void)
+{
+    uint8_t buf[CAPTURE_QUEUE_PROGRESS_OFFSET + 3];
+    uint32_t newest_id = CAPTURE_QUEUE_NO_ID;
+
+    DRIVER("CAPTURE_QUEUE");
+    flash_init();
+
+    capture_queue_newest = CAPTURE_QUEUE_SLOTS - 1;
+    for (uint8_t slot = 0; slot < CAPTURE_QUEUE_SLOTS; slot++)
+    {
+        capture_queue_slot_t *s = &capture_queue_slots[slot];
+        capture_queue_entry_t entry;
+        uint16_t mask;
+
+        memset(s, 0, sizeof *s);
+        flash_read(capture_queue_slot_addr(slot), buf, sizeof buf);
+        if (!capture_queue_decode(buf, &entry))
+            continue;
+
+        // Count the chunks cleared from the lowest bit
+        mask = capture_queue_u16(buf + CAPTURE_QUEUE_PROGRESS_OFFSET);
+        while (s->acked < 16 && !(mask & 1 << s->acked))
+            s->acked++;
+        s->persisted = s->acked;
+        s->delivered = s->delivered_persisted = buf[CAPTURE_QUEUE_PROGRESS_OFFSET + 2] == 0x00;
+        s->id = entry.id;
+
+        if (entry.id > newest_id)
+        {
+            newest_id = entry.id;
+            capture_queue_newest = slot;
+            capture_queue_last_size = entry.size;
+            capture_queue_last_crc = entry.crc32;
+        }
+        if (!s->delivered)
+            capture_queue_stats.pending++;
+    }
+    capture_queue_next_id = newest_id + 1;
+    LOG("pending=%d next_id=%d", capture_queue_stats.pending, capture_queue_next_id);
+}
+
+/**
+ * Store a frame into the queue, reading it one page at a time from its
+ * source, so that it never needs to be whole in RAM. Called from thread
+ * context, such as right after the capture.
+ * @param read Source of the frame.
+ * @param size Size of the frame.
+ * @param info Metadata of the frame, sent ahead of it.
+ * @return Whether the frame was queued.
+ */
+capture_queue_status_t capture_queue_store(capture_queue_read_t *read, size_t size,
+        bluetooth_data_frame_info_t const *info)
+{
+    uint8_t slot = (capture_queue_newest + 1) % CAPTURE_QUEUE_SLOTS;
+    uint32_t addr = capture_queue_slot_addr(slot);
+    uint8_t page[FLASH_PAGE_SIZE];
+    capture_queue_entry_t entry = { .size = size, .info = *info };
+
+    if (size == 0 || size > CAPTURE_QUEUE_MAX_SIZE)
+    {
+        capture_queue_stats.dropped++;
+        return CAPTURE_QUEUE_TOO_LARGE;
+    }
+    if (capture_queue_slots[slot].id != CAPTURE_QUEUE_NO_ID && !capture_queue_slots[slot].delivered)
+    {
+        capture_queue_stats.dropped++;
+        return CAPTURE_QUEUE_FULL;
+    }
+
+    // The last acknowledgements of that slot could still be on their way to the flash
+    while (capture_queue_dirty(slot))
+        __WFE();
+
+    for (uint32_t offset = 0; offset < CAPTURE_QUEUE_DATA_OFFSET + size; offset += FLASH_SECTOR_SIZE)
+        flash_erase_sector(addr + offset);
+
+    for (uint32_t offset = 0; offset < size; offset += sizeof page)
+    {
+        size_t len = size - offset < sizeof page ? size - offset : sizeof page;
+
+        read(page, len);
+        entry.crc32 = capture_queue_crc32(entry.crc32, page, len);
+        flash_program(addr + CAPTURE_QUEUE_DATA_OFFSET + offset, page, len);
+    }
+
+    // The same frame read again, such as when the sensor did not deliver a new one
+    if (entry.size == capture_queue_last_size && entry.crc32 == capture_queue_last_crc)
+    {
+        capture_queue_stats.duplicates++;
+        return CAPTURE_QUEUE_DUPLICATE;
+    }
+
+    // The header commits the frame
+    entry.id = capture_queue_next_id;
+    capture_queue_encode(page, &entry);
+    flash_program(addr, page, CAPTURE_QUEUE_HEADER_SIZE);
+
+    __disable_irq();
+    capture_queue_slots[slot] = (capture_queue_slot_t){ .id = entry.id };
+    capture_queue_newest = slot;
+    capture_queue_stats.pending++;
+    __enable_irq();
+
+    capture_queue_next_id++;
+    capture_queue_last_size = entry.size;
+    capture_queue_last_crc = entry.crc32;
+    capture_queue_stats.stored++;
+    LOG("id=%d slot=%d size=%d", entry.id, slot, size);
+    return CAPTURE_QUEUE_STORED;
+}
+
+/**
+ * Get the oldest frame not delivered yet.
+ * @param slot Set to the slot of the frame.
+ * @param acked Set to how many bytes of it the host acknowledged before,
+ *        as saved in the flash, so that sending can resume from there.
+ * @return False if the queue is empty.
+ */
+bool capture_queue_next(uint8_t *slot, uint32_t *acked)
+{
+    bool found = false;
+
+    for (uint8_t i = 0; i < CAPTURE_QUEUE_SLOTS; i++)
+    {
+        capture_queue_slot_t const *s = &capture_queue_slots[i];
+
+        if (s->id == CAPTURE_QUEUE_NO_ID || s->delivered)
+            continue;
+        if (!found || s->id < capture_queue_slots[*slot].id)
+            *slot = i;
+        found = true;
+    }
+    if (found)
+        *acked = capture_queue_slots[*slot].acked * CAPTURE_QUEUE_CHUNK_SIZE;
+    return found;
+}
+
+/**
+ * Pick the next flash operation, if none is running. Called from interrupts.
+ */
+static void capture_queue_io_run(void);
+
+/**
+ * The flash operation is done: notify the reader, then go on with the next one.
+ */
+static void capture_queue_io_done(void)
+{
+    void (*callback)(void) = NULL;
+    int8_t slot = capture_queue_io.progress_slot;
+
+    if (slot >= 0)
+    {
+        capture_queue_slot_t *s = &capture_queue_slots[slot];
+
+        s->persisted = 16 - __builtin_popcount(capture_queue_u16(capture_queue_io.progress));
+        s->delivered_persisted = capture_queue_io.progress[2] == 0x00;
+        capture_queue_io.progress_slot = -1;
+    }
+    else
+    {
+        callback = capture_queue_io.read_callback;
+    }
+
+    capture_queue_io.running = false;
+    if (callback != NULL)
+        callback();
+    capture_queue_io_run();
+}
+
+static void capture_queue_io_run(void)
+{
+    bool start, read, ok;
+    int8_t slot = -1;
+
+    __disable_irq();
+    start = !capture_queue_io.running;
+    read = start && capture_queue_io.read_waiting;
+    for (uint8_t i = 0; start && !read && slot < 0 && i < CAPTURE_QUEUE_SLOTS; i++)
+        if (capture_queue_dirty(i))
+            slot = i;
+    start = read || slot >= 0;
+    if (start)
+    {
+        capture_queue_io.running = true;
+        capture_queue_io.read_waiting = false;
+        capture_queue_io.progress_slot = slot;
+    }
+    __enable_irq();
+    if (!start)
+        return;
+
+    if (read)
+    {
+        ok = flash_read_async(capture_queue_io.read_addr, capture_queue_io.read_buf,
+                capture_queue_io.read_len, capture_queue_io_done);
+    }
+    else
+    {
+        capture_queue_slot_t const *s = &capture_queue_slots[slot];
+
+        capture_queue_put_u16(capture_queue_io.progress, 0xFFFF << s->acked);
+        capture_queue_io.progress[2] = s->delivered ? 0x00 : 0xFF;
+        ok = flash_program_async(capture_queue_slot_addr(slot) + CAPTURE_QUEUE_PROGRESS_OFFSET,
+                capture_queue_io.progress, sizeof capture_queue_io.progress, capture_queue_io_done);
+    }
+
+    // Nothing else uses the flash from interrupts
+    ASSERT(ok);
+}
+
+/**
+ * Read part of a slot in the background, for the data protocol which runs
+ * from an interrupt, as soon as the flash is free.
+ * @param slot Slot to read from.
+ * @param offset Position in the slot, CAPTURE_QUEUE_DATA_OFFSET for the start of the frame.
+ * @param buf Buffer receiving the data at buf[4], as with flash_read_async().
+ * @param len Length of the data, at most FLASH_ASYNC_READ_MAX.
+ * @param callback Function called from an interrupt once the data is in the buffer.
+ * @return False if a read is already in progress.
+ */
+bool capture_queue_read_async(uint8_t slot, uint32_t offset, uint8_t *buf, size_t len,
+        void (*callback)(void))
+{
+    bool accepted;
+
+    ASSERT(slot < CAPTURE_QUEUE_SLOTS);
+    ASSERT(offset + len <= CAPTURE_QUEUE_SLOT_SIZE);
+
+    __disable_irq();
+    accepted = !capture_queue_io.read_waiting &&
+            !(capture_queue_io.running && capture_queue_io.progress_slot < 0);
+    if (accepted)
+    {
+        capture_queue_io.read_addr = capture_queue_slot_addr(slot) + offset;
+        capture_queue_io.read_buf = buf;
+        capture_queue_io.read_len = len;
+        capture_queue_io.read_callback = callback;
+        capture_queue_io.read_waiting = true;
+    }
+    __enable_irq();
+
+    if (accepted)
+        capture_queue_io_run();
+    return accepted;
+}
+
+/**
+ * Record how much of a frame the host acknowledged, saved to the flash in
+ * the background at every chunk, and once the frame is complete, after
+ * which its slot can be reused. Called from interrupts.
+ * @param slot Slot of the frame.
+ * @param acked Bytes of the frame acknowledged by the host.
+ * @param size Size of the frame.
+ */
+void capture_queue_acked(uint8_t slot, uint32_t acked, uint32_t size)
+{
+    capture_queue_slot_t *s = &capture_queue_slots[slot];
+    uint8_t chunks = acked / CAPTURE_QUEUE_CHUNK_SIZE;
+
+    ASSERT(slot < CAPTURE_QUEUE_SLOTS);
+
+    if (s->id == CAPTURE_QUEUE_NO_ID || s->delivered)
+        return;
+
+    __disable_irq();
+    if (chunks > s->acked)
+        s->acked = chunks;
+    if (acked >= size)
+    {
+        s->delivered = true;
+        capture_queue_stats.pending--;
+        capture_queue_stats.delivered++;
+    }
+    __enable_irq();
+
+    capture_queue_io_run();
+}
+
+/**
+ * Give up on a frame that cannot be read back, as if it was delivered.
+ * @param slot Slot of the frame.
+ */
+void capture_queue_skip(uint8_t slot)
+{
+    LOG("slot=%d", slot);
+    capture_queue_acked(slot, 0, 0);
+}
+
+capture_queue_stats_t capture_queue_get_stats(void)
+{
+    capture_queue_stats_t stats;
+
+    __disable_irq();
+    stats = capture_queue_stats;
+    __enable_irq();
+    return stats;
+}
@@ -0,0 +1,99 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Queue of the frames captured, sent to the host from there, and kept in the
+ * external flash until the host acknowledged them completely, across resets.
+ * The region is a ring of slots holding one frame each, the oldest frames
+ * being sent first. A slot is only reused once its frame was delivered.
+ *
+ * Slot format, little endian:
+ *   header:    magic "MCAP", id (u32), size (u32), CRC-32 of the data (u32),
+ *              metadata: sequence number (u16), uptime of the capture (u32),
+ *              exposure (u32), gain (u16), luma, scale, width (u16), height (u16),
+ *              reserved (u16), CRC-32 of the header so far (u32)
+ *   progress:  at CAPTURE_QUEUE_PROGRESS_OFFSET, one bit cleared per chunk
+ *              of CAPTURE_QUEUE_CHUNK_SIZE acknowledged by the host (u16),
+ *              then 0x00 once the whole frame is (u8)
+ *   data:      from CAPTURE_QUEUE_DATA_OFFSET
+ * The data is programmed before the header, so that a frame cut by a reset
+ * is never seen, and the progress only ever clears bits, without erasing.
+ * The ids keep increasing across resets, and name the frames sent, so that
+ * the host can tell a frame it already has when one is sent again.
+ */
+
+#define CAPTURE_QUEUE_SLOTS             32
+#define CAPTURE_QUEUE_SLOT_SIZE         0x10000
+
+#define CAPTURE_QUEUE_HEADER_SIZE       40
+#define CAPTURE_QUEUE_PROGRESS_OFFSET   64
+#define CAPTURE_QUEUE_DATA_OFFSET       256
+#define CAPTURE_QUEUE_MAX_SIZE          (CAPTURE_QUEUE_SLOT_SIZE - CAPTURE_QUEUE_DATA_OFFSET)
+
+/** Granularity of the progress kept across resets, 16 of them covering a slot. */
+#define CAPTURE_QUEUE_CHUNK_SIZE        (CAPTURE_QUEUE_SLOT_SIZE / 16)
+
+/**
+ * Source of the frame to store, such as the capture buffer of the FPGA.
+ * @param buf Buffer to fill with the next bytes of the frame.
+ * @param len Number of bytes to read.
+ */
+typedef void capture_queue_read_t(uint8_t *buf, size_t len);
+
+typedef enum
+{
+    CAPTURE_QUEUE_STORED,       // The frame is queued
+    CAPTURE_QUEUE_DUPLICATE,    // The frame is the same as the last one queued, which stays
+    CAPTURE_QUEUE_FULL,         // No slot was delivered yet to make room
+    CAPTURE_QUEUE_TOO_LARGE,    // The frame does not fit in a slot
+} capture_queue_status_t;
+
+/**
+ * A frame of the queue, as decoded from the header of its slot.
+ */
+typedef struct
+{
+    uint32_t id;
+    uint32_t size;
+    uint32_t crc32;
+    bluetooth_data_frame_info_t info;
+} capture_queue_entry_t;
+
+typedef struct
+{
+    uint32_t pending;           // Frames waiting for the host
+    uint32_t stored;            // Frames queued since the start
+    uint32_t delivered;         // Frames acknowledged completely by the host since the start
+    uint32_t duplicates;        // Frames not queued as the same as the last one
+    uint32_t dropped;           // Frames not queued for lack of room
+} capture_queue_stats_t;
+
+void capture_queue_init(void);
+capture_queue_status_t capture_queue_store(capture_queue_read_t *read, size_t size,
+        bluetooth_data_frame_info_t const *info);
+bool capture_queue_next(uint8_t *slot, uint32_t *acked);
+bool capture_queue_read_async(uint8_t slot, uint32_t offset, uint8_t *buf, size_t len,
+        void (*callback)(void));
+bool capture_queue_decode(uint8_t const *header, capture_queue_entry_t *entry);
+void capture_queue_acked(uint8_t slot, uint32_t acked, uint32_t size);
+void capture_queue_skip(uint8_t slot);
+capture_queue_stats_t capture_queue_get_stats(void);
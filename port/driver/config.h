@@ -59,7 +59,22 @@
 
 // 0 is reserved for SoftDevice
 #define TIMER_INSTANCE              2
-#define TIMER_MAX_HANDLERS          2
+
+// One per handler that can be added at the same time, six staying for good
+// once their driver is initialised: ov5640, frame, fpga, battery, microphone
+// and the BLE connection; and four while in use: touch, the camera stream,
+// the wait for an acknowledgement of the data protocol, and the
+// asynchronous flash operations
+#define TIMER_MAX_HANDLERS          10
+
+// SPI
+
+#define SPI_QUEUE_SIZE              4       // Transactions of spi_xfer_async() waiting for the bus
+
+// FPGA
+
+#define FPGA_MAX_SUBSCRIBERS        4
+#define FPGA_BATCH_SIZE             256     // Commands queued by fpga_batch_begin(), with their payload
 
 // I2C
 
@@ -75,5 +90,5 @@
 #define DRIVER(name) { \
     static bool ready = false; \
     if (ready) return; else ready = true; \
-    PRINTF("DRIVER(%s)\r\n", name); \
+    LOG("DRIVER(%s)", name); \
 }
@@ -26,6 +26,8 @@
  * Bluetooth Device Firmware Upgrade (DFU)
  */
 
+#define LOG_MODULE MAIN
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -1,192 +0,0 @@
-/*
- * This file is part of the MicroPython for Frame project:
- *      https://github.com/Itsbrilliantlabs/frame-micropython
- *
- * Authored by: Raj Nakarja / Silicon Witchery (raj@siliconwitchery.com)
- *              for Brilliant Labs Inc.
- *
- * ISC Licence
- *
- * Copyright © 2023 Brilliant Labs Inc.
- *
- * Permission to use, copy, modify, and/or distribute this software for any
- * purpose with or without fee is hereby granted, provided that the above
- * copyright notice and this permission notice appear in all copies.
- *
- * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
- * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
- * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
- * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
- * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
- * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
- * PERFORMANCE OF THIS SOFTWARE.
- */
-
-const uint8_t dummy_audio[] = {};
-
-const uint8_t dummy_small_file[] = {
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
-    0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
-};
-
-const uint8_t dummy_large_file[] = {
-    0xff, 0xd8, 0xff, 0xe0, 0x00, 0x10, 0x4a, 0x46, 0x49, 0x46, 0x00, 0x01,
-    0x01, 0x00, 0x00, 0x48, 0x00, 0x48, 0x00, 0x00, 0xff, 0xe1, 0x00, 0x58,
-    0x45, 0x78, 0x69, 0x66, 0x00, 0x00, 0x4d, 0x4d, 0x00, 0x2a, 0x00, 0x00,
-    0x00, 0x08, 0x00, 0x02, 0x01, 0x12, 0x00, 0x03, 0x00, 0x00, 0x00, 0x01,
-    0x00, 0x01, 0x00, 0x00, 0x87, 0x69, 0x00, 0x04, 0x00, 0x00, 0x00, 0x01,
-    0x00, 0x00, 0x00, 0x26, 0x00, 0x00, 0x00, 0x00, 0x00, 0x03, 0xa0, 0x01,
-    0x00, 0x03, 0x00, 0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00, 0xa0, 0x02,
-    0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x30, 0xa0, 0x03,
-    0x00, 0x04, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x30, 0x00, 0x00,
-    0x00, 0x00, 0xff, 0xed, 0x00, 0x38, 0x50, 0x68, 0x6f, 0x74, 0x6f, 0x73,
-    0x68, 0x6f, 0x70, 0x20, 0x33, 0x2e, 0x30, 0x00, 0x38, 0x42, 0x49, 0x4d,
-    0x04, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x38, 0x42, 0x49, 0x4d,
-    0x04, 0x25, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0xd4, 0x1d, 0x8c, 0xd9,
-    0x8f, 0x00, 0xb2, 0x04, 0xe9, 0x80, 0x09, 0x98, 0xec, 0xf8, 0x42, 0x7e,
-    0xff, 0xc0, 0x00, 0x11, 0x08, 0x00, 0x30, 0x00, 0x30, 0x03, 0x01, 0x22,
-    0x00, 0x02, 0x11, 0x01, 0x03, 0x11, 0x01, 0xff, 0xc4, 0x00, 0x1f, 0x00,
-    0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-    0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x10, 0x00, 0x02, 0x01,
-    0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04, 0x04, 0x00, 0x00, 0x01,
-    0x7d, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41,
-    0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1,
-    0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0, 0x24, 0x33, 0x62,
-    0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27,
-    0x28, 0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44,
-    0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58,
-    0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73, 0x74,
-    0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88,
-    0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2,
-    0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5,
-    0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6, 0xc7, 0xc8,
-    0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1,
-    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3,
-    0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xc4, 0x00, 0x1f, 0x01,
-    0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
-    0x08, 0x09, 0x0a, 0x0b, 0xff, 0xc4, 0x00, 0xb5, 0x11, 0x00, 0x02, 0x01,
-    0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04, 0x04, 0x00, 0x01, 0x02,
-    0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12,
-    0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42,
-    0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0, 0x15, 0x62, 0x72,
-    0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a,
-    0x26, 0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43,
-    0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57,
-    0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a, 0x73,
-    0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86,
-    0x87, 0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99,
-    0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3,
-    0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5, 0xc6,
-    0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9,
-    0xda, 0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3,
-    0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xff, 0xdb, 0x00, 0x43, 0x00,
-    0x1c, 0x1c, 0x1c, 0x1c, 0x1c, 0x1c, 0x30, 0x1c, 0x1c, 0x30, 0x44, 0x30,
-    0x30, 0x30, 0x44, 0x5c, 0x44, 0x44, 0x44, 0x44, 0x5c, 0x74, 0x5c, 0x5c,
-    0x5c, 0x5c, 0x5c, 0x74, 0x8c, 0x74, 0x74, 0x74, 0x74, 0x74, 0x74, 0x8c,
-    0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0x8c, 0xa8, 0xa8, 0xa8, 0xa8, 0xa8,
-    0xa8, 0xc4, 0xc4, 0xc4, 0xc4, 0xc4, 0xdc, 0xdc, 0xdc, 0xdc, 0xdc, 0xdc,
-    0xdc, 0xdc, 0xdc, 0xdc, 0xff, 0xdb, 0x00, 0x43, 0x01, 0x22, 0x24, 0x24,
-    0x38, 0x34, 0x38, 0x60, 0x34, 0x34, 0x60, 0xe6, 0x9c, 0x80, 0x9c, 0xe6,
-    0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6,
-    0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6,
-    0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6,
-    0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6, 0xe6,
-    0xe6, 0xff, 0xdd, 0x00, 0x04, 0x00, 0x03, 0xff, 0xda, 0x00, 0x0c, 0x03,
-    0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3f, 0x00, 0xe9, 0x2a, 0xb5,
-    0xd4, 0xe6, 0x04, 0x05, 0x46, 0x59, 0x8e, 0x05, 0x17, 0x37, 0x1e, 0x42,
-    0x8d, 0xa3, 0x2c, 0xc7, 0x00, 0x56, 0x5c, 0xf2, 0xcf, 0x36, 0xdd, 0xfb,
-    0x06, 0xd3, 0x9e, 0x33, 0x54, 0x91, 0x2d, 0x8e, 0x9d, 0xae, 0x93, 0x6b,
-    0x49, 0x21, 0xf9, 0x86, 0x46, 0xde, 0x2a, 0x34, 0xb9, 0xb8, 0x43, 0xf2,
-    0xb9, 0x6f, 0x66, 0xe6, 0xa1, 0x25, 0xfb, 0x94, 0xfd, 0x68, 0x2c, 0xa1,
-    0xb8, 0xe6, 0xae, 0xc4, 0x5c, 0xe8, 0x21, 0x94, 0x4d, 0x12, 0xca, 0x38,
-    0xdc, 0x2a, 0x5a, 0xcd, 0xb2, 0x9b, 0x16, 0xea, 0xa1, 0x49, 0xc6, 0x7a,
-    0x7d, 0x6a, 0xfa, 0x3a, 0xc8, 0x32, 0x3b, 0x75, 0x06, 0xb1, 0xe6, 0x57,
-    0xb1, 0xad, 0xb4, 0x3f, 0xff, 0xd0, 0xb9, 0x7c, 0xfb, 0x6e, 0x3e, 0x89,
-    0xc7, 0xe2, 0x6b, 0x38, 0x92, 0xdc, 0xb1, 0xad, 0x4d, 0x46, 0x23, 0x95,
-    0x98, 0x0e, 0x00, 0xda, 0xde, 0xde, 0x95, 0x96, 0x9b, 0x59, 0xd5, 0x73,
-    0x9c, 0x9a, 0xd1, 0x4a, 0xd1, 0xb9, 0x93, 0x57, 0x76, 0x0d, 0xa4, 0xf2,
-    0x14, 0xd2, 0x88, 0xdc, 0x9c, 0x2a, 0x9c, 0xd7, 0x41, 0x95, 0x4f, 0x95,
-    0x47, 0x4a, 0x6e, 0xe6, 0xae, 0x69, 0x62, 0x1a, 0x35, 0x54, 0x91, 0x1d,
-    0xb4, 0x26, 0x18, 0x82, 0x9e, 0xb5, 0x2a, 0x71, 0x39, 0x1f, 0xde, 0x5f,
-    0xe5, 0x4d, 0xcb, 0x1a, 0x58, 0x46, 0xe9, 0x0b, 0x76, 0x51, 0x8f, 0xc7,
-    0xbd, 0x63, 0x09, 0x5e, 0x46, 0x8d, 0x59, 0x1f, 0xff, 0xd1, 0xe8, 0xc9,
-    0x00, 0x64, 0xd5, 0x19, 0xe6, 0x4d, 0xa5, 0x40, 0x03, 0x35, 0x78, 0x80,
-    0x46, 0x0d, 0x54, 0x96, 0xd0, 0x3f, 0x43, 0x49, 0xab, 0xab, 0x02, 0x10,
-    0x9e, 0x73, 0x48, 0xb1, 0x23, 0x67, 0x8e, 0x9e, 0xe6, 0x98, 0x20, 0xb8,
-    0x4e, 0x15, 0xb8, 0xa5, 0xf2, 0x6e, 0x1b, 0x82, 0x70, 0x3d, 0xab, 0x91,
-    0x51, 0x92, 0x66, 0xbc, 0xc8, 0x6a, 0x08, 0xb7, 0xb2, 0xb0, 0xcf, 0x3c,
-    0x72, 0x6b, 0x41, 0x02, 0x85, 0x01, 0x06, 0x05, 0x55, 0x8e, 0xd4, 0x27,
-    0x24, 0xd5, 0xb0, 0x00, 0x18, 0x15, 0xd3, 0x08, 0x72, 0xa3, 0x36, 0xee,
-    0x7f, 0xff, 0xd9
-};
-
-const uint8_t dummy_jpeg_file[] = {
-    0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x10, 0x4A, 0x46, 0x49, 0x46, 0x00, 0x01, 0x01, 0x00, 0x00, 0x01,
-    0x00, 0x01, 0x00, 0x00, 0xFF, 0xDB, 0x00, 0x43, 0x00, 0x03, 0x02, 0x02, 0x02, 0x02, 0x02, 0x03,
-    0x02, 0x02, 0x02, 0x03, 0x03, 0x03, 0x03, 0x04, 0x06, 0x04, 0x04, 0x04, 0x04, 0x04, 0x08, 0x06,
-    0x06, 0x05, 0x06, 0x09, 0x08, 0x0A, 0x0A, 0x09, 0x08, 0x09, 0x09, 0x0A, 0x0C, 0x0F, 0x0C, 0x0A,
-    0x0B, 0x0E, 0x0B, 0x09, 0x09, 0x0D, 0x11, 0x0D, 0x0E, 0x0F, 0x10, 0x10, 0x11, 0x10, 0x0A, 0x0C,
-    0x12, 0x13, 0x12, 0x10, 0x13, 0x0F, 0x10, 0x10, 0x10, 0xFF, 0xDB, 0x00, 0x43, 0x01, 0x03, 0x03,
-    0x03, 0x04, 0x03, 0x04, 0x08, 0x04, 0x04, 0x08, 0x10, 0x0B, 0x09, 0x0B, 0x10, 0x10, 0x10, 0x10,
-    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
-    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
-    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0xFF, 0xC0,
-    0x00, 0x11, 0x08, 0x00, 0x10, 0x00, 0x10, 0x03, 0x01, 0x11, 0x00, 0x02, 0x11, 0x01, 0x03, 0x11,
-    0x01, 0xFF, 0xC4, 0x00, 0x16, 0x00, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x07, 0x04, 0x05, 0xFF, 0xC4, 0x00, 0x24, 0x10, 0x00, 0x01,
-    0x04, 0x01, 0x04, 0x02, 0x02, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02,
-    0x03, 0x04, 0x06, 0x05, 0x07, 0x08, 0x12, 0x13, 0x11, 0x22, 0x00, 0x14, 0x09, 0x31, 0x32, 0xFF,
-    0xC4, 0x00, 0x16, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0x00, 0x00, 0x00, 0x00, 0x06, 0x07, 0x05, 0xFF, 0xC4, 0x00, 0x25, 0x11, 0x00, 0x01, 0x03, 0x03,
-    0x03, 0x04, 0x03, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x11,
-    0x04, 0x05, 0x12, 0x00, 0x21, 0x41, 0x06, 0x31, 0x61, 0x71, 0x07, 0x22, 0x51, 0xA1, 0xFF, 0xDA,
-    0x00, 0x0C, 0x03, 0x01, 0x00, 0x02, 0x11, 0x03, 0x11, 0x00, 0x3F, 0x00, 0x14, 0xA6, 0xD2, 0x6A,
-    0x1B, 0x73, 0xC1, 0xE6, 0x13, 0x12, 0xD4, 0x95, 0x1C, 0xF3, 0x11, 0x63, 0xE4, 0x25, 0x65, 0xBE,
-    0xBA, 0x5A, 0xEC, 0x69, 0x45, 0x40, 0xB1, 0xC9, 0x20, 0xB2, 0x54, 0xA5, 0x1F, 0xD2, 0xCA, 0xB8,
-    0xFA, 0xF2, 0x20, 0xAB, 0x95, 0x0A, 0x9A, 0x82, 0x9E, 0xCE, 0x82, 0xAC, 0xFB, 0xC4, 0x92, 0x60,
-    0x48, 0x9F, 0x5F, 0xA7, 0x62, 0x4F, 0x1C, 0x8D, 0x4F, 0xEA, 0x2B, 0xAA, 0x2E, 0xEB, 0x03, 0x0E,
-    0xD3, 0x00, 0x09, 0x30, 0x63, 0xDF, 0xE0, 0xDC, 0x01, 0xCF, 0x06, 0x35, 0x8F, 0x65, 0xDB, 0x24,
-    0xCD, 0x79, 0xA6, 0xDD, 0xF5, 0xF9, 0x9B, 0x69, 0xC5, 0xE0, 0x69, 0x55, 0xC7, 0x1F, 0xC7, 0x3A,
-    0x9C, 0x78, 0x92, 0xCE, 0x75, 0xF8, 0xC8, 0x94, 0xFC, 0x86, 0x9A, 0x77, 0xB5, 0x1C, 0x52, 0x8E,
-    0x2D, 0x20, 0xBA, 0x12, 0xE2, 0x0A, 0x9C, 0x5A, 0x47, 0xB3, 0x4B, 0x48, 0x91, 0xF5, 0xCF, 0x5D,
-    0xD1, 0x5B, 0xEF, 0xD4, 0xB6, 0xB6, 0x00, 0x75, 0x6E, 0x94, 0xA5, 0x50, 0xA8, 0xC3, 0x25, 0x00,
-    0x09, 0xD8, 0x83, 0x39, 0x4C, 0x48, 0x3B, 0x79, 0x1A, 0x77, 0xD3, 0x36, 0x4A, 0x85, 0x5B, 0xDC,
-    0x7D, 0xD0, 0x52, 0x04, 0x91, 0x23, 0xBC, 0x0F, 0xE7, 0x6D, 0x27, 0x7E, 0x3D, 0xF7, 0x23, 0x4E,
-    0x95, 0x9D, 0xD4, 0x2B, 0x4E, 0xB1, 0xDA, 0xE9, 0x15, 0x8C, 0xAB, 0x70, 0xB1, 0x70, 0x30, 0xAF,
-    0x64, 0x25, 0x33, 0x0C, 0xF5, 0x2D, 0x72, 0x97, 0x29, 0x2C, 0xA9, 0xF7, 0x39, 0x10, 0xA5, 0x22,
-    0x29, 0x70, 0x25, 0x5E, 0x0F, 0x5B, 0x3E, 0x47, 0x90, 0x0F, 0xC2, 0x3F, 0x30, 0x55, 0x5D, 0xEF,
-    0x0D, 0xD2, 0xA6, 0x99, 0xA5, 0xB8, 0x06, 0x72, 0x1B, 0x4A, 0x94, 0x27, 0xEB, 0x04, 0x81, 0x3B,
-    0xF7, 0x89, 0xF3, 0x1C, 0xEB, 0x57, 0xA5, 0x28, 0x28, 0xED, 0xE5, 0xC0, 0x54, 0x04, 0xC6, 0xEA,
-    0x23, 0xCF, 0xAD, 0x55, 0xBE, 0x1D, 0xF6, 0x62, 0xA1, 0x40, 0xCC, 0xE8, 0xDE, 0x99, 0xBD, 0x5C,
-    0xB7, 0x43, 0xB3, 0xD7, 0x7A, 0x65, 0x58, 0xB1, 0xD9, 0x51, 0x21, 0x88, 0xBF, 0x64, 0xB8, 0xD3,
-    0xF1, 0xC3, 0x68, 0x04, 0x29, 0xC0, 0xD0, 0xFE, 0xBB, 0x3C, 0x02, 0xE0, 0x3C, 0x54, 0x07, 0xB0,
-    0x7E, 0x88, 0xF8, 0xE9, 0xEA, 0xAA, 0x96, 0xAF, 0x17, 0x15, 0xA9, 0xB2, 0xD2, 0xC1, 0x0D, 0x94,
-    0x29, 0x24, 0x90, 0x12, 0xA0, 0x49, 0x58, 0x49, 0x10, 0xA3, 0x89, 0x18, 0x10, 0x4A, 0x4E, 0x2A,
-    0x20, 0x83, 0xA4, 0x77, 0x5B, 0xD2, 0x19, 0x6D, 0x54, 0xAC, 0x00, 0xAC, 0x81, 0x19, 0x48, 0x31,
-    0x24, 0x8E, 0x27, 0x8D, 0xC6, 0xFC, 0x89, 0x1C, 0x6B, 0xFF, 0xD9
-};
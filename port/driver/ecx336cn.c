@@ -27,6 +27,8 @@
  * Sony Microdisplay driver.
  */
 
+#define LOG_MODULE DISPLAY
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
@@ -143,10 +145,10 @@ uint8_t ecx336cn_config[] = {
 
 static inline const void ecx336cn_write_byte(uint8_t addr, uint8_t data)
 {
-    spi_chip_select(SPI_DISP_CS_PIN);
+    spi_chip_select(SPI_DEVICE_DISPLAY);
     spi_write(&addr, 1);
     spi_write(&data, 1);
-    spi_chip_deselect(SPI_DISP_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_DISPLAY);
 }
 
 static inline uint8_t ecx336cn_read_byte(uint8_t addr)
@@ -156,10 +158,10 @@ static inline uint8_t ecx336cn_read_byte(uint8_t addr)
     ecx336cn_write_byte(0x80, 0x01);
     ecx336cn_write_byte(0x81, addr);
 
-    spi_chip_select(SPI_DISP_CS_PIN);
+    spi_chip_select(SPI_DEVICE_DISPLAY);
     spi_write(&addr, 1);
     spi_read(&data, 1);
-    spi_chip_deselect(SPI_DISP_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_DISPLAY);
 
     return data;
 }
@@ -25,9 +25,12 @@
  * Flash chip driver.
  */
 
+#define LOG_MODULE FLASH
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 #include "nrf_gpio.h"
 #include "nrfx_log.h"
@@ -45,19 +48,87 @@
 #define FLASH_CMD_READ              0x03
 #define FLASH_CMD_ENABLE_WRITE      0x06
 #define FLASH_CMD_STATUS            0x05
+#define FLASH_CMD_SECTOR_ERASE      0x20
 #define FLASH_CMD_CHIP_ERASE        0xC7
 #define FLASH_CMD_JEDEC_ID          0x9F
 #define FLASH_CMD_DEVICE_ID         0x90
 
 #define FLASH_STATUS_BUSY_MASK      0x01
 
+// Largest transfer of the SPIM, which counts the bytes on 8 bits
+#define FLASH_XFER_MAX              255
+
+/**
+ * Steps of the operation started by flash_read_async() or flash_program_async().
+ */
+typedef enum
+{
+    FLASH_ASYNC_IDLE,           // No operation in progress
+    FLASH_ASYNC_READ,           // Read command to send
+    FLASH_ASYNC_ENABLE_WRITE,   // Write enable command to send, ahead of the program command
+    FLASH_ASYNC_PROGRAM,        // Program command to send
+    FLASH_ASYNC_STATUS,         // Status to poll until the chip is done programming
+} flash_async_step_t;
+
+/** The flash is in use, by a thread or by the asynchronous operation, which must not interleave. */
+static volatile bool flash_busy;
+
+static struct
+{
+    volatile flash_async_step_t step;
+    volatile bool running;      // A transfer of the current step is on the bus, until its callback
+    bool locked;                // The operation holds flash_busy, from its first transfer on
+    uint8_t *buf;               // Buffer receiving the data read
+    size_t len;                 // Length of the data to read or program
+    spi_callback_t *callback;   // Called once the whole operation is done
+    uint8_t cmd[4 + FLASH_ASYNC_PROGRAM_MAX];
+    uint8_t opcode[1];          // Single byte commands, sent from RAM as EasyDMA requires
+    uint8_t status[2];
+} flash_async;
+
+static void flash_async_run(void);
+static void flash_async_timer_handler(void);
+
+/**
+ * Take the flash for a thread operation if it is free.
+ * @return True if the flash is now ours.
+ */
+static bool flash_try_lock(void)
+{
+    bool locked = false;
+
+    __disable_irq();
+    if (!flash_busy)
+        flash_busy = locked = true;
+    __enable_irq();
+    return locked;
+}
+
+/**
+ * Take the flash for a thread operation, once the asynchronous one completed.
+ */
+static void flash_lock(void)
+{
+    while (!flash_try_lock())
+        __WFE();
+}
+
+/**
+ * Release the flash, and start the asynchronous operation waiting for it.
+ */
+static void flash_unlock(void)
+{
+    flash_busy = false;
+    flash_async_run();
+}
+
 /**
  * Set the CS pin configured with #define SPI_FLASH_CS_PIN
  */
 static inline void flash_chip_select(void)
 {
     nrfx_systick_delay_us(10);
-    nrf_gpio_pin_clear(SPI_FLASH_CS_PIN);
+    spi_chip_select(SPI_DEVICE_FLASH);
     nrfx_systick_delay_us(10);
 }
 
@@ -67,7 +138,7 @@ static inline void flash_chip_select(void)
 static inline void flash_chip_deselect(void)
 {
     nrfx_systick_delay_us(10);
-    nrf_gpio_pin_set(SPI_FLASH_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_FLASH);
     nrfx_systick_delay_us(10);
 }
 
@@ -95,7 +166,9 @@ uint32_t flash_get_jedec_id(void)
 {
     uint8_t buf[3] = {0};
 
+    flash_lock();
     flash_cmd_input(FLASH_CMD_JEDEC_ID, buf, sizeof buf);
+    flash_unlock();
     return buf[0] << 16 | buf[1] << 8 | buf[2] << 0;
 }
 
@@ -117,24 +190,51 @@ static void flash_enable_write(void)
 }
 
 /**
- * Program a page of the flash chip at the given address.
+ * Program bytes of the flash chip from any address, splitting at the page
+ * boundaries, each page being sent in as many transfers as needed under the
+ * same chip select. Programming only turns bits from 1 to 0, so the bytes
+ * written are expected to be erased.
  * @param addr The address at which the data is written.
- * @param page The buffer holding the data to be sent to the flash chip, of size @ref FLASH_PAGE_SIZE.
+ * @param buf The data to write.
+ * @param len The size of ``buf``.
  */
-void flash_program_page(uint32_t addr, uint8_t page[FLASH_PAGE_SIZE])
+void flash_program(uint32_t addr, uint8_t const *buf, size_t len)
 {
-    uint8_t cmds[] = { FLASH_CMD_PROGRAM_PAGE, addr >> 16, addr >> 8, addr >> 0 };
+    flash_lock();
+    while (len > 0)
+    {
+        size_t n = FLASH_PAGE_SIZE - addr % FLASH_PAGE_SIZE;
+        uint8_t cmds[] = { FLASH_CMD_PROGRAM_PAGE, addr >> 16, addr >> 8, addr >> 0 };
 
-    ASSERT(addr % FLASH_PAGE_SIZE == 0);
+        if (n > len)
+            n = len;
 
-    flash_enable_write();
+        flash_enable_write();
 
-    flash_chip_select();
-    spi_write(cmds, sizeof cmds);
-    spi_read(page, FLASH_PAGE_SIZE);
-    flash_chip_deselect();
+        flash_chip_select();
+        spi_write(cmds, sizeof cmds);
+        for (size_t i = 0; i < n; i += FLASH_XFER_MAX)
+            spi_write((uint8_t *)buf + i, n - i < FLASH_XFER_MAX ? n - i : FLASH_XFER_MAX);
+        flash_chip_deselect();
 
-    flash_wait_completion();
+        flash_wait_completion();
+
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+    flash_unlock();
+}
+
+/**
+ * Program a page of the flash chip at the given address.
+ * @param addr The address at which the data is written.
+ * @param page The buffer holding the data to be sent to the flash chip, of size @ref FLASH_PAGE_SIZE.
+ */
+void flash_program_page(uint32_t addr, uint8_t page[FLASH_PAGE_SIZE])
+{
+    ASSERT(addr % FLASH_PAGE_SIZE == 0);
+    flash_program(addr, page, FLASH_PAGE_SIZE);
 }
 
 /**
@@ -147,10 +247,34 @@ void flash_read(uint32_t addr, uint8_t *buf, size_t len)
 {
     uint8_t cmds[] = { FLASH_CMD_READ, addr >> 16, addr >> 8, addr >> 0 };
 
+    flash_lock();
     flash_chip_select();
     spi_write(cmds, sizeof cmds);
-    spi_read(buf, len);
+    for (size_t i = 0; i < len; i += FLASH_XFER_MAX)
+        spi_read(buf + i, len - i < FLASH_XFER_MAX ? len - i : FLASH_XFER_MAX);
     flash_chip_deselect();
+    flash_unlock();
+}
+
+/**
+ * Erase a sector of the flash chip, setting all its bytes to 0xFF.
+ * @param addr The address of the sector, multiple of @ref FLASH_SECTOR_SIZE.
+ */
+void flash_erase_sector(uint32_t addr)
+{
+    uint8_t cmds[] = { FLASH_CMD_SECTOR_ERASE, addr >> 16, addr >> 8, addr >> 0 };
+
+    ASSERT(addr % FLASH_SECTOR_SIZE == 0);
+
+    flash_lock();
+    flash_enable_write();
+
+    flash_chip_select();
+    spi_write(cmds, sizeof cmds);
+    flash_chip_deselect();
+
+    flash_wait_completion();
+    flash_unlock();
 }
 
 /**
@@ -158,18 +282,196 @@ void flash_read(uint32_t addr, uint8_t *buf, size_t len)
  */
 void flash_erase_chip(void)
 {
+    flash_lock();
     flash_cmd_output(FLASH_CMD_CHIP_ERASE, NULL, 0);
     flash_wait_completion();
+    flash_unlock();
 }
 
 uint8_t flash_get_device_id(void)
 {
     uint8_t id;
 
+    flash_lock();
     flash_cmd_input(FLASH_CMD_DEVICE_ID, &id, 1);
+    flash_unlock();
     return id;
 }
 
+/**
+ * The operation is complete: release the flash and tell the caller.
+ */
+static void flash_async_finish(void)
+{
+    spi_callback_t *callback = flash_async.callback;
+
+    timer_del_handler(flash_async_timer_handler);
+    flash_async.locked = false;
+    flash_async.step = FLASH_ASYNC_IDLE;
+    flash_busy = false;
+    callback();
+}
+
+/**
+ * A transfer of the asynchronous operation completed, go to the next step.
+ * Called from the SPI interrupt.
+ */
+static void flash_async_done(void)
+{
+    flash_async.running = false;
+
+    switch (flash_async.step)
+    {
+    case FLASH_ASYNC_ENABLE_WRITE:
+        flash_async.step = FLASH_ASYNC_PROGRAM;
+        flash_async_run();
+        break;
+
+    case FLASH_ASYNC_PROGRAM:
+        // Programming a page takes a few milliseconds, poll from the timer
+        flash_async.step = FLASH_ASYNC_STATUS;
+        break;
+
+    case FLASH_ASYNC_STATUS:
+        if (flash_async.status[1] & FLASH_STATUS_BUSY_MASK)
+            break;
+        flash_async_finish();
+        break;
+
+    default:
+        flash_async_finish();
+        break;
+    }
+}
+
+/**
+ * Start the transfer of the current step, unless one is already on the bus
+ * or a thread holds the flash. Can be called from any context.
+ */
+static void flash_async_run(void)
+{
+    uint8_t const *tx = flash_async.cmd;
+    uint8_t *rx = NULL;
+    size_t tx_len = 1, rx_len = 0;
+    bool start;
+
+    __disable_irq();
+    start = flash_async.step != FLASH_ASYNC_IDLE && !flash_async.running &&
+            (flash_async.locked || !flash_busy);
+    if (start)
+        flash_busy = flash_async.locked = flash_async.running = true;
+    __enable_irq();
+    if (!start)
+        return;
+
+    switch (flash_async.step)
+    {
+    case FLASH_ASYNC_READ:
+        tx_len = 4;
+        rx = flash_async.buf;
+        rx_len = 4 + flash_async.len;
+        break;
+
+    case FLASH_ASYNC_ENABLE_WRITE:
+        flash_async.opcode[0] = FLASH_CMD_ENABLE_WRITE;
+        tx = flash_async.opcode;
+        break;
+
+    case FLASH_ASYNC_PROGRAM:
+        tx_len = 4 + flash_async.len;
+        break;
+
+    default:
+        flash_async.opcode[0] = FLASH_CMD_STATUS;
+        tx = flash_async.opcode;
+        rx = flash_async.status;
+        rx_len = sizeof flash_async.status;
+        break;
+    }
+
+    // If too many transactions wait for the bus, retry from the timer
+    if (!spi_xfer_async(SPI_DEVICE_FLASH, SPI_PRIORITY_LOW, tx, tx_len, rx, rx_len,
+            flash_async_done))
+        flash_async.running = false;
+}
+
+/**
+ * Retry the steps that could not start, and poll the end of programming.
+ */
+static void flash_async_timer_handler(void)
+{
+    flash_async_run();
+}
+
+/**
+ * Claim the asynchronous operation, which there is only one of at a time, and start it.
+ * @return False if one is already in progress.
+ */
+static bool flash_async_start(flash_async_step_t step, uint8_t cmd, uint32_t addr,
+        uint8_t *buf, size_t len, spi_callback_t *callback)
+{
+    bool claimed;
+
+    ASSERT(callback != NULL);
+
+    __disable_irq();
+    claimed = flash_async.step == FLASH_ASYNC_IDLE;
+    if (claimed)
+    {
+        flash_async.cmd[0] = cmd;
+        flash_async.cmd[1] = addr >> 16;
+        flash_async.cmd[2] = addr >> 8;
+        flash_async.cmd[3] = addr >> 0;
+        if (step != FLASH_ASYNC_READ)
+            memcpy(flash_async.cmd + 4, buf, len);
+        flash_async.buf = buf;
+        flash_async.len = len;
+        flash_async.callback = callback;
+        flash_async.step = step;
+    }
+    __enable_irq();
+    if (!claimed)
+        return false;
+
+    timer_add_handler(flash_async_timer_handler);
+    flash_async_run();
+    return true;
+}
+
+/**
+ * Read the flash in the background, for use from interrupts of higher
+ * priority than the SPI one, which cannot wait for the bus. The read waits
+ * for any thread operation on the flash to complete.
+ * @param addr The address at which the data is read.
+ * @param buf The buffer receiving the data at buf[4], after the room for the command.
+ * @param len Length of the data, at most @ref FLASH_ASYNC_READ_MAX.
+ * @param callback Function called from an interrupt once the data is in the buffer.
+ * @return False if another asynchronous operation is in progress.
+ */
+bool flash_read_async(uint32_t addr, uint8_t *buf, size_t len, void (*callback)(void))
+{
+    ASSERT(len <= FLASH_ASYNC_READ_MAX);
+    return flash_async_start(FLASH_ASYNC_READ, FLASH_CMD_READ, addr, buf, len, callback);
+}
+
+/**
+ * Program a few bytes of the flash in the background, such as to update a
+ * flag, within a single page. As with flash_program(), the bytes written are
+ * expected to be erased.
+ * @param addr The address at which the data is written.
+ * @param buf The data to write, copied.
+ * @param len Length of the data, at most @ref FLASH_ASYNC_PROGRAM_MAX.
+ * @param callback Function called from an interrupt once the chip is done.
+ * @return False if another asynchronous operation is in progress.
+ */
+bool flash_program_async(uint32_t addr, uint8_t const *buf, size_t len, void (*callback)(void))
+{
+    ASSERT(len <= FLASH_ASYNC_PROGRAM_MAX);
+    ASSERT(addr % FLASH_PAGE_SIZE + len <= FLASH_PAGE_SIZE);
+    return flash_async_start(FLASH_ASYNC_ENABLE_WRITE, FLASH_CMD_PROGRAM_PAGE, addr,
+            (uint8_t *)buf, len, callback);
+}
+
 /**
  * Configure the SPI peripheral.
  */
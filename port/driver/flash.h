@@ -27,11 +27,25 @@
  */
 
 #define FLASH_PAGE_SIZE 256
+#define FLASH_SECTOR_SIZE 4096
+
+// Longest transfers of flash_read_async() and flash_program_async().
+#define FLASH_ASYNC_READ_MAX 251
+#define FLASH_ASYNC_PROGRAM_MAX 16
+
+// Layout of the flash: the FPGA bitstream first, then the data of the firmware.
+#define FLASH_FONTS_ADDR 0x100000
+#define FLASH_SETTINGS_ADDR 0x180000
+#define FLASH_CAPTURES_ADDR 0x200000
 
 void flash_prepare(void);
 void flash_init(void);
 uint32_t flash_get_jedec_id(void);
+void flash_program(uint32_t addr, uint8_t const *buf, size_t len);
 void flash_program_page(uint32_t addr, uint8_t page[FLASH_PAGE_SIZE]);
 void flash_read(uint32_t addr, uint8_t *buf, size_t len);
+bool flash_read_async(uint32_t addr, uint8_t *buf, size_t len, void (*callback)(void));
+bool flash_program_async(uint32_t addr, uint8_t const *buf, size_t len, void (*callback)(void));
+void flash_erase_sector(uint32_t addr);
 void flash_erase_chip(void);
 uint8_t flash_get_device_id(void);
@@ -0,0 +1,213 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Font atlases read from the flash through a least recently used glyph cache.
+ */
+
+#define LOG_MODULE DISPLAY
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driver/font.h"
+
+#ifdef __arm__
+#include "nrfx_log.h"
+#define ASSERT  NRFX_ASSERT
+#else
+#include <assert.h>
+#define ASSERT  assert
+#endif
+
+typedef struct
+{
+    bool checked;               // The header was read
+    bool valid;                 // The header was found correct
+    uint8_t line_height;
+    uint16_t first;
+    uint16_t count;
+} font_info_t;
+
+typedef struct
+{
+    uint8_t font;               // FONT_MAX if the entry is empty
+    uint16_t code;
+    uint32_t used;              // Value of font_clock when last used
+    font_glyph_t glyph;
+    uint8_t bitmap[FONT_GLYPH_MAX_SIZE];
+} font_cache_entry_t;
+
+static font_read_t *font_read;
+static font_info_t font_infos[FONT_MAX];
+static font_cache_entry_t font_cache[FONT_CACHE_SIZE];
+static uint32_t font_clock;
+static font_stats_t font_stats;
+
+static inline uint16_t font_u16(uint8_t const *p)
+{
+    return p[0] << 0 | p[1] << 8;
+}
+
+static inline uint32_t font_u32(uint8_t const *p)
+{
+    return p[0] << 0 | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**
+ * Forget the atlases and glyphs read so far, such as after the flash got
+ * written.
+ */
+void font_flush(void)
+{
+    memset(font_infos, 0, sizeof font_infos);
+    for (size_t i = 0; i < FONT_CACHE_SIZE; i++)
+        font_cache[i].font = FONT_MAX;
+}
+
+/**
+ * Set where to read the atlases from.
+ * @param read Function reading from the first slot on.
+ */
+void font_init(font_read_t *read)
+{
+    font_read = read;
+    font_flush();
+}
+
+/**
+ * Read the header of an atlas the first time it is used.
+ * @return The header, or NULL if there is no valid atlas in that slot.
+ */
+static font_info_t const *font_open(uint8_t font)
+{
+    font_info_t *info;
+    uint8_t header[FONT_HEADER_SIZE];
+
+    ASSERT(font_read != NULL);
+
+    if (font >= FONT_MAX)
+        return NULL;
+    info = &font_infos[font];
+    if (!info->checked)
+    {
+        font_read(font * FONT_SLOT_SIZE, header, sizeof header);
+        info->checked = true;
+        info->line_height = header[6];
+        info->first = font_u16(header + 8);
+        info->count = font_u16(header + 10);
+        info->valid = memcmp(header, "MFNT", 4) == 0
+                && header[4] == FONT_VERSION && header[5] == FONT_BPP
+                && info->count > 0 && info->first + info->count <= 0x10000
+                && FONT_HEADER_SIZE + info->count * FONT_INDEX_SIZE <= FONT_SLOT_SIZE;
+    }
+    return info->valid ? info : NULL;
+}
+
+/**
+ * @return The distance between two lines of text, or 0 if there is no such font.
+ */
+uint8_t font_line_height(uint8_t font)
+{
+    font_info_t const *info = font_open(font);
+
+    return info == NULL ? 0 : info->line_height;
+}
+
+/**
+ * Read a glyph into the cache, in place of the least recently used one.
+ * @return The cache entry, or NULL if the atlas is corrupted.
+ */
+static font_cache_entry_t *font_load(uint8_t font, font_info_t const *info, uint16_t code)
+{
+    font_cache_entry_t *entry = &font_cache[0];
+    uint8_t index[FONT_INDEX_SIZE];
+    uint32_t offset;
+    size_t size;
+
+    for (size_t i = 1; i < FONT_CACHE_SIZE && entry->font != FONT_MAX; i++)
+        if (font_cache[i].font == FONT_MAX || font_cache[i].used < entry->used)
+            entry = &font_cache[i];
+
+    font_read(font * FONT_SLOT_SIZE + FONT_HEADER_SIZE + (code - info->first) * FONT_INDEX_SIZE,
+            index, sizeof index);
+    offset = font_u32(index + 0);
+    entry->glyph.width = index[4];
+    entry->glyph.height = index[5];
+    entry->glyph.left = (int8_t)index[6];
+    entry->glyph.top = (int8_t)index[7];
+    entry->glyph.advance = index[8];
+    entry->glyph.bitmap = entry->bitmap;
+
+    size = FONT_ROW_SIZE(entry->glyph.width) * entry->glyph.height;
+    if (size > FONT_GLYPH_MAX_SIZE || offset + size > FONT_SLOT_SIZE)
+    {
+        entry->font = FONT_MAX;
+        return NULL;
+    }
+    font_read(font * FONT_SLOT_SIZE + offset, entry->bitmap, size);
+
+    entry->font = font;
+    entry->code = code;
+    return entry;
+}
+
+/**
+ * Get the glyph of a character, from the cache if it was used recently.
+ * @param font Slot of the atlas.
+ * @param code Unicode code point of the character.
+ * @return The glyph, or NULL if the font has no such character.
+ */
+font_glyph_t const *font_glyph(uint8_t font, uint16_t code)
+{
+    font_info_t const *info = font_open(font);
+    font_cache_entry_t *entry = NULL;
+
+    if (info == NULL || code < info->first || code - info->first >= info->count)
+        return NULL;
+
+    for (size_t i = 0; i < FONT_CACHE_SIZE; i++)
+    {
+        if (font_cache[i].font == font && font_cache[i].code == code)
+        {
+            entry = &font_cache[i];
+            font_stats.hits++;
+            break;
+        }
+    }
+    if (entry == NULL)
+    {
+        font_stats.misses++;
+        entry = font_load(font, info, code);
+        if (entry == NULL)
+            return NULL;
+    }
+    entry->used = ++font_clock;
+    return &entry->glyph;
+}
+
+font_stats_t font_get_stats(void)
+{
+    return font_stats;
+}
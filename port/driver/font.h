@@ -0,0 +1,80 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Anti-aliased fonts stored as atlases in the external flash, as produced by
+ * tools/font_atlas.py, one per slot of FONT_SLOT_SIZE bytes. The glyphs are
+ * read on demand into a small cache, evicting the least recently used.
+ * It does not depend on the hardware, and also builds on the host.
+ *
+ * Atlas format, little endian:
+ *   header:    "MFNT", version, bits per pixel, line height, reserved,
+ *              first character (u16), number of characters (u16), reserved (u32)
+ *   index:     per character: offset of the bitmap from the start of the
+ *              atlas (u32), width, height, left, top (i8), advance, reserved
+ *   bitmaps:   rows of 4-bit coverage, high nibble first, each row starting
+ *              on a new byte
+ */
+
+#define FONT_MAX                    8
+#define FONT_SLOT_SIZE              0x10000
+
+#define FONT_HEADER_SIZE            16
+#define FONT_INDEX_SIZE             10
+#define FONT_VERSION                1
+#define FONT_BPP                    4
+
+/** Glyphs in RAM, and the size of their bitmap, enough for 16x20 pixels. */
+#define FONT_CACHE_SIZE             24
+#define FONT_GLYPH_MAX_SIZE         160
+
+/** Bytes per row of a glyph bitmap. */
+#define FONT_ROW_SIZE(width)        (((width) * FONT_BPP + 7) / 8)
+
+/**
+ * Source of the atlases, such as the external flash.
+ * @param addr Address to read from, relative to the first slot.
+ * @param buf Buffer to fill.
+ * @param len Number of bytes to read.
+ */
+typedef void font_read_t(uint32_t addr, uint8_t *buf, size_t len);
+
+typedef struct
+{
+    uint8_t width;              // Size of the bitmap
+    uint8_t height;
+    int8_t left;                // Position of the bitmap from the pen position
+    int8_t top;                 // Position of the bitmap from the top of the line
+    uint8_t advance;            // Move of the pen position to the next character
+    uint8_t const *bitmap;      // FONT_BPP coverage per pixel, valid until the next font_glyph()
+} font_glyph_t;
+
+typedef struct
+{
+    uint32_t hits;
+    uint32_t misses;
+} font_stats_t;
+
+void font_init(font_read_t *read);
+void font_flush(void);
+uint8_t font_line_height(uint8_t font);
+font_glyph_t const *font_glyph(uint8_t font, uint16_t code);
+font_stats_t font_get_stats(void);
@@ -25,16 +25,21 @@
  * FPGA Communication driver
  */
 
+#define LOG_MODULE FPGA
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "nrfx_gpiote.h"
 #include "nrfx_systick.h"
 #include "nrfx_log.h"
 
 #include "driver/config.h"
 #include "driver/fpga.h"
 #include "driver/max77654.h"
+#include "driver/nrfx.h"
 #include "driver/ov5640.h"
 #include "driver/spi.h"
 #include "driver/timer.h"
@@ -47,14 +52,14 @@ void fpga_check_pins(char const *msg)
 
     if (first)
     {
-        LOG("| INT   |       | MODE1 |       |       |");
-        LOG("| RECFG | SCK   | CSN   | MOSI  | MISO  |");
-        LOG("+-------+-------+-------+-------+-------+");
-        LOG("| P0.05 | P0.07 | P0.08 | P0.09 | P0.10 |");
-        LOG("+=======+=======+=======+=======+=======+");
+        LOG_DEBUG("| INT   |       | MODE1 |       |       |");
+        LOG_DEBUG("| RECFG | SCK   | CSN   | MOSI  | MISO  |");
+        LOG_DEBUG("+-------+-------+-------+-------+-------+");
+        LOG_DEBUG("| P0.05 | P0.07 | P0.08 | P0.09 | P0.10 |");
+        LOG_DEBUG("+=======+=======+=======+=======+=======+");
         first = false;
     }
-    LOG("|  %3d  |  %3d  |  %3d  |  %3d  |  %3d  | %s",
+    LOG_DEBUG("|  %3d  |  %3d  |  %3d  |  %3d  |  %3d  | %s",
         nrf_gpio_pin_read(FPGA_RECONFIG_N_PIN),
         nrf_gpio_pin_read(SPI2_SCK_PIN),
         nrf_gpio_pin_read(FPGA_MODE1_PIN),
@@ -64,37 +69,111 @@ void fpga_check_pins(char const *msg)
     );
 }
 
-void fpga_deinit(void)
+static struct
 {
-    nrf_gpio_cfg_default(FPGA_MODE1_PIN);
-    nrf_gpio_cfg_default(FPGA_RECONFIG_N_PIN);
+    bool open;                  // Commands get queued rather than sent
+    size_t len;
+    uint8_t buf[FPGA_BATCH_SIZE];
+} fpga_batch;
+
+/**
+ * Send the commands queued so far, each with its own chip select as the FPGA
+ * expects, but back to back with one transfer each.
+ */
+static void fpga_batch_send(void)
+{
+    if (fpga_batch.len > 0)
+        spi_write_batch(SPI_DEVICE_FPGA, fpga_batch.buf, fpga_batch.len);
+    fpga_batch.len = 0;
+}
+
+/**
+ * Queue a command, sending the queue first if it has no more room for it.
+ * @return False if it is too long to ever fit, and is to be sent directly.
+ */
+static bool fpga_batch_add(uint8_t cmd1, uint8_t cmd2, uint8_t const *buf, size_t len)
+{
+    uint8_t *p;
+
+    if (2 + len > UINT8_MAX || 1 + 2 + len > FPGA_BATCH_SIZE)
+        return false;
+    if (fpga_batch.len + 1 + 2 + len > FPGA_BATCH_SIZE)
+        fpga_batch_send();
+
+    p = fpga_batch.buf + fpga_batch.len;
+    *p++ = 2 + len;
+    *p++ = cmd1;
+    *p++ = cmd2;
+    if (len > 0)
+        memcpy(p, buf, len);
+    fpga_batch.len += 1 + 2 + len;
+    return true;
+}
+
+/**
+ * Queue the commands that follow instead of sending them one at a time, until
+ * fpga_batch_flush(), so that a sequence of commands reaches the FPGA at once.
+ * A command reading from the FPGA sends the queue first, to keep the order.
+ * Not for use from interrupts.
+ */
+void fpga_batch_begin(void)
+{
+    ASSERT(!fpga_batch.open);
+    fpga_batch.open = true;
+}
+
+/**
+ * Send the commands queued since fpga_batch_begin(), and stop queuing.
+ */
+void fpga_batch_flush(void)
+{
+    ASSERT(fpga_batch.open);
+    fpga_batch_send();
+    fpga_batch.open = false;
+}
+
+/**
+ * Send a command with its payload, or queue it if a batch is open.
+ * @param addr Command, such as 0x4410 for the graphics write base.
+ * @param buf Payload of the command.
+ * @param len Length of the payload.
+ */
+void fpga_write(uint16_t addr, uint8_t const *buf, size_t len)
+{
+    uint8_t cmd[] = { addr >> 8, addr >> 0 };
+
+    if (fpga_batch.open && fpga_batch_add(cmd[0], cmd[1], buf, len))
+        return;
+    fpga_batch_send();
+
+    spi_chip_select(SPI_DEVICE_FPGA);
+    spi_write(cmd, sizeof cmd);
+    if (len > 0)
+        spi_write((uint8_t *)buf, len);
+    spi_chip_deselect(SPI_DEVICE_FPGA);
 }
 
 static inline void fpga_cmd(uint8_t cmd1, uint8_t cmd2)
 {
-    spi_chip_select(SPI_FPGA_CS_PIN);
-    spi_write(&cmd1, 1);
-    spi_write(&cmd2, 1);
-    spi_chip_deselect(SPI_FPGA_CS_PIN);
+    fpga_write(cmd1 << 8 | cmd2, NULL, 0);
 }
 
 static inline void fpga_cmd_write(uint8_t cmd1, uint8_t cmd2, uint8_t *buf, size_t len)
 {
-    LOG("cmd1=0x%02X cmd2=0x%02X buf[]={ 0x%02X, ... (x%d) }", cmd1, cmd2, buf[0], len);
-    spi_chip_select(SPI_FPGA_CS_PIN);
-    spi_write(&cmd1, 1);
-    spi_write(&cmd2, 1);
-    spi_read(buf, len);
-    spi_chip_deselect(SPI_FPGA_CS_PIN);
+    LOG_DEBUG("cmd1=0x%02X cmd2=0x%02X buf[]={ 0x%02X, ... (x%d) }", cmd1, cmd2, buf[0], len);
+    fpga_write(cmd1 << 8 | cmd2, buf, len);
 }
 
 static inline void fpga_cmd_read(uint8_t cmd1, uint8_t cmd2, uint8_t *buf, size_t len)
 {
-    spi_chip_select(SPI_FPGA_CS_PIN);
-    spi_write(&cmd1, 1);
-    spi_write(&cmd2, 1);
+    uint8_t cmd[] = { cmd1, cmd2 };
+
+    fpga_batch_send();
+
+    spi_chip_select(SPI_DEVICE_FPGA);
+    spi_write(cmd, sizeof cmd);
     spi_read(buf, len);
-    spi_chip_deselect(SPI_FPGA_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_FPGA);
 }
 
 #define FPGA_CMD_SYSTEM 0x00
@@ -115,6 +194,154 @@ uint32_t fpga_system_version(void)
     return buf[0] << 16 | buf[1] << 8 | buf[2] << 0;
 }
 
+typedef struct
+{
+    uint16_t mask;
+    fpga_event_handler_t *handler;
+} fpga_subscriber_t;
+
+static fpga_subscriber_t fpga_subscribers[FPGA_MAX_SUBSCRIBERS];
+static uint8_t fpga_event_status[4];
+static volatile bool fpga_event_busy;       // Reading the status register
+static volatile bool fpga_event_retry;      // The SPI queue was full, try again at the next tick
+static volatile uint16_t fpga_event_seen;   // Events since the last fpga_event_clear()
+static bool fpga_event_enabled;
+
+static void fpga_event_read(void);
+
+/**
+ * Called from the SPI interrupt with the status register, which the read
+ * clears: dispatch the events, and read again if more arrived meanwhile.
+ */
+static void fpga_event_done(void)
+{
+    uint16_t events = fpga_event_status[2] << 8 | fpga_event_status[3];
+
+    fpga_event_busy = false;
+    fpga_event_seen |= events;
+
+    for (size_t i = 0; i < FPGA_MAX_SUBSCRIBERS; i++)
+        if (fpga_subscribers[i].handler != NULL && (events & fpga_subscribers[i].mask))
+            fpga_subscribers[i].handler(events & fpga_subscribers[i].mask);
+
+    if (!nrf_gpio_pin_read(FPGA_INT_PIN))
+        fpga_event_read();
+}
+
+/**
+ * Read the status register once in the background, or later if too many
+ * transactions already wait for the bus.
+ */
+static void fpga_event_read(void)
+{
+    static uint8_t cmd[] = { FPGA_CMD_SYSTEM, 0x03 };
+
+    if (fpga_event_busy)
+        return;
+    fpga_event_busy = true;
+    if (!spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_HIGH, cmd, sizeof cmd, fpga_event_status, 4, fpga_event_done))
+    {
+        fpga_event_busy = false;
+        fpga_event_retry = true;
+    }
+}
+
+static void fpga_int_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_t action)
+{
+    ASSERT(pin == FPGA_INT_PIN);
+    fpga_event_read();
+}
+
+static void fpga_timer_handler(void)
+{
+    if (fpga_event_retry)
+    {
+        fpga_event_retry = false;
+        fpga_event_read();
+    }
+}
+
+/**
+ * Have a function called on some of the events of the FPGA.
+ * @param mask Events to subscribe to, any of FPGA_EVENT_*.
+ * @param handler Function called from the SPI interrupt.
+ */
+void fpga_subscribe(uint16_t mask, fpga_event_handler_t *handler)
+{
+    for (size_t i = 0; i < FPGA_MAX_SUBSCRIBERS; i++)
+    {
+        if (fpga_subscribers[i].handler == NULL || fpga_subscribers[i].handler == handler)
+        {
+            __disable_irq();
+            fpga_subscribers[i].mask = mask;
+            fpga_subscribers[i].handler = handler;
+            __enable_irq();
+            return;
+        }
+    }
+    ASSERT(!"misconfiguration of FPGA_MAX_SUBSCRIBERS");
+}
+
+/**
+ * Forget some events that occurred, before starting the operation to wait for.
+ * @param mask Events to forget, any of FPGA_EVENT_*.
+ */
+void fpga_event_clear(uint16_t mask)
+{
+    __disable_irq();
+    fpga_event_seen &= ~mask;
+    __enable_irq();
+}
+
+/**
+ * Wait for any of some events since the last call to fpga_event_clear().
+ * @param mask Events to wait for, any of FPGA_EVENT_*.
+ * @param timeout_ms Time after which to give up.
+ * @return False if none of the events occurred in time.
+ */
+bool fpga_event_wait(uint16_t mask, uint32_t timeout_ms)
+{
+    uint64_t start = timer_get_uptime_ms();
+
+    while (!(fpga_event_seen & mask))
+    {
+        if (timer_get_uptime_ms() - start >= timeout_ms)
+            return false;
+        __WFE();
+    }
+    return true;
+}
+
+/**
+ * Listen to the interrupt pin, once the FPGA is configured and no longer
+ * needs it as its reconfiguration input. It idles high, and stays so with
+ * the pull-up if the FPGA does not drive it.
+ */
+static void fpga_event_enable(void)
+{
+    nrfx_gpiote_in_config_t config = NRFX_GPIOTE_CONFIG_IN_SENSE_HITOLO(true);
+    uint32_t err;
+
+    config.pull = NRF_GPIO_PIN_PULLUP;
+    err = nrfx_gpiote_in_init(FPGA_INT_PIN, &config, fpga_int_handler);
+    ASSERT(err == NRFX_SUCCESS);
+    nrfx_gpiote_in_event_enable(FPGA_INT_PIN, true);
+    fpga_event_enabled = true;
+
+    timer_add_handler(fpga_timer_handler);
+}
+
+void fpga_deinit(void)
+{
+    if (fpga_event_enabled)
+    {
+        nrfx_gpiote_in_uninit(FPGA_INT_PIN);
+        fpga_event_enabled = false;
+    }
+    nrf_gpio_cfg_default(FPGA_MODE1_PIN);
+    nrf_gpio_cfg_default(FPGA_RECONFIG_N_PIN);
+}
+
 #define FPGA_CMD_CAMERA 0x10
 
 void fpga_camera_zoom(uint8_t zoom_level)
@@ -137,6 +364,18 @@ void fpga_camera_capture(void)
     fpga_cmd(FPGA_CMD_CAMERA, 0x06);
 }
 
+/**
+ * Start a capture in the background, for use from interrupts.
+ * @param callback Called from the SPI interrupt once the command is sent, or NULL.
+ * @return False if too many transactions wait for the bus.
+ */
+bool fpga_camera_capture_async(void (*callback)(void))
+{
+    static uint8_t cmd[] = { FPGA_CMD_CAMERA, 0x06 };
+
+    return spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_LOW, cmd, sizeof cmd, NULL, 0, callback);
+}
+
 void fpga_camera_off(void)
 {
     fpga_cmd(FPGA_CMD_CAMERA, 0x08);
@@ -147,6 +386,48 @@ void fpga_camera_on(void)
     fpga_cmd(FPGA_CMD_CAMERA, 0x09);
 }
 
+#define FPGA_CMD_MICROPHONE 0x20
+
+void fpga_microphone_stop(void)
+{
+    fpga_cmd(FPGA_CMD_MICROPHONE, 0x04);
+}
+
+void fpga_microphone_start(void)
+{
+    fpga_cmd(FPGA_CMD_MICROPHONE, 0x05);
+}
+
+/**
+ * Start reading the number of samples buffered by the FPGA in the background.
+ * The count is big endian in buf[2] and buf[3], the first two bytes being
+ * clocked in while the command is sent.
+ * @param buf Buffer of 4 bytes, valid until the callback.
+ * @param callback Called from the SPI interrupt once done.
+ * @return False if too many transactions wait for the bus.
+ */
+bool fpga_microphone_get_status_async(uint8_t buf[4], void (*callback)(void))
+{
+    static uint8_t cmd[] = { FPGA_CMD_MICROPHONE, 0x00 };
+
+    return spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_HIGH, cmd, sizeof cmd, buf, 4, callback);
+}
+
+/**
+ * Start reading samples from the FPGA in the background, 16-bit big endian
+ * each, starting at buf[2] as for fpga_microphone_get_status_async().
+ * @param buf Buffer to fill, valid until the callback.
+ * @param len Length of the buffer, including the two leading bytes.
+ * @param callback Called from the SPI interrupt once done.
+ * @return False if too many transactions wait for the bus.
+ */
+bool fpga_microphone_get_data_async(uint8_t *buf, size_t len, void (*callback)(void))
+{
+    static uint8_t cmd[] = { FPGA_CMD_MICROPHONE, 0x10 };
+
+    return spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_HIGH, cmd, sizeof cmd, buf, len, callback);
+}
+
 #define FPGA_CMD_LIVE_VIDEO 0x30
 
 void fpga_live_video_start(void)
@@ -218,6 +499,37 @@ void fpga_capture_get_data(uint8_t *buf, size_t len)
     fpga_cmd_read(FPGA_CMD_CAPTURE, 0x10, buf, len);
 }
 
+/**
+ * Start reading the capture status in the background, which holds the size
+ * of the capture in bytes, big endian in buf[2] and buf[3], the first two
+ * bytes being clocked in while the command is sent.
+ * @param buf Buffer of 4 bytes, valid until the callback.
+ * @param callback Called from the SPI interrupt once done.
+ * @return False if too many transactions wait for the bus.
+ */
+bool fpga_capture_get_status_async(uint8_t buf[4], void (*callback)(void))
+{
+    static uint8_t cmd[] = { FPGA_CMD_CAPTURE, 0x00 };
+
+    return spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_LOW, cmd, sizeof cmd, buf, 4, callback);
+}
+
+/**
+ * Start reading the next bytes of the capture in the background, starting at
+ * buf[2] as for fpga_capture_get_status_async(). Every read continues where
+ * the previous one stopped.
+ * @param buf Buffer to fill, valid until the callback.
+ * @param len Length of the buffer, including the two leading bytes, at most 255.
+ * @param callback Called from the SPI interrupt once done.
+ * @return False if too many transactions wait for the bus.
+ */
+bool fpga_capture_get_data_async(uint8_t *buf, size_t len, void (*callback)(void))
+{
+    static uint8_t cmd[] = { FPGA_CMD_CAPTURE, 0x10 };
+
+    return spi_xfer_async(SPI_DEVICE_FPGA, SPI_PRIORITY_LOW, cmd, sizeof cmd, buf, len, callback);
+}
+
 /**
  * Initial configuration of the registers of the FPGA.
  */
@@ -229,6 +541,7 @@ void fpga_init(void)
     max77654_rail_1v2(true);
     max77654_rail_1v8(true);
     max77654_rail_2v7(true);
+    nrfx_init();
     spi_init();
     timer_init();
     fpga_check_pins("started dependencies");
@@ -253,5 +566,7 @@ void fpga_init(void)
     // Reset the CSN pin, changed as it is also MODE1.
     nrf_gpio_pin_write(SPI_FPGA_CS_PIN, true);
     nrfx_systick_delay_ms(100);
+
+    fpga_event_enable();
     fpga_check_pins("done");
 }
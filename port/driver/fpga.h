@@ -31,17 +31,39 @@
  * - the Microphone data,
  */
 
+// Events of the status register, signaled by pulling FPGA_INT_PIN low.
+#define FPGA_EVENT_CAPTURE_DONE     0x0001  // A capture is complete in the capture buffer
+#define FPGA_EVENT_AUDIO_READY      0x0002  // A block of microphone samples is available
+#define FPGA_EVENT_SWAP_DONE        0x0004  // The graphics buffers got swapped at a display refresh
+
+/**
+ * Called from the SPI interrupt with the events just read.
+ * @param events Those of the events subscribed to that occurred.
+ */
+typedef void fpga_event_handler_t(uint16_t events);
+
 void fpga_prepare(void);
 void fpga_init(void);
 void fpga_deinit(void);
 uint32_t fpga_system_id(void);
 uint32_t fpga_system_version(void);
+void fpga_batch_begin(void);
+void fpga_batch_flush(void);
+void fpga_write(uint16_t addr, uint8_t const *buf, size_t len);
+void fpga_subscribe(uint16_t mask, fpga_event_handler_t *handler);
+void fpga_event_clear(uint16_t mask);
+bool fpga_event_wait(uint16_t mask, uint32_t timeout_ms);
 void fpga_camera_zoom(uint8_t zoom_level);
 void fpga_camera_stop(void);
 void fpga_camera_start(void);
 void fpga_camera_capture(void);
+bool fpga_camera_capture_async(void (*callback)(void));
 void fpga_camera_off(void);
 void fpga_camera_on(void);
+void fpga_microphone_stop(void);
+void fpga_microphone_start(void);
+bool fpga_microphone_get_status_async(uint8_t buf[4], void (*callback)(void));
+bool fpga_microphone_get_data_async(uint8_t *buf, size_t len, void (*callback)(void));
 void fpga_live_video_start(void);
 void fpga_live_video_stop(void);
 void fpga_live_video_replay(void);
@@ -53,6 +75,8 @@ void fpga_graphics_set_write_base(uint32_t base);
 void fpga_graphics_write_data(uint8_t *buf, size_t len);
 uint16_t fpga_capture_get_status(void);
 void fpga_capture_get_data(uint8_t *buf, size_t len);
+bool fpga_capture_get_status_async(uint8_t buf[4], void (*callback)(void));
+bool fpga_capture_get_data_async(uint8_t *buf, size_t len, void (*callback)(void));
 
 // debug
 void fpga_check_pins(char const *msg);
@@ -0,0 +1,191 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Frame scheduler, driven by the shared 1 ms timer. The swaps are completed
+ * by the swap event of the FPGA, at the refresh of the display that applied
+ * them.
+ */
+
+#define LOG_MODULE DISPLAY
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "nrf.h"
+#include "nrfx_log.h"
+
+#include "driver/config.h"
+#include "driver/fpga.h"
+#include "driver/frame.h"
+#include "driver/spi.h"
+#include "driver/timer.h"
+
+#define ASSERT  NRFX_ASSERT
+
+static volatile bool frame_running;
+static uint16_t frame_period_ms;
+static uint64_t frame_deadline_ms;      // Next deadline
+static uint64_t frame_start_ms;         // Deadline of the frame being drawn
+static uint32_t frame_seq;
+static volatile bool frame_presented;   // A swap completed since the last deadline
+
+static volatile bool frame_swap_pending;
+static uint64_t frame_swap_ms;
+static uint64_t frame_swap_start_ms;    // Deadline of the frame being swapped
+
+static uint64_t frame_window_ms;        // Start of the second over which the frames are counted
+static uint16_t frame_window_count;
+static frame_stats_t frame_stats;
+
+__attribute__((weak))
+void frame_callback(uint32_t seq)
+{
+    LOG("seq=%d", seq);
+}
+
+/**
+ * Account for a swap now shown on the display.
+ */
+static void frame_swap_done(uint64_t now)
+{
+    frame_swap_pending = false;
+    frame_stats.frames++;
+    frame_stats.swap_latency_ms = now - frame_swap_ms;
+
+    if (frame_running)
+    {
+        frame_stats.frame_time_ms = now - frame_swap_start_ms;
+        if (frame_stats.frame_time_ms > frame_stats.frame_time_max_ms)
+            frame_stats.frame_time_max_ms = frame_stats.frame_time_ms;
+
+        // A late frame does not count for the one that followed its deadline.
+        if (frame_swap_start_ms == frame_start_ms)
+            frame_presented = true;
+    }
+
+    if (now - frame_window_ms >= 1000)
+    {
+        frame_stats.fps = frame_window_count;
+        frame_window_count = 0;
+        frame_window_ms = now;
+    }
+    frame_window_count++;
+}
+
+/**
+ * Called from the SPI interrupt once the FPGA applied the swap.
+ */
+static void frame_event_handler(uint16_t events)
+{
+    if (frame_swap_pending)
+        frame_swap_done(timer_get_uptime_ms());
+}
+
+static void frame_timer_handler(void)
+{
+    uint64_t now = timer_get_uptime_ms();
+
+    // Do not wait forever for an event that got lost.
+    if (frame_swap_pending && now - frame_swap_ms >= FRAME_SWAP_TIMEOUT_MS)
+    {
+        frame_stats.swap_timeouts++;
+        frame_swap_done(now);
+    }
+
+    if (!frame_running || now < frame_deadline_ms)
+        return;
+
+    // The previous frame did not make it in time, and maybe several did not.
+    if (!frame_presented)
+        frame_stats.missed++;
+    for (; frame_deadline_ms + frame_period_ms <= now; frame_deadline_ms += frame_period_ms)
+        frame_stats.missed++;
+
+    frame_start_ms = frame_deadline_ms;
+    frame_deadline_ms += frame_period_ms;
+    frame_presented = false;
+    frame_callback(frame_seq++);
+}
+
+/**
+ * Start asking for a frame every period.
+ * @param period_ms Time between two deadlines.
+ */
+void frame_start(uint16_t period_ms)
+{
+    ASSERT(period_ms > 0);
+
+    frame_running = false;
+    memset(&frame_stats, 0, sizeof frame_stats);
+    frame_period_ms = period_ms;
+    frame_deadline_ms = timer_get_uptime_ms() + 1;
+    frame_window_ms = frame_deadline_ms;
+    frame_window_count = 0;
+    frame_seq = 0;
+    frame_presented = true;
+    frame_running = true;
+}
+
+void frame_stop(void)
+{
+    frame_running = false;
+}
+
+/**
+ * Swap the graphics buffers, the swap being tracked in the background.
+ */
+void frame_swap(void)
+{
+    // Pending before the command, in case the event comes right after.
+    frame_swap_ms = timer_get_uptime_ms();
+    frame_swap_start_ms = frame_start_ms;
+    frame_swap_pending = true;
+    fpga_graphics_swap_buffer();
+}
+
+/**
+ * Wait for the last swap to be shown, before writing the back buffer again.
+ */
+void frame_wait(void)
+{
+    while (frame_swap_pending)
+        __WFE();
+}
+
+frame_stats_t frame_get_stats(void)
+{
+    return frame_stats;
+}
+
+void frame_init(void)
+{
+    DRIVER("FRAME");
+    fpga_init();
+    spi_init();
+    timer_init();
+
+    timer_add_handler(frame_timer_handler);
+    fpga_subscribe(FPGA_EVENT_SWAP_DONE, frame_event_handler);
+}
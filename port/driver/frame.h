@@ -0,0 +1,49 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Frame pacing of the display: a deadline every period, at which the
+ * application is asked to draw the next frame, and tracking of the buffer
+ * swaps of the FPGA, which take effect at the next refresh of the display.
+ */
+
+/** Longest a swap may stay pending before it is considered lost. */
+#define FRAME_SWAP_TIMEOUT_MS       100
+
+typedef struct
+{
+    uint32_t frames;            // Swaps completed
+    uint32_t missed;            // Deadlines reached without a frame presented since the previous one
+    uint32_t swap_timeouts;     // Swaps still pending after FRAME_SWAP_TIMEOUT_MS
+    uint16_t fps;               // Frames completed over the last second
+    uint16_t frame_time_ms;     // From the deadline to the swap of the last frame
+    uint16_t frame_time_max_ms;
+    uint16_t swap_latency_ms;   // From the swap command to the refresh showing it
+} frame_stats_t;
+
+void frame_init(void);
+void frame_start(uint16_t period_ms);
+void frame_stop(void);
+void frame_swap(void);
+void frame_wait(void);
+frame_stats_t frame_get_stats(void);
+void frame_callback(uint32_t seq);
@@ -0,0 +1,718 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Display list and tile rasterizer. Every tile is filled with transparent
+ * pixels, then every item overlapping it is drawn, clipped to the tile, from
+ * the lowest layer up, and in the order they were added within a layer.
+ */
+
+#define LOG_MODULE DISPLAY
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driver/font.h"
+#include "driver/graphics.h"
+
+#ifdef __arm__
+#include "nrfx_log.h"
+#define ASSERT  NRFX_ASSERT
+#else
+#include <assert.h>
+#define ASSERT  assert
+#endif
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
+
+/** Font of 5x7 pixels for the ASCII characters from ' ' to '~', one byte per row, bit 4 on the left. */
+static const uint8_t graphics_font[95][7] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // space
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x00, 0x04 }, // !
+    { 0x0A, 0x0A, 0x0A, 0x00, 0x00, 0x00, 0x00 }, // "
+    { 0x0A, 0x0A, 0x1F, 0x0A, 0x1F, 0x0A, 0x0A }, // #
+    { 0x04, 0x0F, 0x14, 0x0E, 0x05, 0x1E, 0x04 }, // $
+    { 0x18, 0x19, 0x02, 0x04, 0x08, 0x13, 0x03 }, // %
+    { 0x0C, 0x12, 0x14, 0x08, 0x15, 0x12, 0x0D }, // &
+    { 0x04, 0x04, 0x08, 0x00, 0x00, 0x00, 0x00 }, // quote
+    { 0x02, 0x04, 0x08, 0x08, 0x08, 0x04, 0x02 }, // (
+    { 0x08, 0x04, 0x02, 0x02, 0x02, 0x04, 0x08 }, // )
+    { 0x00, 0x04, 0x15, 0x0E, 0x15, 0x04, 0x00 }, // *
+    { 0x00, 0x04, 0x04, 0x1F, 0x04, 0x04, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x0C, 0x04, 0x08 }, // ,
+    { 0x00, 0x00, 0x00, 0x1F, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C }, // .
+    { 0x00, 0x01, 0x02, 0x04, 0x08, 0x10, 0x00 }, // /
+    { 0x0E, 0x11, 0x13, 0x15, 0x19, 0x11, 0x0E }, // 0
+    { 0x04, 0x0C, 0x04, 0x04, 0x04, 0x04, 0x0E }, // 1
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x08, 0x1F }, // 2
+    { 0x1F, 0x02, 0x04, 0x02, 0x01, 0x11, 0x0E }, // 3
+    { 0x02, 0x06, 0x0A, 0x12, 0x1F, 0x02, 0x02 }, // 4
+    { 0x1F, 0x10, 0x1E, 0x01, 0x01, 0x11, 0x0E }, // 5
+    { 0x06, 0x08, 0x10, 0x1E, 0x11, 0x11, 0x0E }, // 6
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x08, 0x08 }, // 7
+    { 0x0E, 0x11, 0x11, 0x0E, 0x11, 0x11, 0x0E }, // 8
+    { 0x0E, 0x11, 0x11, 0x0F, 0x01, 0x02, 0x0C }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x0C, 0x04, 0x08 }, // ;
+    { 0x02, 0x04, 0x08, 0x10, 0x08, 0x04, 0x02 }, // <
+    { 0x00, 0x00, 0x1F, 0x00, 0x1F, 0x00, 0x00 }, // =
+    { 0x08, 0x04, 0x02, 0x01, 0x02, 0x04, 0x08 }, // >
+    { 0x0E, 0x11, 0x01, 0x02, 0x04, 0x00, 0x04 }, // ?
+    { 0x0E, 0x11, 0x01, 0x0D, 0x15, 0x15, 0x0E }, // @
+    { 0x0E, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // A
+    { 0x1E, 0x11, 0x11, 0x1E, 0x11, 0x11, 0x1E }, // B
+    { 0x0E, 0x11, 0x10, 0x10, 0x10, 0x11, 0x0E }, // C
+    { 0x1C, 0x12, 0x11, 0x11, 0x11, 0x12, 0x1C }, // D
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x1F }, // E
+    { 0x1F, 0x10, 0x10, 0x1E, 0x10, 0x10, 0x10 }, // F
+    { 0x0E, 0x11, 0x10, 0x17, 0x11, 0x11, 0x0F }, // G
+    { 0x11, 0x11, 0x11, 0x1F, 0x11, 0x11, 0x11 }, // H
+    { 0x0E, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // I
+    { 0x07, 0x02, 0x02, 0x02, 0x02, 0x12, 0x0C }, // J
+    { 0x11, 0x12, 0x14, 0x18, 0x14, 0x12, 0x11 }, // K
+    { 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x1F }, // L
+    { 0x11, 0x1B, 0x15, 0x15, 0x11, 0x11, 0x11 }, // M
+    { 0x11, 0x11, 0x19, 0x15, 0x13, 0x11, 0x11 }, // N
+    { 0x0E, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // O
+    { 0x1E, 0x11, 0x11, 0x1E, 0x10, 0x10, 0x10 }, // P
+    { 0x0E, 0x11, 0x11, 0x11, 0x15, 0x12, 0x0D }, // Q
+    { 0x1E, 0x11, 0x11, 0x1E, 0x14, 0x12, 0x11 }, // R
+    { 0x0F, 0x10, 0x10, 0x0E, 0x01, 0x01, 0x1E }, // S
+    { 0x1F, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // T
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x0E }, // U
+    { 0x11, 0x11, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // V
+    { 0x11, 0x11, 0x11, 0x15, 0x15, 0x15, 0x0A }, // W
+    { 0x11, 0x11, 0x0A, 0x04, 0x0A, 0x11, 0x11 }, // X
+    { 0x11, 0x11, 0x11, 0x0A, 0x04, 0x04, 0x04 }, // Y
+    { 0x1F, 0x01, 0x02, 0x04, 0x08, 0x10, 0x1F }, // Z
+    { 0x0E, 0x08, 0x08, 0x08, 0x08, 0x08, 0x0E }, // [
+    { 0x00, 0x10, 0x08, 0x04, 0x02, 0x01, 0x00 }, // backslash
+    { 0x0E, 0x02, 0x02, 0x02, 0x02, 0x02, 0x0E }, // ]
+    { 0x04, 0x0A, 0x11, 0x00, 0x00, 0x00, 0x00 }, // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F }, // _
+    { 0x08, 0x04, 0x02, 0x00, 0x00, 0x00, 0x00 }, // `
+    { 0x00, 0x00, 0x0E, 0x01, 0x0F, 0x11, 0x0F }, // a
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x1E }, // b
+    { 0x00, 0x00, 0x0E, 0x10, 0x10, 0x11, 0x0E }, // c
+    { 0x01, 0x01, 0x0D, 0x13, 0x11, 0x11, 0x0F }, // d
+    { 0x00, 0x00, 0x0E, 0x11, 0x1F, 0x10, 0x0E }, // e
+    { 0x06, 0x09, 0x08, 0x1C, 0x08, 0x08, 0x08 }, // f
+    { 0x00, 0x0F, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // g
+    { 0x10, 0x10, 0x16, 0x19, 0x11, 0x11, 0x11 }, // h
+    { 0x04, 0x00, 0x0C, 0x04, 0x04, 0x04, 0x0E }, // i
+    { 0x02, 0x00, 0x06, 0x02, 0x02, 0x12, 0x0C }, // j
+    { 0x10, 0x10, 0x12, 0x14, 0x18, 0x14, 0x12 }, // k
+    { 0x0C, 0x04, 0x04, 0x04, 0x04, 0x04, 0x0E }, // l
+    { 0x00, 0x00, 0x1A, 0x15, 0x15, 0x11, 0x11 }, // m
+    { 0x00, 0x00, 0x16, 0x19, 0x11, 0x11, 0x11 }, // n
+    { 0x00, 0x00, 0x0E, 0x11, 0x11, 0x11, 0x0E }, // o
+    { 0x00, 0x00, 0x1E, 0x11, 0x1E, 0x10, 0x10 }, // p
+    { 0x00, 0x00, 0x0D, 0x13, 0x0F, 0x01, 0x01 }, // q
+    { 0x00, 0x00, 0x16, 0x19, 0x10, 0x10, 0x10 }, // r
+    { 0x00, 0x00, 0x0E, 0x10, 0x0E, 0x01, 0x1E }, // s
+    { 0x08, 0x08, 0x1C, 0x08, 0x08, 0x09, 0x06 }, // t
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x13, 0x0D }, // u
+    { 0x00, 0x00, 0x11, 0x11, 0x11, 0x0A, 0x04 }, // v
+    { 0x00, 0x00, 0x11, 0x11, 0x15, 0x15, 0x0A }, // w
+    { 0x00, 0x00, 0x11, 0x0A, 0x04, 0x0A, 0x11 }, // x
+    { 0x00, 0x00, 0x11, 0x11, 0x0F, 0x01, 0x0E }, // y
+    { 0x00, 0x00, 0x1F, 0x02, 0x04, 0x08, 0x1F }, // z
+    { 0x02, 0x04, 0x04, 0x08, 0x04, 0x04, 0x02 }, // {
+    { 0x04, 0x04, 0x04, 0x04, 0x04, 0x04, 0x04 }, // |
+    { 0x08, 0x04, 0x04, 0x02, 0x04, 0x04, 0x08 }, // }
+    { 0x00, 0x00, 0x08, 0x15, 0x02, 0x00, 0x00 }, // ~
+};
+
+static graphics_item_t graphics_items[GRAPHICS_MAX_ITEMS];
+static size_t graphics_items_len;
+
+/** Strings and bitmaps of the items, copied so that the caller can free them. */
+static uint8_t graphics_data[GRAPHICS_DATA_SIZE] __attribute__((aligned(4)));
+static size_t graphics_data_len;
+
+/** Order in which to draw the items, by layer. */
+static uint8_t graphics_order[GRAPHICS_MAX_ITEMS];
+
+/**
+ * Hash of the content of every tile of the two graphics buffers of the FPGA,
+ * the one being written becoming visible on every swap.
+ */
+static uint32_t graphics_hashes[2][GRAPHICS_TILES_Y][GRAPHICS_TILES_X];
+static bool graphics_hashes_valid[2];
+
+/** Rows of every tile of the two buffers known to hold only transparent pixels, one bit each. */
+static uint16_t graphics_clear_rows[2][GRAPHICS_TILES_Y][GRAPHICS_TILES_X];
+static uint8_t graphics_back;
+
+/** Tile being rasterized, and its position on the screen. */
+static uint8_t graphics_tile[GRAPHICS_TILE_HEIGHT][GRAPHICS_TILE_WIDTH];
+static int16_t graphics_tile_x;
+static int16_t graphics_tile_y;
+
+/**
+ * Empty the display list.
+ */
+void graphics_clear(void)
+{
+    graphics_items_len = 0;
+    graphics_data_len = 0;
+}
+
+/**
+ * FNV-1a hash of the tile, to tell if it changed since the last time that
+ * buffer was written.
+ */
+static uint32_t graphics_hash_tile(void)
+{
+    uint32_t hash = 2166136261;
+
+    for (size_t y = 0; y < GRAPHICS_TILE_HEIGHT; y++)
+    {
+        for (size_t x = 0; x < GRAPHICS_TILE_WIDTH; x++)
+        {
+            hash ^= graphics_tile[y][x];
+            hash *= 16777619;
+        }
+    }
+    return hash;
+}
+
+/**
+ * Forget what the graphics buffers hold, so that the next two frames get
+ * written entirely, such as after the FPGA got reset or cleared.
+ */
+void graphics_invalidate(void)
+{
+    graphics_hashes_valid[0] = false;
+    graphics_hashes_valid[1] = false;
+}
+
+/**
+ * Record that both graphics buffers were cleared, so that only the opaque
+ * pixels of the next frames get written.
+ */
+void graphics_cleared(void)
+{
+    uint32_t hash;
+
+    memset(graphics_tile, GRAPHICS_TRANSPARENT, sizeof graphics_tile);
+    hash = graphics_hash_tile();
+
+    for (size_t i = 0; i < 2; i++)
+    {
+        for (size_t ty = 0; ty < GRAPHICS_TILES_Y; ty++)
+        {
+            for (size_t tx = 0; tx < GRAPHICS_TILES_X; tx++)
+            {
+                graphics_hashes[i][ty][tx] = hash;
+                graphics_clear_rows[i][ty][tx] = 0xFFFF;
+            }
+        }
+        graphics_hashes_valid[i] = true;
+    }
+}
+
+/**
+ * Append an item to the display list.
+ * @param data_len Room to reserve for its string or bitmap.
+ * @return The item to fill, or NULL if the list is full.
+ */
+static graphics_item_t *graphics_add(graphics_type_t type, uint8_t color, uint8_t layer,
+        size_t data_len, uint8_t **data)
+{
+    graphics_item_t *item;
+
+    if (graphics_items_len == GRAPHICS_MAX_ITEMS || ((data_len + 3) & ~3) > GRAPHICS_DATA_SIZE - graphics_data_len)
+        return NULL;
+
+    item = &graphics_items[graphics_items_len++];
+    item->type = type;
+    item->color = color;
+    item->layer = layer;
+    if (data != NULL)
+        *data = graphics_data + graphics_data_len;
+    graphics_data_len += (data_len + 3) & ~3;
+    return item;
+}
+
+/**
+ * Add a filled rectangle.
+ * @return False if the display list is full.
+ */
+bool graphics_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color, uint8_t layer)
+{
+    graphics_item_t *item = graphics_add(GRAPHICS_RECT, color, layer, 0, NULL);
+
+    if (item == NULL)
+        return false;
+    item->x = x;
+    item->y = y;
+    item->width = width;
+    item->height = height;
+    return true;
+}
+
+/**
+ * Add a line one pixel wide, both ends included.
+ * @return False if the display list is full.
+ */
+bool graphics_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color, uint8_t layer)
+{
+    graphics_item_t *item = graphics_add(GRAPHICS_LINE, color, layer, 0, NULL);
+
+    if (item == NULL)
+        return false;
+    item->x = MIN(x0, x1);
+    item->y = MIN(y0, y1);
+    item->width = MAX(x0, x1) - item->x + 1;
+    item->height = MAX(y0, y1) - item->y + 1;
+    item->line.x0 = x0;
+    item->line.y0 = y0;
+    item->line.x1 = x1;
+    item->line.y1 = y1;
+    return true;
+}
+
+/**
+ * Decode the next character of an UTF-8 string, those out of the basic
+ * multilingual plane or invalid being replaced by '?'.
+ * @param i Position in the string, moved past the character.
+ */
+static uint16_t graphics_utf8_next(char const *str, size_t len, size_t *i)
+{
+    uint8_t c = str[(*i)++];
+    uint32_t code;
+    size_t n;
+
+    if (c < 0x80)
+        return c;
+    else if ((c & 0xE0) == 0xC0)
+        code = c & 0x1F, n = 1;
+    else if ((c & 0xF0) == 0xE0)
+        code = c & 0x0F, n = 2;
+    else
+        return '?';
+
+    for (; n > 0; n--)
+    {
+        if (*i == len || (str[*i] & 0xC0) != 0x80)
+            return '?';
+        code = code << 6 | (str[(*i)++] & 0x3F);
+    }
+    return code;
+}
+
+/**
+ * Add a line of text with a font of the flash, the characters missing from
+ * the font being drawn as '?', or not at all if it has none either.
+ */
+static bool graphics_text_glyphs(int16_t x, int16_t y, char const *str, size_t len, uint8_t color,
+        uint8_t font, uint8_t layer)
+{
+    uint16_t codes[GRAPHICS_TEXT_MAX_LEN];
+    uint8_t advances[GRAPHICS_TEXT_MAX_LEN];
+    uint8_t *data;
+    uint8_t line_height = font_line_height(font);
+    graphics_item_t *item;
+    size_t n = 0, width = 0;
+
+    if (line_height == 0)
+        return false;
+
+    for (size_t i = 0; i < len && n < GRAPHICS_TEXT_MAX_LEN; n++)
+    {
+        font_glyph_t const *glyph;
+
+        codes[n] = graphics_utf8_next(str, len, &i);
+        glyph = font_glyph(font, codes[n]);
+        if (glyph == NULL)
+        {
+            codes[n] = '?';
+            glyph = font_glyph(font, codes[n]);
+        }
+        advances[n] = glyph == NULL ? 0 : glyph->advance;
+        width += advances[n];
+    }
+
+    item = graphics_add(GRAPHICS_GLYPHS, color, layer, n * sizeof *codes + n, &data);
+    if (item == NULL)
+        return false;
+    memcpy(data, codes, n * sizeof *codes);
+    memcpy(data + n * sizeof *codes, advances, n);
+    item->x = x;
+    item->y = y;
+    item->width = MIN(width, INT16_MAX);
+    item->height = line_height;
+    item->glyphs.codes = (uint16_t const *)data;
+    item->glyphs.advances = data + n * sizeof *codes;
+    item->glyphs.len = n;
+    item->glyphs.font = font;
+    return true;
+}
+
+/**
+ * Add a line of text, with the built-in font, whose characters out of the
+ * printable ASCII range are drawn as '?', or with a font of the flash.
+ * @param x Left of the text.
+ * @param y Top of the text.
+ * @param str UTF-8 string.
+ * @param font 0 for the built-in font, or the slot of a font of the flash plus 1.
+ * @return False if the display list is full, or if there is no such font.
+ */
+bool graphics_text(int16_t x, int16_t y, char const *str, size_t len, uint8_t color,
+        uint8_t font, uint8_t layer)
+{
+    uint8_t *data;
+    graphics_item_t *item;
+
+    if (font > 0)
+        return graphics_text_glyphs(x, y, str, len, color, font - 1, layer);
+
+    len = MIN(len, GRAPHICS_TEXT_MAX_LEN);
+    item = graphics_add(GRAPHICS_TEXT, color, layer, len, &data);
+    if (item == NULL)
+        return false;
+    memcpy(data, str, len);
+    item->x = x;
+    item->y = y;
+    item->width = len * GRAPHICS_FONT_WIDTH;
+    item->height = GRAPHICS_FONT_HEIGHT;
+    item->text.str = (char const *)data;
+    item->text.len = len;
+    return true;
+}
+
+/**
+ * Add a bitmap, whose transparent pixels are not drawn.
+ * @param data One byte per pixel, row after row.
+ * @return False if the display list is full.
+ */
+bool graphics_bitmap(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t const *data, uint8_t layer)
+{
+    uint8_t *copy;
+    graphics_item_t *item;
+
+    ASSERT(width > 0 && height > 0);
+
+    item = graphics_add(GRAPHICS_BITMAP, 0, layer, width * height, &copy);
+    if (item == NULL)
+        return false;
+    memcpy(copy, data, width * height);
+    item->x = x;
+    item->y = y;
+    item->width = width;
+    item->height = height;
+    item->bitmap.data = copy;
+    return true;
+}
+
+static inline void graphics_plot(int16_t x, int16_t y, uint8_t color)
+{
+    x -= graphics_tile_x;
+    y -= graphics_tile_y;
+    if (x >= 0 && x < GRAPHICS_TILE_WIDTH && y >= 0 && y < GRAPHICS_TILE_HEIGHT)
+        graphics_tile[y][x] = color;
+}
+
+/**
+ * Bresenham's algorithm, only plotting the pixels within the tile.
+ */
+static void graphics_draw_line(graphics_item_t const *item)
+{
+    int16_t x = item->line.x0, y = item->line.y0;
+    int16_t dx = item->line.x1 > x ? item->line.x1 - x : x - item->line.x1;
+    int16_t dy = item->line.y1 > y ? y - item->line.y1 : item->line.y1 - y;
+    int16_t sx = item->line.x1 > x ? 1 : -1;
+    int16_t sy = item->line.y1 > y ? 1 : -1;
+    int32_t err = dx + dy;
+
+    for (;;)
+    {
+        int32_t e2 = 2 * err;
+
+        graphics_plot(x, y, item->color);
+        if (x == item->line.x1 && y == item->line.y1)
+            break;
+        if (e2 >= dy)
+        {
+            err += dy;
+            x += sx;
+        }
+        if (e2 <= dx)
+        {
+            err += dx;
+            y += sy;
+        }
+    }
+}
+
+static void graphics_draw_text(graphics_item_t const *item)
+{
+    // Only the characters overlapping the tile
+    int16_t first = MAX(0, (graphics_tile_x - item->x) / GRAPHICS_FONT_WIDTH);
+    int16_t last = MIN(item->text.len, (graphics_tile_x + GRAPHICS_TILE_WIDTH - item->x) / GRAPHICS_FONT_WIDTH + 1);
+
+    for (int16_t i = first; i < last; i++)
+    {
+        uint8_t c = item->text.str[i];
+        uint8_t const *glyph = graphics_font[(c >= ' ' && c <= '~' ? c : '?') - ' '];
+
+        for (int16_t row = 0; row < 7; row++)
+            for (int16_t col = 0; col < 5; col++)
+                if (glyph[row] & (0x10 >> col))
+                    graphics_plot(item->x + i * GRAPHICS_FONT_WIDTH + col, item->y + row, item->color);
+    }
+}
+
+/**
+ * Blend the glyphs of the characters overlapping the tile with what is
+ * beneath, according to their coverage.
+ */
+static void graphics_draw_glyphs(graphics_item_t const *item)
+{
+    int16_t pen = item->x;
+
+    for (size_t i = 0; i < item->glyphs.len; pen += item->glyphs.advances[i++])
+    {
+        font_glyph_t const *glyph;
+
+        // Only the characters overlapping the tile, with some margin for the overhangs
+        if (pen + item->glyphs.advances[i] + GRAPHICS_GLYPH_MARGIN <= graphics_tile_x)
+            continue;
+        if (pen - GRAPHICS_GLYPH_MARGIN >= graphics_tile_x + GRAPHICS_TILE_WIDTH)
+            break;
+
+        glyph = font_glyph(item->glyphs.font, item->glyphs.codes[i]);
+        if (glyph == NULL)
+            continue;
+
+        for (int16_t row = 0; row < glyph->height; row++)
+        {
+            int16_t y = item->y + glyph->top + row - graphics_tile_y;
+            uint8_t const *src = glyph->bitmap + row * FONT_ROW_SIZE(glyph->width);
+
+            if (y < 0 || y >= GRAPHICS_TILE_HEIGHT)
+                continue;
+
+            for (int16_t col = 0; col < glyph->width; col++)
+            {
+                int16_t x = pen + glyph->left + col - graphics_tile_x;
+                uint8_t alpha = (src[col / 2] >> (col % 2 ? 0 : 4)) & 0x0F;
+                uint8_t *dst;
+
+                if (x < 0 || x >= GRAPHICS_TILE_WIDTH || alpha == 0)
+                    continue;
+                dst = &graphics_tile[y][x];
+                *dst += ((int16_t)item->color - *dst) * alpha / 15;
+            }
+        }
+    }
+}
+
+/**
+ * Draw the part of an item overlapping the tile.
+ * @param x0 Left of the overlap, in tile coordinates.
+ * @param y0 Top of the overlap.
+ * @param x1 Right of the overlap, excluded.
+ * @param y1 Bottom of the overlap, excluded.
+ */
+static void graphics_draw(graphics_item_t const *item, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+    switch (item->type)
+    {
+    case GRAPHICS_RECT:
+    {
+        for (int16_t y = y0; y < y1; y++)
+            memset(&graphics_tile[y][x0], item->color, x1 - x0);
+        break;
+    }
+    case GRAPHICS_LINE:
+    {
+        graphics_draw_line(item);
+        break;
+    }
+    case GRAPHICS_TEXT:
+    {
+        graphics_draw_text(item);
+        break;
+    }
+    case GRAPHICS_GLYPHS:
+    {
+        graphics_draw_glyphs(item);
+        break;
+    }
+    case GRAPHICS_BITMAP:
+    {
+        for (int16_t y = y0; y < y1; y++)
+        {
+            uint8_t const *src = item->bitmap.data +
+                    (graphics_tile_y + y - item->y) * item->width + graphics_tile_x - item->x;
+
+            for (int16_t x = x0; x < x1; x++)
+                if (src[x] != GRAPHICS_TRANSPARENT)
+                    graphics_tile[y][x] = src[x];
+        }
+        break;
+    }
+    }
+}
+
+/**
+ * Sort the items by layer, keeping the order in which they were added
+ * within a layer.
+ */
+static void graphics_sort(void)
+{
+    for (size_t i = 0; i < graphics_items_len; i++)
+    {
+        size_t j = i;
+
+        for (; j > 0 && graphics_items[graphics_order[j - 1]].layer > graphics_items[i].layer; j--)
+            graphics_order[j] = graphics_order[j - 1];
+        graphics_order[j] = i;
+    }
+}
+
+/**
+ * Rasterize a tile out of the display list.
+ * @param tx Column of the tile.
+ * @param ty Row of the tile.
+ */
+static void graphics_render_tile(size_t tx, size_t ty)
+{
+    graphics_tile_x = tx * GRAPHICS_TILE_WIDTH;
+    graphics_tile_y = ty * GRAPHICS_TILE_HEIGHT;
+    memset(graphics_tile, GRAPHICS_TRANSPARENT, sizeof graphics_tile);
+
+    for (size_t i = 0; i < graphics_items_len; i++)
+    {
+        graphics_item_t const *item = &graphics_items[graphics_order[i]];
+        int16_t x0 = MAX(item->x, graphics_tile_x) - graphics_tile_x;
+        int16_t y0 = MAX(item->y, graphics_tile_y) - graphics_tile_y;
+        int16_t x1 = MIN(item->x + item->width, graphics_tile_x + GRAPHICS_TILE_WIDTH) - graphics_tile_x;
+        int16_t y1 = MIN(item->y + item->height, graphics_tile_y + GRAPHICS_TILE_HEIGHT) - graphics_tile_y;
+
+        if (x0 < x1 && y0 < y1)
+            graphics_draw(item, x0, y0, x1, y1);
+    }
+}
+
+/**
+ * Write a row of the tile as spans of opaque pixels, skipping the runs of
+ * transparent pixels, which the buffer already holds. Runs shorter than
+ * GRAPHICS_SPAN_GAP are written along, as it costs less than a new span.
+ * @param y Row of the tile.
+ * @return False if the row holds only transparent pixels.
+ */
+static bool graphics_write_spans(graphics_write_t *write, size_t y)
+{
+    uint8_t *row = graphics_tile[y];
+    uint32_t base = (graphics_tile_y + y) * GRAPHICS_WIDTH + graphics_tile_x;
+    size_t x = 0, start, end;
+    bool opaque = false;
+
+    for (;;)
+    {
+        while (x < GRAPHICS_TILE_WIDTH && row[x] == GRAPHICS_TRANSPARENT)
+            x++;
+        if (x == GRAPHICS_TILE_WIDTH)
+            return opaque;
+
+        start = end = x;
+        for (; x < GRAPHICS_TILE_WIDTH && x - end < GRAPHICS_SPAN_GAP; x++)
+            if (row[x] != GRAPHICS_TRANSPARENT)
+                end = x + 1;
+        write(base + start, row + start, end - start);
+        opaque = true;
+        x = end;
+    }
+}
+
+/**
+ * Write a row of the tile entirely, over whatever the buffer holds.
+ * @param y Row of the tile.
+ * @return False if the row holds only transparent pixels.
+ */
+static bool graphics_write_row(graphics_write_t *write, size_t y)
+{
+    write((graphics_tile_y + y) * GRAPHICS_WIDTH + graphics_tile_x,
+            graphics_tile[y], GRAPHICS_TILE_WIDTH);
+
+    for (size_t x = 0; x < GRAPHICS_TILE_WIDTH; x++)
+        if (graphics_tile[y][x] != GRAPHICS_TRANSPARENT)
+            return true;
+    return false;
+}
+
+/**
+ * Rasterize the whole display list, and write out the tiles that differ from
+ * the content of the back buffer. The rows that were transparent in the back
+ * buffer are written as spans of opaque pixels, the others entirely to erase
+ * what they held. The buffers must then be swapped.
+ * @param write Destination of the pixels.
+ * @return The number of tiles written.
+ */
+size_t graphics_render(graphics_write_t *write)
+{
+    uint32_t (*hashes)[GRAPHICS_TILES_X] = graphics_hashes[graphics_back];
+    uint16_t (*clear_rows)[GRAPHICS_TILES_X] = graphics_clear_rows[graphics_back];
+    bool valid = graphics_hashes_valid[graphics_back];
+    size_t written = 0;
+
+    graphics_sort();
+
+    for (size_t ty = 0; ty < GRAPHICS_TILES_Y; ty++)
+    {
+        for (size_t tx = 0; tx < GRAPHICS_TILES_X; tx++)
+        {
+            uint32_t hash;
+            uint16_t clear = 0;
+
+            graphics_render_tile(tx, ty);
+            hash = graphics_hash_tile();
+            if (valid && hash == hashes[ty][tx])
+                continue;
+
+            for (size_t y = 0; y < GRAPHICS_TILE_HEIGHT; y++)
+            {
+                bool opaque;
+
+                if (valid && clear_rows[ty][tx] & (1 << y))
+                    opaque = graphics_write_spans(write, y);
+                else
+                    opaque = graphics_write_row(write, y);
+                if (!opaque)
+                    clear |= 1 << y;
+            }
+            hashes[ty][tx] = hash;
+            clear_rows[ty][tx] = clear;
+            written++;
+        }
+    }
+
+    graphics_hashes_valid[graphics_back] = true;
+    graphics_back ^= 1;
+    return written;
+}
@@ -0,0 +1,119 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Retained-mode 2D graphics: the content of the screen is described by a
+ * list of items, rasterized one tile at a time, as there is no room for a
+ * whole frame in RAM. Every row of a tile is then written to the graphics
+ * buffer of the FPGA, one byte per pixel, at the address y * width + x.
+ * Only the tiles that differ from what the buffer already holds are written,
+ * so that the update time depends on how much changed, not on the screen size,
+ * and only their opaque pixels where the buffer is known to be transparent.
+ * It does not depend on the hardware, and also builds on the host.
+ */
+
+#define GRAPHICS_WIDTH              640
+#define GRAPHICS_HEIGHT             400
+
+#define GRAPHICS_TILE_WIDTH         64
+#define GRAPHICS_TILE_HEIGHT        16
+#define GRAPHICS_TILES_X            (GRAPHICS_WIDTH / GRAPHICS_TILE_WIDTH)
+#define GRAPHICS_TILES_Y            (GRAPHICS_HEIGHT / GRAPHICS_TILE_HEIGHT)
+
+/** Items in the display list. */
+#define GRAPHICS_MAX_ITEMS          64
+
+/** Room for the strings and bitmaps of the items. */
+#define GRAPHICS_DATA_SIZE          4096
+
+/** Transparent pixels between two spans below which the spans are merged, about the cost of a new span. */
+#define GRAPHICS_SPAN_GAP           8
+
+/** Color of the pixels not covered by any item, letting the camera view through. */
+#define GRAPHICS_TRANSPARENT        0x00
+
+/** Cell of a character of the built-in font, including the spacing. */
+#define GRAPHICS_FONT_WIDTH         6
+#define GRAPHICS_FONT_HEIGHT        8
+
+/** Characters of a text item, enough to span the screen with the built-in font. */
+#define GRAPHICS_TEXT_MAX_LEN       (GRAPHICS_WIDTH / GRAPHICS_FONT_WIDTH + 1)
+
+/** How far a glyph of a font of the flash may extend past its advance. */
+#define GRAPHICS_GLYPH_MARGIN       8
+
+typedef enum
+{
+    GRAPHICS_RECT,
+    GRAPHICS_LINE,
+    GRAPHICS_TEXT,
+    GRAPHICS_BITMAP,
+    GRAPHICS_GLYPHS,
+} graphics_type_t;
+
+typedef struct
+{
+    uint8_t type;               // One of graphics_type_t
+    uint8_t layer;              // Items of higher layers are drawn over the others
+    uint8_t color;              // Color of the rectangle, line or text
+    int16_t x, y;               // Bounding box of the item, possibly out of the screen
+    int16_t width, height;
+    union
+    {
+        struct
+        {
+            int16_t x0, y0, x1, y1;
+        } line;
+        struct
+        {
+            char const *str;
+            uint16_t len;
+        } text;
+        struct
+        {
+            uint8_t const *data;    // One byte per pixel, GRAPHICS_TRANSPARENT ones not drawn
+        } bitmap;
+        struct
+        {
+            uint16_t const *codes;  // Characters of the text
+            uint8_t const *advances;// Width of every character, to find those in a tile
+            uint16_t len;
+            uint8_t font;           // Slot of the font in the flash
+        } glyphs;
+    };
+} graphics_item_t;
+
+/**
+ * Destination of the rendered pixels, such as the graphics buffer of the FPGA.
+ * @param base Address of the first pixel, y * GRAPHICS_WIDTH + x.
+ * @param buf Pixels to write, one byte each.
+ * @param len Number of pixels.
+ */
+typedef void graphics_write_t(uint32_t base, uint8_t *buf, size_t len);
+
+void graphics_clear(void);
+void graphics_invalidate(void);
+void graphics_cleared(void);
+bool graphics_rect(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t color, uint8_t layer);
+bool graphics_line(int16_t x0, int16_t y0, int16_t x1, int16_t y1, uint8_t color, uint8_t layer);
+bool graphics_text(int16_t x, int16_t y, char const *str, size_t len, uint8_t color, uint8_t font, uint8_t layer);
+bool graphics_bitmap(int16_t x, int16_t y, int16_t width, int16_t height, uint8_t const *data, uint8_t layer);
+size_t graphics_render(graphics_write_t *write);
@@ -27,6 +27,8 @@
  * Wrapper library over Nordic NRFX I2C drivers.
  */
 
+#define LOG_MODULE I2C
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -68,7 +70,7 @@ static inline bool i2c_filter_error(char const *func, nrfx_err_t err)
     }
     default:
     {
-        LOG("%s, %s", func, NRFX_LOG_ERROR_STRING_GET(err));
+        LOG_ERROR("%s, %s", func, NRFX_LOG_ERROR_STRING_GET(err));
         return false;
     }
     }
@@ -28,6 +28,8 @@
  * IQS620 touch controller driver.
  */
 
+#define LOG_MODULE TOUCH
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -181,7 +183,7 @@ static uint8_t iqs620_button_1_state;
 static inline void check(char const *func, nrfx_err_t err)
 {
     if (err != NRFX_SUCCESS)
-        LOG("%s: %s", func, NRFX_LOG_ERROR_STRING_GET(err));
+        LOG_ERROR("%s: %s", func, NRFX_LOG_ERROR_STRING_GET(err));
 }
 
 /**
@@ -303,7 +305,7 @@ typedef enum
 __attribute__((weak))
 void iqs620_callback_button_pressed(uint8_t button)
 {
-    LOG("button=0x%02X", button);
+    LOG_DEBUG("button=0x%02X", button);
 }
 
 /**
@@ -313,7 +315,7 @@ void iqs620_callback_button_pressed(uint8_t button)
 __attribute__((weak))
 void iqs620_callback_button_released(uint8_t button)
 {
-    LOG("button=0x%02X", button);
+    LOG_DEBUG("button=0x%02X", button);
 }
 
 /**
@@ -367,13 +369,13 @@ static void iqs620_touch_rdy_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_
 
     uint8_t events;
     iqs620_read_reg(IQS620_GLOBAL_EVENTS, &events, 1);
-    LOG("events=0x%02x", events);
+    LOG_DEBUG("events=0x%02x", events);
 
     if (events & IQS620_GLOBAL_EVENTS_PROX)
     {
         uint8_t proxflags;
         iqs620_read_reg(IQS620_PROX_FUSION_FLAGS, &proxflags, 1);
-        LOG("proxflags=0x%02x", proxflags);
+        LOG_DEBUG("proxflags=0x%02x", proxflags);
         iqs620_process_state(0, &iqs620_button_0_state, STATE(proxflags, 0));
         iqs620_process_state(1, &iqs620_button_1_state, STATE(proxflags, 1));
     }
@@ -381,7 +383,7 @@ static void iqs620_touch_rdy_handler(nrfx_gpiote_pin_t pin, nrf_gpiote_polarity_
     {
         uint8_t sysflags;
         iqs620_read_reg(IQS620_SYS_FLAGS, &sysflags, 1);
-        LOG("sysflags=0x%02x", sysflags);
+        LOG_DEBUG("sysflags=0x%02x", sysflags);
         if (sysflags & IQS620_SYS_FLAGS_RESET_HAPPENED)
         {
             LOG("reset detected, reconfiguring");
@@ -416,7 +418,7 @@ uint16_t iqs620_get_count(uint8_t channel)
     iqs620_read_reg(channel * 2 + IQS620_CHANNEL_COUNT_0_LO, data, sizeof(data));
 
     count = data[1] << 8 | data[0] << 0;
-    LOG("channel=%d count=%d", channel, count);
+    LOG_DEBUG("channel=%d count=%d", channel, count);
     return (count);
 }
 
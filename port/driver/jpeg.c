@@ -0,0 +1,790 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * JPEG encoder, with the AAN fast DCT in 8.8 fixed point as in the IJG
+ * jfdctfst.c, using the SIMD instructions of the Cortex-M4 for its
+ * butterflies and rotations. Portable versions of these instructions are
+ * provided for building on the host.
+ */
+
+#define LOG_MODULE CAMERA
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driver/jpeg.h"
+
+#ifdef __arm__
+#include "nrf.h"
+#include "nrfx_log.h"
+#define ASSERT  NRFX_ASSERT
+#else
+#include <assert.h>
+#define ASSERT  assert
+#endif
+
+#ifndef __ARM_FEATURE_DSP
+
+static inline uint32_t __QADD16(uint32_t a, uint32_t b)
+{
+    int32_t lo = (int16_t)a + (int16_t)b;
+    int32_t hi = (int16_t)(a >> 16) + (int16_t)(b >> 16);
+
+    lo = lo > INT16_MAX ? INT16_MAX : lo < INT16_MIN ? INT16_MIN : lo;
+    hi = hi > INT16_MAX ? INT16_MAX : hi < INT16_MIN ? INT16_MIN : hi;
+    return (uint16_t)lo | (uint32_t)(uint16_t)hi << 16;
+}
+
+static inline uint32_t __QSUB16(uint32_t a, uint32_t b)
+{
+    int32_t lo = (int16_t)a - (int16_t)b;
+    int32_t hi = (int16_t)(a >> 16) - (int16_t)(b >> 16);
+
+    lo = lo > INT16_MAX ? INT16_MAX : lo < INT16_MIN ? INT16_MIN : lo;
+    hi = hi > INT16_MAX ? INT16_MAX : hi < INT16_MIN ? INT16_MIN : hi;
+    return (uint16_t)lo | (uint32_t)(uint16_t)hi << 16;
+}
+
+static inline uint32_t __SMLAD(uint32_t a, uint32_t b, uint32_t acc)
+{
+    return (int16_t)a * (int16_t)b + (int16_t)(a >> 16) * (int16_t)(b >> 16) + (int32_t)acc;
+}
+
+static inline uint32_t __ROR(uint32_t x, uint32_t n)
+{
+    return x >> n | x << (32 - n);
+}
+
+#endif
+
+/** Two signed 16-bit values in a word, for the SIMD instructions. */
+#define JPEG_PAIR(lo, hi)   ((uint32_t)(uint16_t)(lo) | (uint32_t)(uint16_t)(hi) << 16)
+#define JPEG_LO(w)          ((int16_t)(w))
+#define JPEG_HI(w)          ((int16_t)((w) >> 16))
+
+/** Constants of the AAN DCT, in 8.8 fixed point. */
+#define JPEG_FIX_0_382683433    98
+#define JPEG_FIX_0_541196100    139
+#define JPEG_FIX_0_707106781    181
+#define JPEG_FIX_1_306562965    334
+
+/** Scaling left by the AAN DCT on each row and column, in 2.14 fixed point. */
+static const uint16_t jpeg_aan_scale[8] = {
+    16384, 22725, 21407, 19266, 16384, 12873, 8867, 4520,
+};
+
+/** Position in the zigzag order of every coefficient in natural order. */
+static const uint8_t jpeg_zigzag[64] = {
+     0,  1,  5,  6, 14, 15, 27, 28,
+     2,  4,  7, 13, 16, 26, 29, 42,
+     3,  8, 12, 17, 25, 30, 41, 43,
+     9, 11, 18, 24, 31, 40, 44, 53,
+    10, 19, 23, 32, 39, 45, 52, 54,
+    20, 22, 33, 38, 46, 51, 55, 60,
+    21, 34, 37, 47, 50, 56, 59, 61,
+    35, 36, 48, 49, 57, 58, 62, 63,
+};
+
+/** Example quantization tables of the standard, Annex K, in natural order. */
+static const uint8_t jpeg_std_qt[2][64] = {
+    {
+        16, 11, 10, 16,  24,  40,  51,  61,
+        12, 12, 14, 19,  26,  58,  60,  55,
+        14, 13, 16, 24,  40,  57,  69,  56,
+        14, 17, 22, 29,  51,  87,  80,  62,
+        18, 22, 37, 56,  68, 109, 103,  77,
+        24, 35, 55, 64,  81, 104, 113,  92,
+        49, 64, 78, 87, 103, 121, 120, 101,
+        72, 92, 95, 98, 112, 100, 103,  99,
+    },
+    {
+        17, 18, 24, 47, 99, 99, 99, 99,
+        18, 21, 26, 66, 99, 99, 99, 99,
+        24, 26, 56, 99, 99, 99, 99, 99,
+        47, 66, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+        99, 99, 99, 99, 99, 99, 99, 99,
+    },
+};
+
+/*
+ * Example Huffman tables of the standard, Annex K: the DHT segment contents,
+ * then the code and its length for every symbol.
+ */
+
+static const uint8_t jpeg_dht_dc_lum[29] = {
+    0x00, 0x00, 0x01, 0x05, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x00, 0x00,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0A, 0x0B,
+};
+
+static const uint8_t jpeg_dht_ac_lum[179] = {
+    0x10, 0x00, 0x02, 0x01, 0x03, 0x03, 0x02, 0x04, 0x03, 0x05, 0x05, 0x04,
+    0x04, 0x00, 0x00, 0x01, 0x7D, 0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05,
+    0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07, 0x22, 0x71, 0x14,
+    0x32, 0x81, 0x91, 0xA1, 0x08, 0x23, 0x42, 0xB1, 0xC1, 0x15, 0x52, 0xD1,
+    0xF0, 0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0A, 0x16, 0x17, 0x18, 0x19,
+    0x1A, 0x25, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x34, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53, 0x54,
+    0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x83, 0x84,
+    0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+    0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8, 0xA9, 0xAA,
+    0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2, 0xC3, 0xC4,
+    0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5, 0xD6, 0xD7,
+    0xD8, 0xD9, 0xDA, 0xE1, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8, 0xE9,
+    0xEA, 0xF1, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA,
+};
+
+static const uint8_t jpeg_dht_dc_chrom[29] = {
+    0x01, 0x00, 0x03, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01,
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06,
+    0x07, 0x08, 0x09, 0x0A, 0x0B,
+};
+
+static const uint8_t jpeg_dht_ac_chrom[179] = {
+    0x11, 0x00, 0x02, 0x01, 0x02, 0x04, 0x04, 0x03, 0x04, 0x07, 0x05, 0x04,
+    0x04, 0x00, 0x01, 0x02, 0x77, 0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05,
+    0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71, 0x13, 0x22, 0x32,
+    0x81, 0x08, 0x14, 0x42, 0x91, 0xA1, 0xB1, 0xC1, 0x09, 0x23, 0x33, 0x52,
+    0xF0, 0x15, 0x62, 0x72, 0xD1, 0x0A, 0x16, 0x24, 0x34, 0xE1, 0x25, 0xF1,
+    0x17, 0x18, 0x19, 0x1A, 0x26, 0x27, 0x28, 0x29, 0x2A, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x3A, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x53,
+    0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x63, 0x64, 0x65, 0x66, 0x67,
+    0x68, 0x69, 0x6A, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7A, 0x82,
+    0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89, 0x8A, 0x92, 0x93, 0x94, 0x95,
+    0x96, 0x97, 0x98, 0x99, 0x9A, 0xA2, 0xA3, 0xA4, 0xA5, 0xA6, 0xA7, 0xA8,
+    0xA9, 0xAA, 0xB2, 0xB3, 0xB4, 0xB5, 0xB6, 0xB7, 0xB8, 0xB9, 0xBA, 0xC2,
+    0xC3, 0xC4, 0xC5, 0xC6, 0xC7, 0xC8, 0xC9, 0xCA, 0xD2, 0xD3, 0xD4, 0xD5,
+    0xD6, 0xD7, 0xD8, 0xD9, 0xDA, 0xE2, 0xE3, 0xE4, 0xE5, 0xE6, 0xE7, 0xE8,
+    0xE9, 0xEA, 0xF2, 0xF3, 0xF4, 0xF5, 0xF6, 0xF7, 0xF8, 0xF9, 0xFA,
+};
+
+static const uint16_t jpeg_code_dc_lum[12] = {
+    0x0000, 0x0002, 0x0003, 0x0004, 0x0005, 0x0006, 0x000E, 0x001E,
+    0x003E, 0x007E, 0x00FE, 0x01FE,
+};
+
+static const uint8_t jpeg_size_dc_lum[12] = {
+    0x02, 0x03, 0x03, 0x03, 0x03, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09,
+};
+
+static const uint16_t jpeg_code_dc_chrom[12] = {
+    0x0000, 0x0001, 0x0002, 0x0006, 0x000E, 0x001E, 0x003E, 0x007E,
+    0x00FE, 0x01FE, 0x03FE, 0x07FE,
+};
+
+static const uint8_t jpeg_size_dc_chrom[12] = {
+    0x02, 0x02, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B,
+};
+
+static const uint16_t jpeg_code_ac_lum[256] = {
+    0x000A, 0x0000, 0x0001, 0x0004, 0x000B, 0x001A, 0x0078, 0x00F8,
+    0x03F6, 0xFF82, 0xFF83, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x000C, 0x001B, 0x0079, 0x01F6, 0x07F6, 0xFF84, 0xFF85,
+    0xFF86, 0xFF87, 0xFF88, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x001C, 0x00F9, 0x03F7, 0x0FF4, 0xFF89, 0xFF8A, 0xFF8B,
+    0xFF8C, 0xFF8D, 0xFF8E, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x003A, 0x01F7, 0x0FF5, 0xFF8F, 0xFF90, 0xFF91, 0xFF92,
+    0xFF93, 0xFF94, 0xFF95, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x003B, 0x03F8, 0xFF96, 0xFF97, 0xFF98, 0xFF99, 0xFF9A,
+    0xFF9B, 0xFF9C, 0xFF9D, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x007A, 0x07F7, 0xFF9E, 0xFF9F, 0xFFA0, 0xFFA1, 0xFFA2,
+    0xFFA3, 0xFFA4, 0xFFA5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x007B, 0x0FF6, 0xFFA6, 0xFFA7, 0xFFA8, 0xFFA9, 0xFFAA,
+    0xFFAB, 0xFFAC, 0xFFAD, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x00FA, 0x0FF7, 0xFFAE, 0xFFAF, 0xFFB0, 0xFFB1, 0xFFB2,
+    0xFFB3, 0xFFB4, 0xFFB5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01F8, 0x7FC0, 0xFFB6, 0xFFB7, 0xFFB8, 0xFFB9, 0xFFBA,
+    0xFFBB, 0xFFBC, 0xFFBD, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01F9, 0xFFBE, 0xFFBF, 0xFFC0, 0xFFC1, 0xFFC2, 0xFFC3,
+    0xFFC4, 0xFFC5, 0xFFC6, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01FA, 0xFFC7, 0xFFC8, 0xFFC9, 0xFFCA, 0xFFCB, 0xFFCC,
+    0xFFCD, 0xFFCE, 0xFFCF, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x03F9, 0xFFD0, 0xFFD1, 0xFFD2, 0xFFD3, 0xFFD4, 0xFFD5,
+    0xFFD6, 0xFFD7, 0xFFD8, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x03FA, 0xFFD9, 0xFFDA, 0xFFDB, 0xFFDC, 0xFFDD, 0xFFDE,
+    0xFFDF, 0xFFE0, 0xFFE1, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x07F8, 0xFFE2, 0xFFE3, 0xFFE4, 0xFFE5, 0xFFE6, 0xFFE7,
+    0xFFE8, 0xFFE9, 0xFFEA, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0xFFEB, 0xFFEC, 0xFFED, 0xFFEE, 0xFFEF, 0xFFF0, 0xFFF1,
+    0xFFF2, 0xFFF3, 0xFFF4, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x07F9, 0xFFF5, 0xFFF6, 0xFFF7, 0xFFF8, 0xFFF9, 0xFFFA, 0xFFFB,
+    0xFFFC, 0xFFFD, 0xFFFE, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+static const uint8_t jpeg_size_ac_lum[256] = {
+    0x04, 0x02, 0x02, 0x03, 0x04, 0x05, 0x07, 0x08, 0x0A, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x04, 0x05, 0x07, 0x09, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x05, 0x08, 0x0A, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x06, 0x09, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x06, 0x0A, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x07, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x07, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x0F, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0A, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0A, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint16_t jpeg_code_ac_chrom[256] = {
+    0x0000, 0x0001, 0x0004, 0x000A, 0x0018, 0x0019, 0x0038, 0x0078,
+    0x01F4, 0x03F6, 0x0FF4, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x000B, 0x0039, 0x00F6, 0x01F5, 0x07F6, 0x0FF5, 0xFF88,
+    0xFF89, 0xFF8A, 0xFF8B, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x001A, 0x00F7, 0x03F7, 0x0FF6, 0x7FC2, 0xFF8C, 0xFF8D,
+    0xFF8E, 0xFF8F, 0xFF90, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x001B, 0x00F8, 0x03F8, 0x0FF7, 0xFF91, 0xFF92, 0xFF93,
+    0xFF94, 0xFF95, 0xFF96, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x003A, 0x01F6, 0xFF97, 0xFF98, 0xFF99, 0xFF9A, 0xFF9B,
+    0xFF9C, 0xFF9D, 0xFF9E, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x003B, 0x03F9, 0xFF9F, 0xFFA0, 0xFFA1, 0xFFA2, 0xFFA3,
+    0xFFA4, 0xFFA5, 0xFFA6, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x0079, 0x07F7, 0xFFA7, 0xFFA8, 0xFFA9, 0xFFAA, 0xFFAB,
+    0xFFAC, 0xFFAD, 0xFFAE, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x007A, 0x07F8, 0xFFAF, 0xFFB0, 0xFFB1, 0xFFB2, 0xFFB3,
+    0xFFB4, 0xFFB5, 0xFFB6, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x00F9, 0xFFB7, 0xFFB8, 0xFFB9, 0xFFBA, 0xFFBB, 0xFFBC,
+    0xFFBD, 0xFFBE, 0xFFBF, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01F7, 0xFFC0, 0xFFC1, 0xFFC2, 0xFFC3, 0xFFC4, 0xFFC5,
+    0xFFC6, 0xFFC7, 0xFFC8, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01F8, 0xFFC9, 0xFFCA, 0xFFCB, 0xFFCC, 0xFFCD, 0xFFCE,
+    0xFFCF, 0xFFD0, 0xFFD1, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01F9, 0xFFD2, 0xFFD3, 0xFFD4, 0xFFD5, 0xFFD6, 0xFFD7,
+    0xFFD8, 0xFFD9, 0xFFDA, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x01FA, 0xFFDB, 0xFFDC, 0xFFDD, 0xFFDE, 0xFFDF, 0xFFE0,
+    0xFFE1, 0xFFE2, 0xFFE3, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x07F9, 0xFFE4, 0xFFE5, 0xFFE6, 0xFFE7, 0xFFE8, 0xFFE9,
+    0xFFEA, 0xFFEB, 0xFFEC, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x0000, 0x3FE0, 0xFFED, 0xFFEE, 0xFFEF, 0xFFF0, 0xFFF1, 0xFFF2,
+    0xFFF3, 0xFFF4, 0xFFF5, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+    0x03FA, 0x7FC3, 0xFFF6, 0xFFF7, 0xFFF8, 0xFFF9, 0xFFFA, 0xFFFB,
+    0xFFFC, 0xFFFD, 0xFFFE, 0x0000, 0x0000, 0x0000, 0x0000, 0x0000,
+};
+
+static const uint8_t jpeg_size_ac_chrom[256] = {
+    0x02, 0x02, 0x03, 0x04, 0x05, 0x05, 0x06, 0x07, 0x09, 0x0A, 0x0C, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x04, 0x06, 0x08, 0x09, 0x0B, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x05, 0x08, 0x0A, 0x0C, 0x0F, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x05, 0x08, 0x0A, 0x0C, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x06, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x06, 0x0A, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x07, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x07, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x09, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0B, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x00, 0x0E, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x0A, 0x0F, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x00, 0x00, 0x00, 0x00, 0x00,
+};
+
+static const uint8_t jpeg_soi_app0[] = {
+    0xFF, 0xD8,                                     // SOI
+    0xFF, 0xE0, 0x00, 0x10, 'J', 'F', 'I', 'F', 0x00, 0x01, 0x01,
+    0x00, 0x00, 0x01, 0x00, 0x01, 0x00, 0x00,       // APP0: JFIF 1.1, no density, no thumbnail
+    0xFF, 0xDB, 0x00, 0x84,                         // DQT, followed by the two tables
+};
+
+static const uint8_t jpeg_dht_header[] = {
+    0xFF, 0xC4, 0x01, 0xA2,                         // DHT, followed by the four tables
+};
+
+static const uint8_t jpeg_sos[] = {
+    0xFF, 0xDA, 0x00, 0x0C, 0x03,                   // SOS, 3 components
+    0x01, 0x00, 0x02, 0x11, 0x03, 0x11,             // Y on tables 0, Cb and Cr on tables 1
+    0x00, 0x3F, 0x00,                               // Spectral selection 0..63, no approximation
+};
+
+static const uint8_t jpeg_eoi[] = {
+    0xFF, 0xD9,
+};
+
+static const uint8_t jpeg_table_id[2] = {
+    0x00, 0x01,
+};
+
+/**
+ * Get a segment of the header, in order.
+ * @param i Index of the segment.
+ * @param len Set to the length of the segment.
+ * @return The segment, or NULL past the last one.
+ */
+static uint8_t const *jpeg_header_part(jpeg_t const *jpeg, size_t i, size_t *len)
+{
+#define JPEG_PART(x, n) do { *len = (n); return (x); } while (0)
+    switch (i)
+    {
+    case 0:  JPEG_PART(jpeg_soi_app0, sizeof jpeg_soi_app0);
+    case 1:  JPEG_PART(&jpeg_table_id[0], 1);
+    case 2:  JPEG_PART(jpeg->qt[0], 64);
+    case 3:  JPEG_PART(&jpeg_table_id[1], 1);
+    case 4:  JPEG_PART(jpeg->qt[1], 64);
+    case 5:  JPEG_PART(jpeg->sof, sizeof jpeg->sof);
+    case 6:  JPEG_PART(jpeg_dht_header, sizeof jpeg_dht_header);
+    case 7:  JPEG_PART(jpeg_dht_dc_lum, sizeof jpeg_dht_dc_lum);
+    case 8:  JPEG_PART(jpeg_dht_ac_lum, sizeof jpeg_dht_ac_lum);
+    case 9:  JPEG_PART(jpeg_dht_dc_chrom, sizeof jpeg_dht_dc_chrom);
+    case 10: JPEG_PART(jpeg_dht_ac_chrom, sizeof jpeg_dht_ac_chrom);
+    case 11: JPEG_PART(jpeg_sos, sizeof jpeg_sos);
+    default: JPEG_PART(NULL, 0);
+    }
+#undef JPEG_PART
+}
+
+/**
+ * Copy the part of the header after what was already output, and move on to
+ * the data once it is complete.
+ * @return Number of bytes copied.
+ */
+static size_t jpeg_write_header(jpeg_t *jpeg, uint8_t *buf, size_t len)
+{
+    uint8_t const *part;
+    size_t part_len, start = 0, pos = 0;
+
+    for (size_t i = 0; (part = jpeg_header_part(jpeg, i, &part_len)) != NULL; i++)
+    {
+        if (jpeg->offset < start + part_len)
+        {
+            size_t skip = jpeg->offset - start;
+            size_t n = part_len - skip < len - pos ? part_len - skip : len - pos;
+
+            memcpy(buf + pos, part + skip, n);
+            pos += n;
+            jpeg->offset += n;
+            if (pos == len)
+                return pos;
+        }
+        start += part_len;
+    }
+
+    jpeg->stage = JPEG_STAGE_DATA;
+    jpeg->offset = 0;
+    return pos;
+}
+
+/**
+ * One dimension of the DCT, in place, on 8 contiguous values.
+ */
+static inline void jpeg_fdct_1d(int16_t *d)
+{
+    uint32_t w01, w23, w54, w76, t01, t32, t54, t76, e1011, e1312, p;
+    int32_t z1, z2, z3, z4, z11, z13, tmp4, tmp5, tmp6, tmp7;
+
+    memcpy(&w01, d + 0, 4);
+    memcpy(&w23, d + 2, 4);
+    memcpy(&w54, d + 4, 4);
+    memcpy(&w76, d + 6, 4);
+    w54 = __ROR(w54, 16);
+    w76 = __ROR(w76, 16);
+
+    // First butterflies, two at once: (tmp0, tmp1) (tmp7, tmp6) (tmp2, tmp3) (tmp5, tmp4)
+    t01 = __QADD16(w01, w76);
+    t76 = __QSUB16(w01, w76);
+    t32 = __ROR(__QADD16(w23, w54), 16);
+    t54 = __QSUB16(w23, w54);
+
+    // Even part: (tmp10, tmp11) (tmp13, tmp12)
+    e1011 = __QADD16(t01, t32);
+    e1312 = __QSUB16(t01, t32);
+    z1 = (int32_t)__SMLAD(e1312, JPEG_PAIR(JPEG_FIX_0_707106781, JPEG_FIX_0_707106781), 128) >> 8;
+    d[0] = JPEG_LO(e1011) + JPEG_HI(e1011);
+    d[4] = JPEG_LO(e1011) - JPEG_HI(e1011);
+    d[2] = JPEG_LO(e1312) + z1;
+    d[6] = JPEG_LO(e1312) - z1;
+
+    // Odd part: the rotation by z5 is merged into two dot products
+    tmp4 = JPEG_HI(t54);
+    tmp5 = JPEG_LO(t54);
+    tmp6 = JPEG_HI(t76);
+    tmp7 = JPEG_LO(t76);
+    p = JPEG_PAIR(tmp4 + tmp5, tmp6 + tmp7);
+    z2 = (int32_t)__SMLAD(p, JPEG_PAIR(JPEG_FIX_0_541196100 + JPEG_FIX_0_382683433,
+            -JPEG_FIX_0_382683433), 128) >> 8;
+    z4 = (int32_t)__SMLAD(p, JPEG_PAIR(JPEG_FIX_0_382683433,
+            JPEG_FIX_1_306562965 - JPEG_FIX_0_382683433), 128) >> 8;
+    z3 = ((tmp5 + tmp6) * JPEG_FIX_0_707106781 + 128) >> 8;
+    z11 = tmp7 + z3;
+    z13 = tmp7 - z3;
+    d[5] = z13 + z2;
+    d[3] = z13 - z2;
+    d[1] = z11 + z4;
+    d[7] = z11 - z4;
+}
+
+/**
+ * Transpose a block in place, so that the columns become contiguous.
+ */
+static inline void jpeg_transpose(int16_t *d)
+{
+    for (size_t y = 0; y < 8; y++)
+    {
+        for (size_t x = y + 1; x < 8; x++)
+        {
+            int16_t t = d[y * 8 + x];
+
+            d[y * 8 + x] = d[x * 8 + y];
+            d[x * 8 + y] = t;
+        }
+    }
+}
+
+/**
+ * Transform and quantize a block of level-shifted samples.
+ * @param d The samples, in natural order, overwritten.
+ * @param qr Reciprocal quantization table to use.
+ * @param out The quantized coefficients, in zigzag order.
+ */
+static void jpeg_fdct_quantize(int16_t *d, uint32_t const *qr, int16_t *out)
+{
+    for (size_t i = 0; i < 64; i += 8)
+        jpeg_fdct_1d(d + i);
+    jpeg_transpose(d);
+    for (size_t i = 0; i < 64; i += 8)
+        jpeg_fdct_1d(d + i);
+
+    // The block is left transposed: d[x * 8 + y] holds the coefficient (y, x)
+    for (size_t x = 0; x < 8; x++)
+    {
+        for (size_t y = 0; y < 8; y++)
+        {
+            int32_t v = d[x * 8 + y];
+            size_t n = y * 8 + x;
+            uint32_t q = ((uint32_t)(v < 0 ? -v : v) * qr[n] + 0x8000) >> 16;
+
+            out[jpeg_zigzag[n]] = v < 0 ? -(int32_t)q : (int32_t)q;
+        }
+    }
+}
+
+/**
+ * Read the next MCU out of the rows of pixels, and transform its four blocks.
+ */
+static void jpeg_load_mcu(jpeg_t *jpeg)
+{
+    int16_t d[4][64];
+    size_t stride = jpeg->width * 2;
+
+    for (size_t y = 0; y < 8; y++)
+    {
+        uint8_t const *p = jpeg->rows + y * stride + jpeg->mcu_x * JPEG_MCU_WIDTH * 2;
+
+        // Y0 U Y1 V: two pixels sharing the same chroma
+        for (size_t x = 0; x < 8; x++, p += 4)
+        {
+            size_t b = x < 4 ? 0 : 1;
+            size_t i = y * 8 + (x % 4) * 2;
+
+            d[b][i + 0] = p[0] - 128;
+            d[b][i + 1] = p[2] - 128;
+            d[2][y * 8 + x] = p[1] - 128;
+            d[3][y * 8 + x] = p[3] - 128;
+        }
+    }
+
+    jpeg_fdct_quantize(d[0], jpeg->qr[0], jpeg->coefs[0]);
+    jpeg_fdct_quantize(d[1], jpeg->qr[0], jpeg->coefs[1]);
+    jpeg_fdct_quantize(d[2], jpeg->qr[1], jpeg->coefs[2]);
+    jpeg_fdct_quantize(d[3], jpeg->qr[1], jpeg->coefs[3]);
+}
+
+/**
+ * Append bits to the output, stuffing a zero after every 0xFF byte.
+ * The caller checks that there is room for the bytes completed.
+ * @return Number of bytes written.
+ */
+static size_t jpeg_put_bits(jpeg_t *jpeg, uint8_t *buf, uint32_t code, uint8_t size)
+{
+    size_t pos = 0;
+
+    jpeg->bits = jpeg->bits << size | (code & ((1u << size) - 1));
+    jpeg->nbits += size;
+    while (jpeg->nbits >= 8)
+    {
+        uint8_t byte = jpeg->bits >> (jpeg->nbits - 8);
+
+        buf[pos++] = byte;
+        if (byte == 0xFF)
+            buf[pos++] = 0x00;
+        jpeg->nbits -= 8;
+    }
+    jpeg->bits &= (1u << jpeg->nbits) - 1;
+    return pos;
+}
+
+/**
+ * Output a Huffman symbol followed by the extra bits of a value.
+ * @return Number of bytes written.
+ */
+static size_t jpeg_put_symbol(jpeg_t *jpeg, uint8_t *buf, uint16_t const *codes,
+        uint8_t const *sizes, uint8_t symbol, int32_t value, uint8_t category)
+{
+    size_t pos = jpeg_put_bits(jpeg, buf, codes[symbol], sizes[symbol]);
+
+    // Negative values are sent as their one's complement
+    if (category > 0)
+        pos += jpeg_put_bits(jpeg, buf + pos, value < 0 ? value - 1 : value, category);
+    return pos;
+}
+
+/**
+ * Number of bits needed for the magnitude of a coefficient.
+ */
+static inline uint8_t jpeg_category(int32_t v)
+{
+    uint32_t a = v < 0 ? -v : v;
+
+    return a == 0 ? 0 : 32 - __builtin_clz(a);
+}
+
+/**
+ * Encode the MCUs, one symbol at a time, as long as there is room for one.
+ * @return Number of bytes written.
+ */
+static size_t jpeg_write_data(jpeg_t *jpeg, uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+
+    while (len - pos >= JPEG_SYMBOL_MAX_SIZE)
+    {
+        bool chroma;
+        int16_t const *coefs;
+        uint16_t const *ac_codes;
+        uint8_t const *ac_sizes;
+
+        // Move on to the next MCU, reading the next rows of pixels if needed
+        if (jpeg->block == 4)
+        {
+            if (jpeg->mcu_y * JPEG_MCU_HEIGHT == jpeg->height)
+            {
+                jpeg->stage = JPEG_STAGE_TRAILER;
+                break;
+            }
+            if (jpeg->mcu_x == 0)
+                jpeg->read(jpeg->rows, JPEG_ROWS_SIZE(jpeg->width));
+
+            jpeg_load_mcu(jpeg);
+            jpeg->block = 0;
+            jpeg->k = 0;
+            jpeg->run = 0;
+
+            if (++jpeg->mcu_x * JPEG_MCU_WIDTH == jpeg->width)
+            {
+                jpeg->mcu_x = 0;
+                jpeg->mcu_y++;
+            }
+        }
+
+        chroma = jpeg->block >= 2;
+        coefs = jpeg->coefs[jpeg->block];
+        ac_codes = chroma ? jpeg_code_ac_chrom : jpeg_code_ac_lum;
+        ac_sizes = chroma ? jpeg_size_ac_chrom : jpeg_size_ac_lum;
+
+        // DC coefficient, relative to the previous block of the same component
+        if (jpeg->k == 0)
+        {
+            size_t c = jpeg->block < 2 ? 0 : jpeg->block - 1;
+            int32_t diff = coefs[0] - jpeg->dc[c];
+            uint8_t cat = jpeg_category(diff);
+
+            jpeg->dc[c] = coefs[0];
+            pos += jpeg_put_symbol(jpeg, buf + pos,
+                    chroma ? jpeg_code_dc_chrom : jpeg_code_dc_lum,
+                    chroma ? jpeg_size_dc_chrom : jpeg_size_dc_lum,
+                    cat, diff, cat);
+            jpeg->k = 1;
+            continue;
+        }
+
+        // Count the zeros before the next AC coefficient
+        while (jpeg->k < 64 && coefs[jpeg->k] == 0)
+        {
+            jpeg->run++;
+            jpeg->k++;
+        }
+
+        if (jpeg->k == 64)
+        {
+            // End of block, unless the last coefficient was not zero
+            if (jpeg->run > 0)
+                pos += jpeg_put_symbol(jpeg, buf + pos, ac_codes, ac_sizes, 0x00, 0, 0);
+            jpeg->block++;
+            jpeg->k = 0;
+            jpeg->run = 0;
+            continue;
+        }
+
+        if (jpeg->run >= 16)
+        {
+            // Sixteen zeros at once
+            pos += jpeg_put_symbol(jpeg, buf + pos, ac_codes, ac_sizes, 0xF0, 0, 0);
+            jpeg->run -= 16;
+            continue;
+        }
+
+        {
+            int32_t v = coefs[jpeg->k];
+            uint8_t cat = jpeg_category(v);
+
+            pos += jpeg_put_symbol(jpeg, buf + pos, ac_codes, ac_sizes,
+                    jpeg->run << 4 | cat, v, cat);
+            jpeg->run = 0;
+            if (++jpeg->k == 64)
+            {
+                jpeg->block++;
+                jpeg->k = 0;
+            }
+        }
+    }
+    return pos;
+}
+
+/**
+ * Pad the last byte with ones and append the end of image marker.
+ * @return Number of bytes written.
+ */
+static size_t jpeg_write_trailer(jpeg_t *jpeg, uint8_t *buf, size_t len)
+{
+    size_t pos = 0;
+
+    if (jpeg->offset == 0 && jpeg->nbits > 0)
+    {
+        if (len < 2)
+            return 0;
+        pos += jpeg_put_bits(jpeg, buf, 0x7F, 8 - jpeg->nbits);
+    }
+
+    while (pos < len && jpeg->offset < sizeof jpeg_eoi)
+        buf[pos++] = jpeg_eoi[jpeg->offset++];
+
+    if (jpeg->offset == sizeof jpeg_eoi)
+        jpeg->stage = JPEG_STAGE_DONE;
+    return pos;
+}
+
+/**
+ * Produce the next bytes of the image.
+ * @param buf Buffer to fill, such as the payload of a packet.
+ * @param len Room in the buffer, at least JPEG_SYMBOL_MAX_SIZE, which gets
+ *        filled up to the last few bytes.
+ * @return Number of bytes written, 0 once the image is complete.
+ */
+size_t jpeg_encode(jpeg_t *jpeg, uint8_t *buf, size_t len)
+{
+    size_t pos = 0, n;
+
+    ASSERT(len >= JPEG_SYMBOL_MAX_SIZE);
+
+    while (pos < len)
+    {
+        enum jpeg_stage stage = jpeg->stage;
+
+        switch (jpeg->stage)
+        {
+        case JPEG_STAGE_HEADER:
+            n = jpeg_write_header(jpeg, buf + pos, len - pos);
+            break;
+        case JPEG_STAGE_DATA:
+            n = jpeg_write_data(jpeg, buf + pos, len - pos);
+            break;
+        case JPEG_STAGE_TRAILER:
+            n = jpeg_write_trailer(jpeg, buf + pos, len - pos);
+            break;
+        default:
+            n = 0;
+            break;
+        }
+        pos += n;
+
+        // Stop when there is no room left for progressing further
+        if (n == 0 && jpeg->stage == stage)
+            break;
+    }
+    return pos;
+}
+
+bool jpeg_is_done(jpeg_t const *jpeg)
+{
+    return jpeg->stage == JPEG_STAGE_DONE;
+}
+
+/**
+ * Prepare the encoding of a frame.
+ * @param width Width of the frame, multiple of JPEG_MCU_WIDTH.
+ * @param height Height of the frame, multiple of JPEG_MCU_HEIGHT.
+ * @param quality From 1 to 100, scaling the tables as in the IJG library.
+ * @param read Source of the pixels, called for every row of MCUs.
+ * @param rows Buffer of JPEG_ROWS_SIZE(width) bytes for reading the rows.
+ */
+void jpeg_init(jpeg_t *jpeg, uint16_t width, uint16_t height, uint8_t quality,
+        jpeg_read_t *read, uint8_t *rows)
+{
+    uint32_t scale;
+
+    ASSERT(width > 0 && width % JPEG_MCU_WIDTH == 0);
+    ASSERT(height > 0 && height % JPEG_MCU_HEIGHT == 0);
+    ASSERT(quality >= 1 && quality <= 100);
+
+    memset(jpeg, 0, sizeof *jpeg);
+    jpeg->width = width;
+    jpeg->height = height;
+    jpeg->read = read;
+    jpeg->rows = rows;
+    jpeg->stage = JPEG_STAGE_HEADER;
+    jpeg->block = 4;
+
+    scale = quality < 50 ? 5000 / quality : 200 - quality * 2;
+    for (size_t t = 0; t < 2; t++)
+    {
+        for (size_t n = 0; n < 64; n++)
+        {
+            uint32_t q = (jpeg_std_qt[t][n] * scale + 50) / 100;
+
+            q = q < 1 ? 1 : q > 255 ? 255 : q;
+            jpeg->qt[t][jpeg_zigzag[n]] = q;
+
+            // The DCT output is scaled by 8 and the AAN factors of its row and column
+            jpeg->qr[t][n] = ((uint64_t)1 << 41) /
+                    ((uint64_t)q * jpeg_aan_scale[n / 8] * jpeg_aan_scale[n % 8]);
+        }
+    }
+
+    memcpy(jpeg->sof, (uint8_t[]){
+        0xFF, 0xC0, 0x00, 0x11, 0x08,               // SOF0, 8-bit samples
+        height >> 8, height >> 0, width >> 8, width >> 0,
+        0x03,                                       // 3 components
+        0x01, 0x21, 0x00,                           // Y, 2x1 sampling, table 0
+        0x02, 0x11, 0x01,                           // Cb, 1x1 sampling, table 1
+        0x03, 0x11, 0x01,                           // Cr, 1x1 sampling, table 1
+    }, sizeof jpeg->sof);
+}
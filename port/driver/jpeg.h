@@ -0,0 +1,80 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Baseline JPEG encoder for the YUYV frames of the camera, 4:2:2 subsampled.
+ * The frame is read one row of MCUs (8 lines) at a time, and the output is
+ * produced incrementally, as many bytes as the caller has room for, so that
+ * it can be written straight into the payloads of the transport.
+ * It does not depend on the hardware, and also builds on the host.
+ */
+
+#define JPEG_MCU_WIDTH              16
+#define JPEG_MCU_HEIGHT             8
+
+/** Room needed for one symbol and its extra bits, if every byte gets stuffed. */
+#define JPEG_SYMBOL_MAX_SIZE        10
+
+/** Size of the buffer holding one row of MCUs of YUYV pixels. */
+#define JPEG_ROWS_SIZE(width)       ((width) * 2 * JPEG_MCU_HEIGHT)
+
+/**
+ * Source of the frame, such as the FPGA capture buffer.
+ * @param buf Buffer to fill with the next pixels, in raster order.
+ * @param len Number of bytes to read.
+ */
+typedef void jpeg_read_t(uint8_t *buf, size_t len);
+
+typedef struct
+{
+    uint16_t width;             // Frame size, multiple of the MCU size
+    uint16_t height;
+    jpeg_read_t *read;          // Source of the pixels
+    uint8_t *rows;              // Current row of MCUs, of JPEG_ROWS_SIZE(width) bytes
+
+    uint8_t qt[2][64];          // Quantization tables as in the header, in zigzag order
+    uint32_t qr[2][64];         // Their reciprocal in 16.16 fixed point, with the DCT scaling folded in
+    uint8_t sof[19];            // Start of frame segment, holding the frame size
+
+    enum jpeg_stage {
+        JPEG_STAGE_HEADER,
+        JPEG_STAGE_DATA,
+        JPEG_STAGE_TRAILER,
+        JPEG_STAGE_DONE,
+    } stage;
+    size_t offset;              // Bytes of the header or trailer already output
+
+    uint16_t mcu_x;             // Next MCU to encode
+    uint16_t mcu_y;
+    uint8_t block;              // Block of the MCU being encoded: Y, Y, Cb, Cr, or 4 if none
+    uint8_t k;                  // Next coefficient of that block, in zigzag order
+    uint8_t run;                // Zero coefficients before it
+    int16_t dc[3];              // Last DC coefficient of every component
+    int16_t coefs[4][64];       // Quantized coefficients of the MCU, in zigzag order
+
+    uint32_t bits;              // Bits not yet output, in the low nbits
+    uint8_t nbits;
+} jpeg_t;
+
+void jpeg_init(jpeg_t *jpeg, uint16_t width, uint16_t height, uint8_t quality,
+        jpeg_read_t *read, uint8_t *rows);
+size_t jpeg_encode(jpeg_t *jpeg, uint8_t *buf, size_t len);
+bool jpeg_is_done(jpeg_t const *jpeg);
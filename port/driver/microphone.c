@@ -0,0 +1,356 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Microphone pipeline: the FPGA signals every block of samples, which gets
+ * read over SPI in the background into a ring of blocks. A slow poll of the
+ * FPGA keeps the stream going if these signals never come. The media channel
+ * then pulls them from the SoftDevice event interrupt, compressing them on
+ * the fly.
+ *
+ * The ring has a single producer, the SPI interrupt, moving the head, and a
+ * single consumer, the media channel, moving the tail.
+ */
+
+#define LOG_MODULE AUDIO
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nrf.h"
+#include "nrfx_log.h"
+
+#include "driver/bluetooth_data_protocol.h"
+#include "driver/config.h"
+#include "driver/fpga.h"
+#include "driver/microphone.h"
+#include "driver/timer.h"
+
+#define ASSERT  NRFX_ASSERT
+
+#define MIN(a, b) ((a) < (b) ? (a) : (b))
+
+#define MICROPHONE_BLOCK_NUM        4   // Power of two
+#define MICROPHONE_POLL_MS          8   // Half a block, so that the ring still fills in time
+
+/**
+ * Samples as read from the FPGA, big endian, after the two bytes clocked in
+ * while the read command is sent.
+ */
+typedef struct
+{
+    uint16_t seq;
+    uint8_t rx[2 + MICROPHONE_BLOCK_SAMPLES * 2];
+} microphone_block_t;
+
+static microphone_block_t microphone_ring[MICROPHONE_BLOCK_NUM];
+
+// The SPIM counts the bytes of a transfer on 8 bits, and frames hold pairs of samples
+NRFX_STATIC_ASSERT(sizeof microphone_ring[0].rx <= UINT8_MAX);
+NRFX_STATIC_ASSERT(MICROPHONE_BLOCK_SAMPLES % 2 == 0);
+
+/** Blocks written and read so far, wrapping, only their difference matters. */
+static volatile uint8_t microphone_head;
+static volatile uint8_t microphone_tail;
+
+/** Samples of the tail block already compressed. */
+static uint16_t microphone_offset;
+
+/** Sequence number of the next block read. */
+static uint16_t microphone_seq;
+
+/** Answer of the FPGA status command. */
+static uint8_t microphone_status[4];
+
+static volatile bool microphone_running;
+static volatile bool microphone_busy;
+static microphone_stats_t microphone_stats;
+
+/** IMA-ADPCM encoder state, carried from one frame to the next. */
+static struct
+{
+    int16_t predictor;
+    uint8_t index;
+} microphone_adpcm;
+
+static const uint16_t microphone_adpcm_steps[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41,
+    45, 50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209,
+    230, 253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876,
+    963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749,
+    3024, 3327, 3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630,
+    9493, 10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623,
+    27086, 29794, 32767,
+};
+
+static const int8_t microphone_adpcm_index_shift[8] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+};
+
+/**
+ * Clamp to a signed 16-bit value, in a single instruction on the Cortex-M4.
+ */
+static inline int32_t microphone_sat16(int32_t x)
+{
+#ifdef __ARM_FEATURE_SAT
+    return __SSAT(x, 16);
+#else
+    return x > INT16_MAX ? INT16_MAX : x < INT16_MIN ? INT16_MIN : x;
+#endif
+}
+
+/**
+ * Compress one sample, updating the encoder state like the decoder will.
+ * @param sample The 16-bit sample to encode.
+ * @return The 4-bit code.
+ */
+static uint8_t microphone_adpcm_encode(int16_t sample)
+{
+    int32_t step = microphone_adpcm_steps[microphone_adpcm.index];
+    int32_t diff = sample - microphone_adpcm.predictor;
+    int32_t delta = step >> 3;
+    int32_t index;
+    uint8_t code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        delta += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        delta += step;
+    }
+
+    microphone_adpcm.predictor = microphone_sat16(microphone_adpcm.predictor +
+            (code & 8 ? -delta : delta));
+
+    index = microphone_adpcm.index + microphone_adpcm_index_shift[code & 7];
+    microphone_adpcm.index = index < 0 ? 0 : index > 88 ? 88 : index;
+
+    return code;
+}
+
+static inline int16_t microphone_sample(microphone_block_t const *block, size_t i)
+{
+    return (int16_t)(block->rx[2 + i * 2] << 8 | block->rx[3 + i * 2]);
+}
+
+/**
+ * Compress the next samples into a frame for the media channel.
+ * Called from the SoftDevice event interrupt.
+ * @param buf Buffer to fill with the frame.
+ * @param len Room available in the buffer.
+ * @return Length of the frame, or 0 if no samples are available.
+ */
+size_t microphone_read_frame(uint8_t *buf, size_t len)
+{
+    microphone_block_t const *block;
+    size_t n;
+
+    if (microphone_tail == microphone_head || len < MICROPHONE_FRAME_HEADER + 1)
+        return 0;
+
+    block = &microphone_ring[microphone_tail % MICROPHONE_BLOCK_NUM];
+    n = MIN(MICROPHONE_BLOCK_SAMPLES - microphone_offset, (len - MICROPHONE_FRAME_HEADER) * 2);
+
+    buf[0] = block->seq >> 0;
+    buf[1] = block->seq >> 8;
+    buf[2] = microphone_offset;
+    buf[3] = (uint16_t)microphone_adpcm.predictor >> 0;
+    buf[4] = (uint16_t)microphone_adpcm.predictor >> 8;
+    buf[5] = microphone_adpcm.index;
+    buf += MICROPHONE_FRAME_HEADER;
+
+    for (size_t i = microphone_offset; i < microphone_offset + n; i += 2)
+    {
+        uint8_t lo = microphone_adpcm_encode(microphone_sample(block, i + 0));
+        uint8_t hi = microphone_adpcm_encode(microphone_sample(block, i + 1));
+
+        *buf++ = hi << 4 | lo;
+    }
+
+    microphone_offset += n;
+    if (microphone_offset == MICROPHONE_BLOCK_SAMPLES)
+    {
+        microphone_offset = 0;
+        microphone_tail++;
+    }
+
+    microphone_stats.frames++;
+    return MICROPHONE_FRAME_HEADER + n / 2;
+}
+
+static void microphone_status_done(void);
+
+/**
+ * Ask the FPGA how many samples it has, as soon as the bus is free, unless
+ * too many transactions already wait for it, in which case the next event will.
+ */
+static void microphone_read(void)
+{
+    bool idle;
+
+    // Called from both the SPI and the timer interrupts
+    __disable_irq();
+    idle = microphone_running && !microphone_busy;
+    if (idle)
+        microphone_busy = true;
+    __enable_irq();
+
+    if (idle && !fpga_microphone_get_status_async(microphone_status, microphone_status_done))
+        microphone_busy = false;
+}
+
+/**
+ * A block was read from the FPGA: hand it over to the media channel.
+ * Called from the SPI interrupt.
+ */
+static void microphone_data_done(void)
+{
+    microphone_ring[microphone_head % MICROPHONE_BLOCK_NUM].seq = microphone_seq++;
+    microphone_head++;
+    microphone_stats.blocks++;
+    microphone_busy = false;
+
+    bluetooth_data_event(DATA_EVENT_SPI_DONE);
+
+    // Catch up with the blocks that became available meanwhile.
+    microphone_read();
+}
+
+/**
+ * The FPGA told how many samples it has: read a block if there is enough.
+ * Called from the SPI interrupt.
+ */
+static void microphone_status_done(void)
+{
+    uint16_t available = microphone_status[2] << 8 | microphone_status[3] << 0;
+
+    if (!microphone_running || available < MICROPHONE_BLOCK_SAMPLES)
+    {
+        microphone_busy = false;
+        return;
+    }
+
+    // If the host is too slow, replace the newest block with fresher samples,
+    // leaving a hole in the sequence numbers.
+    __disable_irq();
+    if ((uint8_t)(microphone_head - microphone_tail) == MICROPHONE_BLOCK_NUM)
+    {
+        microphone_head--;
+        microphone_stats.dropped++;
+    }
+    __enable_irq();
+
+    if (!fpga_microphone_get_data_async(microphone_ring[microphone_head % MICROPHONE_BLOCK_NUM].rx,
+            sizeof microphone_ring[0].rx, microphone_data_done))
+        microphone_busy = false;
+}
+
+/**
+ * The FPGA has a block of samples ready, read them unless already doing so.
+ * Called from the SPI interrupt.
+ */
+static void microphone_event_handler(uint16_t events)
+{
+    microphone_read();
+}
+
+/**
+ * Ask the FPGA for samples once in a while, in case it does not signal them,
+ * such as with a bitstream that does not drive its interrupt pin.
+ * Called from the timer interrupt.
+ */
+static void microphone_timer_handler(void)
+{
+    static uint8_t ticks_ms;
+
+    if (!microphone_running || ++ticks_ms < MICROPHONE_POLL_MS)
+        return;
+    ticks_ms = 0;
+    microphone_read();
+}
+
+/**
+ * Start reading samples, dropping any left from a previous stream.
+ */
+void microphone_start(void)
+{
+    // Let a transfer of the previous stream complete
+    while (microphone_busy)
+        __WFE();
+
+    microphone_head = microphone_tail = 0;
+    microphone_offset = 0;
+    microphone_seq = 0;
+    microphone_adpcm.predictor = 0;
+    microphone_adpcm.index = 0;
+
+    fpga_microphone_start();
+    microphone_running = true;
+}
+
+/**
+ * Stop reading samples. Those already read can still be pulled.
+ */
+void microphone_stop(void)
+{
+    microphone_running = false;
+    fpga_microphone_stop();
+}
+
+bool microphone_is_running(void)
+{
+    return microphone_running;
+}
+
+void microphone_get_stats(microphone_stats_t *stats)
+{
+    __disable_irq();
+    *stats = microphone_stats;
+    __enable_irq();
+}
+
+void microphone_init(void)
+{
+    DRIVER("MICROPHONE");
+    fpga_init();
+    timer_init();
+    fpga_subscribe(FPGA_EVENT_AUDIO_READY, microphone_event_handler);
+    timer_add_handler(microphone_timer_handler);
+}
@@ -0,0 +1,56 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/**
+ * Microphone samples read from the FPGA in the background and compressed
+ * with IMA-ADPCM into frames for the media channel.
+ *
+ * Every frame is self-contained:
+ * - u16: sequence number of the block the samples come from,
+ * - u8: index of the first sample within that block,
+ * - i16: ADPCM predictor before the first sample,
+ * - u8: ADPCM step index before the first sample,
+ * - 4-bit codes, two samples per byte, the first in the low nibble.
+ *
+ * Blocks lost because the host did not keep up leave a hole in the sequence
+ * numbers, and the decoder restarts from the state carried by the next frame.
+ */
+
+#define MICROPHONE_SAMPLE_RATE      8000
+#define MICROPHONE_BLOCK_SAMPLES    126 // Read in one SPI transfer of at most 255 bytes
+#define MICROPHONE_FRAME_HEADER     6
+
+/**
+ * Statistics about the microphone stream.
+ */
+typedef struct
+{
+    uint32_t blocks;            // Blocks read from the FPGA
+    uint32_t dropped;           // Blocks lost because the ring was full
+    uint32_t frames;            // Frames handed to the media channel
+} microphone_stats_t;
+
+void microphone_init(void);
+void microphone_start(void);
+void microphone_stop(void);
+bool microphone_is_running(void);
+size_t microphone_read_frame(uint8_t *buf, size_t len);
+void microphone_get_stats(microphone_stats_t *stats);
@@ -27,6 +27,8 @@
  * OV5640 camera module driver.
  */
 
+#define LOG_MODULE CAMERA
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -46,6 +48,20 @@
 #define ASSERT NRFX_ASSERT
 #define LEN(x) (sizeof (x) / sizeof *(x))
 
+/** Time without use after which the sensor goes to standby. */
+#define OV5640_IDLE_TIMEOUT_MS  3000
+
+/** Time from leaving standby to the registers being accessible again. */
+#define OV5640_WAKE_DELAY_MS    2
+
+/** Standby, with the configuration retained, or streaming pixels to the FPGA. */
+static volatile bool ov5640_standby;
+
+/** Kept awake regardless of the idle timeout, such as for the live view. */
+static volatile bool ov5640_held;
+
+static volatile uint32_t ov5640_idle_ms;
+
 static inline void ov5640_delay_ms(uint32_t ms)
 {
     nrfx_systick_delay_ms(ms);
@@ -177,10 +193,12 @@ void ov5640_pwr_on(void)
 
 /**
  * Put camera into low-power mode, preserving configuration.
+ * The registers are not accessible until ov5640_pwr_wake().
  */
 void ov5640_pwr_sleep(void)
 {
-    ov5640_set_power(true);
+    ov5640_standby = true;
+    ov5640_set_power(false);
 }
 
 /**
@@ -188,7 +206,53 @@ void ov5640_pwr_sleep(void)
  */
 void ov5640_pwr_wake(void)
 {
+    ov5640_idle_ms = 0;
     ov5640_set_power(true);
+    ov5640_delay_ms(OV5640_WAKE_DELAY_MS);
+    ov5640_standby = false;
+}
+
+/**
+ * Wake the camera up if it is in standby, and restart its idle timeout.
+ * To call before every use of the camera.
+ * @return True if it was in standby, in which case the automatic exposure
+ *         needs a few frames to settle again.
+ */
+bool ov5640_use(void)
+{
+    ov5640_idle_ms = 0;
+    if (!ov5640_standby)
+        return false;
+
+    LOG("leaving standby");
+    ov5640_pwr_wake();
+    return true;
+}
+
+/**
+ * Keep the camera awake while it continuously outputs frames, such as for
+ * the live view or a stream, or let it go to standby once idle again.
+ * @param hold True to keep it awake.
+ */
+void ov5640_hold(bool hold)
+{
+    if (hold)
+        ov5640_use();
+    ov5640_idle_ms = 0;
+    ov5640_held = hold;
+}
+
+/**
+ * Put the camera in standby after some time without use.
+ */
+static void ov5640_timer_handler(void)
+{
+    if (ov5640_standby || ov5640_held)
+        return;
+    if (++ov5640_idle_ms < OV5640_IDLE_TIMEOUT_MS)
+        return;
+
+    ov5640_pwr_sleep();
 }
 
 /**
@@ -468,6 +532,75 @@ void ov5640_outsize_set(uint16_t offx, uint16_t offy, uint16_t width, uint16_t h
     ov5640_write_reg(0x3212, 0xA3);
 }
 
+/** Origin of the ISP input window on the array, and the border kept around the image, as set by ov5640_mode_1x(). */
+#define OV5640_WINDOW_X0        16
+#define OV5640_WINDOW_Y0        14
+#define OV5640_WINDOW_XOFF      16
+#define OV5640_WINDOW_YOFF      46
+
+/** Pixels of the array per pixel of the full 640x400 output. */
+#define OV5640_WINDOW_SCALE     4
+
+/**
+ * Crop the part of the array read by the ISP, and set the size it gets
+ * scaled to, all latched at the same frame boundary.
+ * @pre ov5640_mode_1x() should have already been called.
+ * @param x Left of the region, in pixels of the full 640x400 output.
+ * @param y Top of the region.
+ * @param width Width of the region.
+ * @param height Height of the region.
+ * @param out_width Width output by the sensor, at most width.
+ * @param out_height Height output by the sensor, at most height.
+ */
+void ov5640_set_window(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+        uint16_t out_width, uint16_t out_height)
+{
+    uint16_t hs = OV5640_WINDOW_X0 + x * OV5640_WINDOW_SCALE;
+    uint16_t vs = OV5640_WINDOW_Y0 + y * OV5640_WINDOW_SCALE;
+    uint16_t he = hs + width * OV5640_WINDOW_SCALE + OV5640_WINDOW_XOFF * 2 - 1;
+    uint16_t ve = vs + height * OV5640_WINDOW_SCALE + OV5640_WINDOW_YOFF * 2 - 1;
+
+    ASSERT(out_width <= width && out_height <= height);
+
+    ov5640_write_reg(0x3212, 0x03); // start group 3
+
+    ov5640_write_reg(0x3800, hs >> 8); // HS
+    ov5640_write_reg(0x3801, hs & 0xFF); // HS
+    ov5640_write_reg(0x3802, vs >> 8); // VS
+    ov5640_write_reg(0x3803, vs & 0xFF); // VS
+    ov5640_write_reg(0x3804, he >> 8); // HW (HE)
+    ov5640_write_reg(0x3805, he & 0xFF); // HW (HE)
+    ov5640_write_reg(0x3806, ve >> 8); // VH (VE)
+    ov5640_write_reg(0x3807, ve & 0xFF); // VH (VE)
+
+    ov5640_write_reg(0x3808, out_width >> 8); // DVPHO
+    ov5640_write_reg(0x3809, out_width & 0xFF); // DVPHO
+    ov5640_write_reg(0x380a, out_height >> 8); // DVPVO
+    ov5640_write_reg(0x380b, out_height & 0xFF); // DVPVO
+
+    // end group 3
+    ov5640_write_reg(0x3212, 0x13);
+
+    // launch group 3
+    ov5640_write_reg(0x3212, 0xA3);
+}
+
+/**
+ * Read the exposure and white balance currently applied by the automatic
+ * controls, and the average luminance they measured on the last frame.
+ * @param stats Filled with the register values.
+ */
+void ov5640_get_stats(ov5640_stats_t *stats)
+{
+    stats->exposure = (ov5640_read_reg(0x3500) & 0x0F) << 16 |
+            ov5640_read_reg(0x3501) << 8 | ov5640_read_reg(0x3502) << 0;
+    stats->gain = (ov5640_read_reg(0x350A) & 0x03) << 8 | ov5640_read_reg(0x350B) << 0;
+    stats->awb_red = (ov5640_read_reg(0x3400) & 0x0F) << 8 | ov5640_read_reg(0x3401) << 0;
+    stats->awb_green = (ov5640_read_reg(0x3402) & 0x0F) << 8 | ov5640_read_reg(0x3403) << 0;
+    stats->awb_blue = (ov5640_read_reg(0x3404) & 0x0F) << 8 | ov5640_read_reg(0x3405) << 0;
+    stats->luma = ov5640_read_reg(0x56A1);
+}
+
 /**
  * Focus init transfer camera module firmware.
  */
@@ -531,4 +664,7 @@ void ov5640_init(void)
     // Check the chip ID
     uint16_t id = ov5640_read_reg(OV5640_CHIPIDH) << 8 | ov5640_read_reg(OV5640_CHIPIDL);
     ASSERT(id == OV5640_ID);
+
+    // Go to standby when unused
+    timer_add_handler(ov5640_timer_handler);
 }
@@ -39,12 +39,27 @@
 #define TRANSFER_ERROR 0x01u
 #define I2C_SLAVE_ADDR OV5640_ADDR
 
+/**
+ * State of the automatic exposure and white balance.
+ */
+typedef struct
+{
+    uint32_t exposure;          // Exposure time, in 1/16 of a line (0x3500-0x3502)
+    uint16_t gain;              // Sensor gain, in 1/16 (0x350A-0x350B)
+    uint16_t awb_red;           // White balance gains, in 1/1024 (0x3400-0x3405)
+    uint16_t awb_green;
+    uint16_t awb_blue;
+    uint8_t luma;               // Average luminance of the last frame (0x56A1)
+} ov5640_stats_t;
+
 void ov5640_prepare(void);
 void ov5640_init(void);
 void ov5640_deinit(void);
 void ov5640_pwr_on(void);
 void ov5640_pwr_sleep(void);
 void ov5640_pwr_wake(void);
+bool ov5640_use(void);
+void ov5640_hold(bool hold);
 
 void ov5640_mode_1x(void);
 void ov5640_mode_2x(void);
@@ -59,5 +74,8 @@ void ov5640_flash_ctrl(bool on);
 void ov5640_mirror(bool on);
 void ov5640_flip(bool on);
 void ov5640_outsize_set(uint16_t offx, uint16_t offy, uint16_t width, uint16_t height);
+void ov5640_set_window(uint16_t x, uint16_t y, uint16_t width, uint16_t height,
+        uint16_t out_width, uint16_t out_height);
+void ov5640_get_stats(ov5640_stats_t *stats);
 void ov5640_focus_init(void);
 
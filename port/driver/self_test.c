@@ -26,6 +26,8 @@
  * General power setups.
  */
 
+#define LOG_MODULE POWER
+
 #include <stdint.h>
 #include <stddef.h>
 #include <stdbool.h>
@@ -83,7 +85,7 @@ static void power_check_errors(void)
 
 void power_assert_func(char const *file, int line, char const *func, char const *expr)
 {
-    LOG("%s:%d: (#%d) %s: %s", file, line, power_test_num, func, expr);
+    LOG_ERROR("%s:%d: (#%d) %s: %s", file, line, power_test_num, func, expr);
 
     if (power_halt_on_error)
     {
@@ -0,0 +1,540 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Log-structured key-value store in the external flash.
+ */
+
+#define LOG_MODULE FLASH
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "driver/flash.h"
+#include "driver/settings.h"
+
+#ifdef __arm__
+#include "nrfx_log.h"
+#include "driver/config.h"
+#define ASSERT  NRFX_ASSERT
+#else
+#include <assert.h>
+#define ASSERT  assert
+#define LOG(...)                do { } while (0)
+#define LOG_WARNING(...)        do { } while (0)
+#define DRIVER(name)            do { } while (0)
+#endif
+
+#define SETTINGS_MAGIC              0x5445534D  // "MSET"
+#define SETTINGS_RECORD_SET         0x01
+#define SETTINGS_RECORD_DELETE      0x02
+
+#define SETTINGS_ERASED             0xFFFFFFFF
+
+typedef struct
+{
+    uint32_t hash;              // Of the key, to skip reading the others
+    uint32_t addr;              // Of the latest record of the key
+    uint8_t key_len;
+    uint8_t value_len;
+} settings_entry_t;
+
+static settings_entry_t settings_index[SETTINGS_MAX_KEYS];
+static size_t settings_index_len;
+static uint8_t settings_active;         // Sector appended to
+static uint32_t settings_seq;           // Sequence number of the active sector
+static uint32_t settings_offset;        // Where the next record goes in the active sector
+static settings_stats_t settings_stats;
+
+static inline uint32_t settings_u32(uint8_t const *p)
+{
+    return p[0] << 0 | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static inline void settings_put_u32(uint8_t *p, uint32_t u)
+{
+    p[0] = u >> 0;
+    p[1] = u >> 8;
+    p[2] = u >> 16;
+    p[3] = u >> 24;
+}
+
+static inline uint32_t settings_sector_addr(uint8_t sector)
+{
+    return FLASH_SETTINGS_ADDR + sector * FLASH_SECTOR_SIZE;
+}
+
+static inline size_t settings_record_size(size_t key_len, size_t value_len)
+{
+    return SETTINGS_RECORD_HEADER_SIZE + ((key_len + value_len + 3) & ~3);
+}
+
+static uint32_t settings_hash(char const *key, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (uint8_t)key[i]) * 16777619u;
+    return hash;
+}
+
+static uint32_t settings_crc32(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    crc = ~crc;
+    while (len-- > 0)
+    {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/**
+ * CRC of a record, covering the first half of its header, the key and the value.
+ */
+static uint32_t settings_record_crc(uint8_t const *record)
+{
+    uint32_t crc = settings_crc32(0, record, 4);
+
+    return settings_crc32(crc, record + SETTINGS_RECORD_HEADER_SIZE,
+            record[0] + (record[2] | record[3] << 8));
+}
+
+/**
+ * @return The position of the entry of a key in the index, or settings_index_len.
+ */
+static size_t settings_find(char const *key, size_t key_len, uint32_t hash)
+{
+    char buf[SETTINGS_KEY_MAX_LEN];
+
+    for (size_t i = 0; i < settings_index_len; i++)
+    {
+        settings_entry_t const *entry = &settings_index[i];
+
+        if (entry->hash != hash || entry->key_len != key_len)
+            continue;
+        flash_read(entry->addr + SETTINGS_RECORD_HEADER_SIZE, (uint8_t *)buf, key_len);
+        if (memcmp(buf, key, key_len) == 0)
+            return i;
+    }
+    return settings_index_len;
+}
+
+/**
+ * Apply a record to the index, as when it was appended.
+ * @return False if the index is full.
+ */
+static bool settings_index_record(uint32_t addr, uint8_t const *record)
+{
+    char const *key = (char const *)record + SETTINGS_RECORD_HEADER_SIZE;
+    uint32_t hash = settings_hash(key, record[0]);
+    size_t i = settings_find(key, record[0], hash);
+
+    if (record[1] == SETTINGS_RECORD_DELETE)
+    {
+        if (i < settings_index_len)
+            settings_index[i] = settings_index[--settings_index_len];
+        return true;
+    }
+
+    if (i == settings_index_len)
+    {
+        if (settings_index_len == SETTINGS_MAX_KEYS)
+            return false;
+        settings_index_len++;
+    }
+    settings_index[i] = (settings_entry_t){
+        .hash = hash,
+        .addr = addr,
+        .key_len = record[0],
+        .value_len = record[2],
+    };
+    return true;
+}
+
+/**
+ * @return True if a range of the flash holds only erased bytes.
+ */
+static bool settings_is_erased(uint32_t addr, uint32_t len)
+{
+    uint8_t buf[64];
+
+    while (len > 0)
+    {
+        size_t n = len < sizeof buf ? len : sizeof buf;
+
+        flash_read(addr, buf, n);
+        for (size_t i = 0; i < n; i++)
+            if (buf[i] != 0xFF)
+                return false;
+        addr += n;
+        len -= n;
+    }
+    return true;
+}
+
+/**
+ * Read the records of a sector into the index, up to the erased end of the
+ * sector. A damaged record, cut by a power loss, is skipped by looking for
+ * the next valid record at every 4 bytes.
+ * @return The offset of the first byte not used by a record.
+ */
+static uint32_t settings_scan(uint8_t sector)
+{
+    uint32_t base = settings_sector_addr(sector);
+    uint32_t offset = SETTINGS_HEADER_SIZE;
+    uint8_t record[SETTINGS_RECORD_MAX_SIZE];
+    bool damaged = false;
+
+    while (offset + SETTINGS_RECORD_HEADER_SIZE <= FLASH_SECTOR_SIZE)
+    {
+        size_t value_len, size;
+
+        flash_read(base + offset, record, SETTINGS_RECORD_HEADER_SIZE);
+        if (settings_u32(record) == SETTINGS_ERASED
+                && settings_is_erased(base + offset, FLASH_SECTOR_SIZE - offset))
+            return offset;
+
+        value_len = record[2] | record[3] << 8;
+        size = settings_record_size(record[0], value_len);
+        if (record[0] > 0 && record[0] <= SETTINGS_KEY_MAX_LEN
+                && value_len <= SETTINGS_VALUE_MAX_LEN
+                && offset + size <= FLASH_SECTOR_SIZE)
+        {
+            flash_read(base + offset + SETTINGS_RECORD_HEADER_SIZE,
+                    record + SETTINGS_RECORD_HEADER_SIZE, record[0] + value_len);
+            if (settings_record_crc(record) == settings_u32(record + 4))
+            {
+                if (!settings_index_record(base + offset, record))
+                    LOG_WARNING("index full, key dropped");
+                offset += size;
+                damaged = false;
+                continue;
+            }
+        }
+
+        if (!damaged)
+            LOG_WARNING("sector %d damaged at 0x%03X", sector, (unsigned)offset);
+        damaged = true;
+        offset += 4;
+    }
+    return FLASH_SECTOR_SIZE;
+}
+
+/**
+ * @return The sequence number of a sector, or 0 if it has no valid header.
+ */
+static uint32_t settings_sector_seq(uint8_t sector)
+{
+    uint8_t header[SETTINGS_HEADER_SIZE];
+
+    flash_read(settings_sector_addr(sector), header, sizeof header);
+    if (settings_u32(header) != SETTINGS_MAGIC || settings_u32(header + 4) == SETTINGS_ERASED)
+        return 0;
+    return settings_u32(header + 4);
+}
+
+static void settings_erase(uint8_t sector)
+{
+    flash_erase_sector(settings_sector_addr(sector));
+    settings_stats.erases++;
+}
+
+/**
+ * Make a sector the one appended to. The sequence number is programmed before
+ * the magic, so that a header cut by a power loss never looks valid.
+ */
+static void settings_start_sector(uint8_t sector, uint32_t seq)
+{
+    uint8_t header[SETTINGS_HEADER_SIZE];
+
+    settings_put_u32(header, SETTINGS_MAGIC);
+    settings_put_u32(header + 4, seq);
+    flash_program(settings_sector_addr(sector) + 4, header + 4, 4);
+    flash_program(settings_sector_addr(sector), header, 4);
+
+    settings_active = sector;
+    settings_seq = seq;
+    settings_offset = SETTINGS_HEADER_SIZE;
+}
+
+/**
+ * Copy the records of a sector that are still in use to the active sector,
+ * then erase it. It has room for them, as the records of all the keys fit
+ * in a sector, along with a record damaged by a power loss while copying.
+ * The magic of the sector is cleared before the erase, as an erase cut by a
+ * power loss leaves any content, which could otherwise pass for a header
+ * over stale records.
+ */
+static void settings_collect(uint8_t sector)
+{
+    uint32_t base = settings_sector_addr(sector);
+    uint8_t record[SETTINGS_RECORD_MAX_SIZE];
+    uint8_t const retired[4] = { 0 };
+
+    for (size_t i = 0; i < settings_index_len; i++)
+    {
+        settings_entry_t *entry = &settings_index[i];
+        size_t size = settings_record_size(entry->key_len, entry->value_len);
+
+        if (entry->addr < base || entry->addr >= base + FLASH_SECTOR_SIZE)
+            continue;
+        ASSERT(settings_offset + size <= FLASH_SECTOR_SIZE);
+
+        flash_read(entry->addr, record, size);
+        entry->addr = settings_sector_addr(settings_active) + settings_offset;
+        flash_program(entry->addr, record, size);
+        settings_offset += size;
+        settings_stats.writes++;
+    }
+    flash_program(base, retired, sizeof retired);
+    settings_erase(sector);
+}
+
+/**
+ * Move on to the next sector, which is always erased, and free the oldest one.
+ */
+static void settings_next_sector(void)
+{
+    uint8_t next = (settings_active + 1) % SETTINGS_SECTORS;
+
+    settings_start_sector(next, settings_seq + 1);
+    settings_collect((next + 1) % SETTINGS_SECTORS);
+}
+
+/**
+ * Append a record to the log, and apply it to the index.
+ */
+static void settings_append(uint8_t type, char const *key, size_t key_len,
+        uint8_t const *buf, size_t len)
+{
+    uint8_t record[SETTINGS_RECORD_MAX_SIZE];
+    size_t size = settings_record_size(key_len, len);
+    uint32_t addr;
+
+    memset(record, 0xFF, size);
+    record[0] = key_len;
+    record[1] = type;
+    record[2] = len >> 0;
+    record[3] = len >> 8;
+    memcpy(record + SETTINGS_RECORD_HEADER_SIZE, key, key_len);
+    if (len > 0)
+        memcpy(record + SETTINGS_RECORD_HEADER_SIZE + key_len, buf, len);
+    settings_put_u32(record + 4, settings_record_crc(record));
+
+    if (settings_offset + size > FLASH_SECTOR_SIZE)
+        settings_next_sector();
+
+    addr = settings_sector_addr(settings_active) + settings_offset;
+    flash_program(addr, record, size);
+    settings_offset += size;
+    settings_stats.writes++;
+
+    settings_index_record(addr, record);
+}
+
+/**
+ * Read the value of a key.
+ * @param key Name of the setting, not nul-terminated.
+ * @param key_len Length of the key.
+ * @param buf Buffer receiving the value, of SETTINGS_VALUE_MAX_LEN bytes at most.
+ * @param len Size of the buffer, set to the length of the value.
+ * @return False if the key is not set.
+ */
+bool settings_get(char const *key, size_t key_len, uint8_t *buf, size_t *len)
+{
+    size_t i = settings_find(key, key_len, settings_hash(key, key_len));
+    settings_entry_t const *entry = &settings_index[i];
+
+    if (i == settings_index_len)
+        return false;
+    if (*len > entry->value_len)
+        *len = entry->value_len;
+    flash_read(entry->addr + SETTINGS_RECORD_HEADER_SIZE + key_len, buf, *len);
+    return true;
+}
+
+/**
+ * Set the value of a key, unless it already has that value.
+ * @param key Name of the setting, up to SETTINGS_KEY_MAX_LEN bytes.
+ * @param key_len Length of the key.
+ * @param buf Value, up to SETTINGS_VALUE_MAX_LEN bytes.
+ * @param len Length of the value.
+ * @return False if there is no room for one more key.
+ */
+bool settings_set(char const *key, size_t key_len, uint8_t const *buf, size_t len)
+{
+    uint8_t old[SETTINGS_VALUE_MAX_LEN];
+    size_t old_len = sizeof old;
+
+    ASSERT(key_len > 0 && key_len <= SETTINGS_KEY_MAX_LEN);
+    ASSERT(len <= SETTINGS_VALUE_MAX_LEN);
+
+    if (settings_get(key, key_len, old, &old_len))
+    {
+        if (old_len == len && memcmp(old, buf, len) == 0)
+            return true;
+    }
+    else if (settings_index_len == SETTINGS_MAX_KEYS)
+    {
+        return false;
+    }
+
+    settings_append(SETTINGS_RECORD_SET, key, key_len, buf, len);
+    return true;
+}
+
+/**
+ * Remove a key.
+ * @return False if the key was not set.
+ */
+bool settings_delete(char const *key, size_t key_len)
+{
+    if (settings_find(key, key_len, settings_hash(key, key_len)) == settings_index_len)
+        return false;
+    settings_append(SETTINGS_RECORD_DELETE, key, key_len, NULL, 0);
+    return true;
+}
+
+/**
+ * Read an integer value, as set from Python.
+ * @param key Name of the setting, nul-terminated.
+ * @param value Set to the value if there is one.
+ * @return False if the key is not set, or not to an integer.
+ */
+bool settings_get_int(char const *key, int32_t *value)
+{
+    uint8_t buf[1 + sizeof *value];
+    size_t len = sizeof buf;
+
+    if (!settings_get(key, strlen(key), buf, &len)
+            || len != sizeof buf || buf[0] != SETTINGS_TYPE_INT)
+        return false;
+    memcpy(value, buf + 1, sizeof *value);
+    return true;
+}
+
+/**
+ * Set an integer value, readable from Python.
+ * @param key Name of the setting, nul-terminated.
+ * @param value Value to set.
+ * @return False if there is no room for one more key.
+ */
+bool settings_set_int(char const *key, int32_t value)
+{
+    uint8_t buf[1 + sizeof value] = { SETTINGS_TYPE_INT };
+
+    memcpy(buf + 1, &value, sizeof value);
+    return settings_set(key, strlen(key), buf, sizeof buf);
+}
+
+/**
+ * @return The number of keys set.
+ */
+size_t settings_count(void)
+{
+    return settings_index_len;
+}
+
+/**
+ * Get the name of a key, to list them all.
+ * @param i Position of the key, less than settings_count().
+ * @param key Buffer receiving the name, not nul-terminated.
+ * @return The length of the name.
+ */
+size_t settings_key(size_t i, char key[SETTINGS_KEY_MAX_LEN])
+{
+    ASSERT(i < settings_index_len);
+    flash_read(settings_index[i].addr + SETTINGS_RECORD_HEADER_SIZE,
+            (uint8_t *)key, settings_index[i].key_len);
+    return settings_index[i].key_len;
+}
+
+settings_stats_t settings_get_stats(void)
+{
+    settings_stats.keys = settings_index_len;
+    settings_stats.used = 0;
+    for (size_t i = 0; i < settings_index_len; i++)
+        settings_stats.used += settings_record_size(settings_index[i].key_len, settings_index[i].value_len);
+    return settings_stats;
+}
+
+/**
+ * Rebuild the index from the log, reading the sectors from the oldest to the
+ * newest, and finish any move to a new sector cut by a power loss.
+ */
+void settings_init(void)
+{
+    uint32_t seqs[SETTINGS_SECTORS];
+    uint8_t next;
+
+    DRIVER("SETTINGS");
+    flash_init();
+
+    settings_index_len = 0;
+    settings_seq = 0;
+    for (uint8_t i = 0; i < SETTINGS_SECTORS; i++)
+    {
+        seqs[i] = settings_sector_seq(i);
+        if (seqs[i] > settings_seq)
+        {
+            settings_seq = seqs[i];
+            settings_active = i;
+        }
+    }
+
+    if (settings_seq == 0)
+    {
+        LOG("empty, starting a new log");
+        if (!settings_is_erased(settings_sector_addr(0), FLASH_SECTOR_SIZE))
+            settings_erase(0);
+        settings_start_sector(0, 1);
+    }
+    else
+    {
+        // The oldest sector is the first one with a header after the active one
+        for (uint8_t i = 1; i <= SETTINGS_SECTORS; i++)
+        {
+            uint8_t sector = (settings_active + i) % SETTINGS_SECTORS;
+            uint32_t offset;
+
+            if (seqs[sector] == 0)
+                continue;
+            offset = settings_scan(sector);
+            if (sector == settings_active)
+                settings_offset = offset;
+        }
+    }
+
+    // Keep the sector after the active one erased, for the next move.
+    next = (settings_active + 1) % SETTINGS_SECTORS;
+    if (seqs[next] != 0)
+        settings_collect(next);
+    else if (!settings_is_erased(settings_sector_addr(next), FLASH_SECTOR_SIZE))
+        settings_erase(next);
+
+    LOG("keys=%d sector=%d offset=0x%03X",
+            (int)settings_index_len, settings_active, (unsigned)settings_offset);
+}
@@ -0,0 +1,76 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/**
+ * Key-value settings kept in the external flash across resets, as a log of
+ * records appended to a ring of sectors, with an index of the keys in RAM.
+ * Setting or deleting a key appends a record, the newest one winning.
+ * When the current sector is full, the log moves on to the next one, and the
+ * oldest sector gets its records still in use copied to the new one, then
+ * erased, so that every sector gets erased in turn. Every record carries a
+ * CRC, so that one cut by a power loss is ignored, along with what follows it
+ * in its sector.
+ *
+ * Sector format, little endian:
+ *   header:    magic "MSET", cleared before the sector is erased,
+ *              sequence number (u32), higher for newer sectors
+ *   records:   key length, type, value length (u16), CRC-32 of the rest (u32),
+ *              key, value, padding to a multiple of 4 bytes
+ */
+
+#define SETTINGS_SECTORS            8
+
+#define SETTINGS_KEY_MAX_LEN        15
+#define SETTINGS_VALUE_MAX_LEN      128
+
+/** Keys in the index, few enough for all their records to fit one sector. */
+#define SETTINGS_MAX_KEYS           24
+
+/** Type of a value, as its first byte, for those set from Python. */
+#define SETTINGS_TYPE_NONE          'N'
+#define SETTINGS_TYPE_BOOL          'B'
+#define SETTINGS_TYPE_INT           'i'     // int32_t
+#define SETTINGS_TYPE_FLOAT         'f'     // float
+#define SETTINGS_TYPE_STR           's'
+#define SETTINGS_TYPE_BYTES         'b'
+
+#define SETTINGS_HEADER_SIZE        8
+#define SETTINGS_RECORD_HEADER_SIZE 8
+#define SETTINGS_RECORD_MAX_SIZE    (SETTINGS_RECORD_HEADER_SIZE + ((SETTINGS_KEY_MAX_LEN + SETTINGS_VALUE_MAX_LEN + 3) & ~3))
+
+typedef struct
+{
+    uint32_t keys;              // Keys set
+    uint32_t used;              // Bytes of the log holding the values of the keys
+    uint32_t writes;            // Records appended since the start
+    uint32_t erases;            // Sectors erased since the start
+} settings_stats_t;
+
+void settings_init(void);
+bool settings_get(char const *key, size_t key_len, uint8_t *buf, size_t *len);
+bool settings_set(char const *key, size_t key_len, uint8_t const *buf, size_t len);
+bool settings_delete(char const *key, size_t key_len);
+bool settings_get_int(char const *key, int32_t *value);
+bool settings_set_int(char const *key, int32_t value);
+size_t settings_count(void);
+size_t settings_key(size_t i, char key[SETTINGS_KEY_MAX_LEN]);
+settings_stats_t settings_get_stats(void);
@@ -27,6 +27,8 @@
  * Wrapper library over Nordic SPI NRFX drivers.
  */
 
+#define LOG_MODULE SPI
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -42,9 +44,115 @@
 // SPI instance
 static const nrfx_spim_t spi2 = NRFX_SPIM_INSTANCE(2);
 
+typedef struct
+{
+    uint8_t cs_pin;
+    nrf_spim_frequency_t frequency;
+    nrf_spim_mode_t mode;
+    nrf_spim_bit_order_t bit_order;
+} spi_device_config_t;
+
+// Bus settings of every device, applied whenever it gets the bus.
+static const spi_device_config_t spi_devices[SPI_DEVICE_NUM] = {
+    [SPI_DEVICE_DISPLAY] = { SPI_DISP_CS_PIN, NRF_SPIM_FREQ_1M, NRF_SPIM_MODE_3, NRF_SPIM_BIT_ORDER_LSB_FIRST },
+    [SPI_DEVICE_FLASH] = { SPI_FLASH_CS_PIN, NRF_SPIM_FREQ_8M, NRF_SPIM_MODE_3, NRF_SPIM_BIT_ORDER_MSB_FIRST },
+    [SPI_DEVICE_FPGA] = { SPI_FPGA_CS_PIN, NRF_SPIM_FREQ_1M, NRF_SPIM_MODE_3, NRF_SPIM_BIT_ORDER_LSB_FIRST },
+};
+
+typedef struct
+{
+    uint8_t device;
+    uint8_t priority;
+    uint8_t const *tx_buf;
+    size_t tx_len;
+    uint8_t *rx_buf;
+    size_t rx_len;
+    spi_callback_t *callback;
+} spi_transaction_t;
+
 // Indicate that SPI completed the transfer from the interrupt handler to main loop.
 static volatile bool m_xfer_done = true;
 
+// Set while a device owns the bus.
+static volatile bool spi_bus_busy;
+
+// Device whose settings the bus currently has.
+static spi_device_t spi_bus_device = SPI_DEVICE_NUM;
+
+// Transactions waiting for the bus, in the order they were started.
+static spi_transaction_t spi_queue[SPI_QUEUE_SIZE];
+static volatile uint8_t spi_queue_len;
+
+// Transaction in progress, to finish from the interrupt handler.
+static spi_transaction_t spi_async;
+static volatile bool spi_async_running;
+
+/**
+ * Give the bus the settings of a device, if it had those of another one.
+ * @param device Device that now owns the bus.
+ */
+static void spi_bus_configure(spi_device_t device)
+{
+    spi_device_config_t const *config = &spi_devices[device];
+
+    if (device == spi_bus_device)
+        return;
+    nrf_spim_frequency_set(spi2.p_reg, config->frequency);
+    nrf_spim_configure(spi2.p_reg, config->mode, config->bit_order);
+    spi_bus_device = device;
+}
+
+/**
+ * Take the bus for the queued transaction of highest priority, the oldest
+ * one among those of the same priority, if the bus is free.
+ * Must be called with the interrupts disabled.
+ * @return True if a transaction was taken out of the queue into spi_async.
+ */
+static bool spi_queue_pop(void)
+{
+    size_t best = 0;
+
+    if (spi_bus_busy || spi_queue_len == 0)
+        return false;
+
+    for (size_t i = 1; i < spi_queue_len; i++)
+        if (spi_queue[i].priority > spi_queue[best].priority)
+            best = i;
+
+    spi_async = spi_queue[best];
+    for (size_t i = best; i + 1 < spi_queue_len; i++)
+        spi_queue[i] = spi_queue[i + 1];
+    spi_queue_len--;
+
+    spi_bus_busy = true;
+    spi_async_running = true;
+    return true;
+}
+
+/**
+ * Start the next queued transaction if the bus is free.
+ */
+static void spi_queue_next(void)
+{
+    nrfx_spim_xfer_desc_t xfer;
+    bool taken;
+    uint32_t err;
+
+    __disable_irq();
+    taken = spi_queue_pop();
+    __enable_irq();
+    if (!taken)
+        return;
+
+    spi_bus_configure(spi_async.device);
+    nrf_gpio_pin_clear(spi_devices[spi_async.device].cs_pin);
+    xfer = (nrfx_spim_xfer_desc_t)NRFX_SPIM_XFER_TRX(spi_async.tx_buf, spi_async.tx_len,
+            spi_async.rx_buf, spi_async.rx_len);
+    m_xfer_done = false;
+    err = nrfx_spim_xfer(&spi2, &xfer, 0);
+    ASSERT(err == NRFX_SUCCESS);
+}
+
 /**
  * SPI event handler
  */
@@ -53,24 +161,66 @@ void spim_event_handler(nrfx_spim_evt_t const * p_event, void *p_context)
     // NOTE: there is only one event type: NRFX_SPIM_EVENT_DONE
     // so no need for case statement
     m_xfer_done = true;
+
+    // Release the bus before the callback, which may start another transfer.
+    if (spi_async_running)
+    {
+        spi_async_running = false;
+        nrf_gpio_pin_set(spi_devices[spi_async.device].cs_pin);
+        spi_bus_busy = false;
+        if (spi_async.callback != NULL)
+            spi_async.callback();
+        spi_queue_next();
+    }
+}
+
+/**
+ * Take the bus if nobody holds it and no transaction is waiting for it.
+ * @return True if the bus is now ours.
+ */
+static bool spi_bus_try_acquire(void)
+{
+    bool acquired = false;
+
+    __disable_irq();
+    if (!spi_bus_busy && spi_queue_len == 0)
+        spi_bus_busy = acquired = true;
+    __enable_irq();
+    return acquired;
+}
+
+/**
+ * Take the bus for a device, once the transactions started by spi_xfer_async()
+ * completed, so not from an interrupt of higher priority than the SPI one.
+ * @param device Device to give the bus to.
+ */
+static void spi_bus_acquire(spi_device_t device)
+{
+    ASSERT(device < SPI_DEVICE_NUM);
+    while (!spi_bus_try_acquire())
+        __WFE();
+    spi_bus_configure(device);
 }
 
 /**
- * Select the CS pin: software control.
- * @param cs_pin GPIO pin to use, must be configured as output.
+ * Take the bus for a device, and select it.
+ * @param device Device to select.
  */
-void spi_chip_select(uint8_t cs_pin)
+void spi_chip_select(spi_device_t device)
 {
-    nrf_gpio_pin_clear(cs_pin);
+    spi_bus_acquire(device);
+    nrf_gpio_pin_clear(spi_devices[device].cs_pin);
 }
 
 /**
- * Deselect the CS pin: software control.
- * @param cs_pin GPIO pin to use, must be configured as output.
+ * Deselect a device, and let the next transaction have the bus.
+ * @param device Device to deselect.
  */
-void spi_chip_deselect(uint8_t cs_pin)
+void spi_chip_deselect(spi_device_t device)
 {
-    nrf_gpio_pin_set(cs_pin);
+    nrf_gpio_pin_set(spi_devices[device].cs_pin);
+    spi_bus_busy = false;
+    spi_queue_next();
 }
 
 static void spi_xfer(nrfx_spim_xfer_desc_t *xfer)
@@ -111,6 +261,73 @@ void spi_write(uint8_t *buf, size_t len)
     spi_xfer(&xfer);
 }
 
+/**
+ * Write several commands to a device back to back, each in a single transfer
+ * framed by its own chip select, without letting any other transfer between.
+ * @param device Device to write to.
+ * @param buf Commands, each preceded by its length on one byte.
+ * @param len Length of the whole buffer.
+ */
+void spi_write_batch(spi_device_t device, uint8_t *buf, size_t len)
+{
+    uint8_t cs_pin = spi_devices[device].cs_pin;
+
+    spi_bus_acquire(device);
+    for (size_t i = 0; i < len; i += 1 + buf[i])
+    {
+        nrf_gpio_pin_clear(cs_pin);
+        spi_write(buf + i + 1, buf[i]);
+        nrf_gpio_pin_set(cs_pin);
+    }
+    spi_bus_busy = false;
+    spi_queue_next();
+}
+
+/**
+ * Start a transaction with a device in the background: write a command and
+ * read the answer, then release the device and call the callback from the SPI
+ * interrupt. If the bus is in use, the transaction waits in the queue for its
+ * turn. Both buffers must stay valid until the callback.
+ * The device clocks data in while the command is written, so the answer
+ * starts at rx_buf[tx_len].
+ * @param device Device to select.
+ * @param priority Order in which the waiting transactions get the bus.
+ * @param tx_buf Command to send.
+ * @param tx_len Length of the command.
+ * @param rx_buf Buffer receiving the whole transaction.
+ * @param rx_len Length of the whole transaction, command included.
+ * @param callback Function called from the interrupt once done, or NULL.
+ * @return False if the queue is full, and nothing was started.
+ */
+bool spi_xfer_async(spi_device_t device, spi_priority_t priority,
+        uint8_t const *tx_buf, size_t tx_len, uint8_t *rx_buf, size_t rx_len,
+        spi_callback_t *callback)
+{
+    bool queued = false;
+
+    ASSERT(device < SPI_DEVICE_NUM);
+
+    __disable_irq();
+    if (spi_queue_len < SPI_QUEUE_SIZE)
+    {
+        spi_queue[spi_queue_len++] = (spi_transaction_t){
+            .device = device,
+            .priority = priority,
+            .tx_buf = tx_buf,
+            .tx_len = tx_len,
+            .rx_buf = rx_buf,
+            .rx_len = rx_len,
+            .callback = callback,
+        };
+        queued = true;
+    }
+    __enable_irq();
+
+    if (queued)
+        spi_queue_next();
+    return queued;
+}
+
 /**
  * Initialise an SPI master interface with defaults values.
  * @param spi The instance to configure.
@@ -125,6 +342,7 @@ static void spi_init_instance(nrfx_spim_t spi, uint8_t sck_pin, uint8_t mosi_pin
         sck_pin, mosi_pin, miso_pin, NRFX_SPIM_PIN_NOT_USED
     );
 
+    // Set again for every device by spi_bus_configure()
     config.frequency = NRF_SPIM_FREQ_1M;
     config.mode      = NRF_SPIM_MODE_3;
     config.bit_order = NRF_SPIM_BIT_ORDER_LSB_FIRST;
@@ -142,15 +360,10 @@ void spi_init(void)
 
     spi_init_instance(spi2, SPI2_SCK_PIN, SPI2_MOSI_PIN, SPI2_MISO_PIN);
 
-    // configure CS pin for the Display (for active low)
-    nrf_gpio_pin_set(SPI_DISP_CS_PIN);
-    nrf_gpio_cfg_output(SPI_DISP_CS_PIN);
-
-    // for now, pull high to disable external flash chip
-    nrf_gpio_pin_set(SPI_FLASH_CS_PIN);
-    nrf_gpio_cfg_output(SPI_FLASH_CS_PIN);
-
-    // for now, pull high to disable external flash chip
-    nrf_gpio_pin_set(SPI_FPGA_CS_PIN);
-    nrf_gpio_cfg_output(SPI_FPGA_CS_PIN);
+    // Deselect all the devices (active low)
+    for (size_t i = 0; i < SPI_DEVICE_NUM; i++)
+    {
+        nrf_gpio_pin_set(spi_devices[i].cs_pin);
+        nrf_gpio_cfg_output(spi_devices[i].cs_pin);
+    }
 }
@@ -22,12 +22,41 @@
  */
 
 /**
- * Wrapper over the NRFX SPIM driver.
+ * Arbiter of the SPIM bus shared by the display, the flash and the FPGA.
+ * The bus is owned by one device at a time, from spi_chip_select() to
+ * spi_chip_deselect() in thread context, or for one transaction started with
+ * spi_xfer_async() from interrupts. The frequency, mode and bit order are set
+ * for the device at the start of every ownership. Transactions started while
+ * the bus is in use are queued, and get the bus by priority then in order,
+ * ahead of any thread waiting for it.
  */
 
+typedef enum
+{
+    SPI_DEVICE_DISPLAY,
+    SPI_DEVICE_FLASH,
+    SPI_DEVICE_FPGA,
+    SPI_DEVICE_NUM,
+} spi_device_t;
+
+typedef enum
+{
+    SPI_PRIORITY_LOW,           // Can wait, such as a camera capture command
+    SPI_PRIORITY_HIGH,          // Data lost if late, such as microphone samples
+} spi_priority_t;
+
+/**
+ * Called from the SPI interrupt once a transfer started by spi_xfer_async() completed.
+ */
+typedef void spi_callback_t(void);
+
 void spi_init(void);
 void spi_uninit(void);
-void spi_chip_select(uint8_t cs_pin);
-void spi_chip_deselect(uint8_t cs_pin);
+void spi_chip_select(spi_device_t device);
+void spi_chip_deselect(spi_device_t device);
 void spi_read(uint8_t *buf, size_t len);
 void spi_write(uint8_t *buf, size_t len);
+void spi_write_batch(spi_device_t device, uint8_t *buf, size_t len);
+bool spi_xfer_async(spi_device_t device, spi_priority_t priority,
+        uint8_t const *tx_buf, size_t tx_len, uint8_t *rx_buf, size_t rx_len,
+        spi_callback_t *callback);
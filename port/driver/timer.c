@@ -25,6 +25,8 @@
  * Wrapper around the timer interface for sharing it across drivers.
  */
 
+#define LOG_MODULE TIMER
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -63,6 +65,8 @@ static void timer_event_handler(nrf_timer_event_t event, void *ctx)
 
 /**
  * Get a pointer within the array of handlers, for modification purposes.
+ * To call with the interrupts disabled, as handlers are added and removed
+ * from interrupts too.
  * @param ptr A pointer to a function handler, or eventually NULL.
  */
 static timer_handler_t **timer_get_handler_slot(timer_handler_t *ptr)
@@ -75,18 +79,17 @@ static timer_handler_t **timer_get_handler_slot(timer_handler_t *ptr)
 
 /**
  * Remove a function from the list of timer handlers to execute.
+ * Can be called from any context.
  * @param ptr Function pointer of the timer that was previously added.
  */
 void timer_del_handler(timer_handler_t *ptr)
 {
     timer_handler_t **slot;
 
-    slot = timer_get_handler_slot(ptr);
-    if (slot == NULL)
-        return;
-
     __disable_irq();
-    *slot = NULL;
+    slot = timer_get_handler_slot(ptr);
+    if (slot != NULL)
+        *slot = NULL;
     __enable_irq();
 }
 
@@ -94,18 +97,21 @@ void timer_add_handler(timer_handler_t *ptr)
 {
     timer_handler_t **slot;
 
-    LOG("0x%p", ptr);
-
-    // Check if the timer is already configured.
-    if (timer_get_handler_slot(ptr) != NULL)
-        return;
-
-    slot = timer_get_handler_slot(NULL);
-    assert(slot != NULL); // misconfiguration of TIMER_MAX_HANDLERS
+    LOG_DEBUG("0x%p", ptr);
 
+    // Look for the handler and a free slot at once, so that one added from
+    // an interrupt does not take the slot found by the thread
     __disable_irq();
-    *slot = ptr;
+    slot = timer_get_handler_slot(ptr);
+    if (slot == NULL)
+    {
+        slot = timer_get_handler_slot(NULL);
+        if (slot != NULL)
+            *slot = ptr;
+    }
     __enable_irq();
+
+    assert(slot != NULL); // misconfiguration of TIMER_MAX_HANDLERS
 }
 
 /**
@@ -27,6 +27,8 @@
  * User interface for capacitove touch sensors.
  */
 
+#define LOG_MODULE TOUCH
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -239,7 +241,7 @@ static void touch_set_timer(touch_event_t event)
     }
 
     // Submit the configuration.
-    LOG("timer_add_handler");
+    LOG_DEBUG("timer_add_handler");
     timer_add_handler(&touch_timer_handler);
 }
 
@@ -281,7 +283,7 @@ static void touch_timer_handler(void)
         timer_del_handler(&touch_timer_handler);
 
         // Submit the event to the state machine.
-        LOG("touch_timer_event=%s",
+        LOG_DEBUG("touch_timer_event=%s",
                 touch_timer_event == TOUCH_EVENT_SHORT ? "SHORT" :
                 touch_timer_event == TOUCH_EVENT_LONG ? "LONG" :
                 "?");
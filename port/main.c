@@ -24,6 +24,8 @@
  * THE SOFTWARE.
  */
 
+#define LOG_MODULE MAIN
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -43,7 +45,9 @@
 
 #include "driver/bluetooth_low_energy.h"
 #include "driver/bluetooth_data_protocol.h"
+#include "driver/capture_queue.h"
 #include "driver/fpga.h"
+#include "driver/settings.h"
 
 /** Variable that holds the Softdevice NVIC state.  */
 nrf_nvic_state_t nrf_nvic_state = {{0}, 0};
@@ -95,6 +99,13 @@ int main(void)
     // Initialise drivers
     ble_init();
     fpga_init();
+    capture_queue_init();
+    settings_init();
+
+    // Restore the modules to log set before the last reset
+    int32_t modules;
+    if (settings_get_int("log.modules", &modules))
+        log_modules = modules;
 
     // Initialise the stack pointer for the main thread
     mp_stack_set_top(&_stack_top);
@@ -153,7 +164,7 @@ int main(void)
  */
 _Noreturn void __assert_func(const char *file, int line, const char *func, const char *expr)
 {
-    LOG("%s:%d: %s: %s", file, line, func, expr);
+    LOG_ERROR("%s:%d: %s: %s", file, line, func, expr);
     for (;;) __asm__("bkpt");
 }
 
@@ -0,0 +1,144 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2022 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "py/obj.h"
+#include "py/qstr.h"
+#include "py/runtime.h"
+
+#include "ble.h"
+
+#include "driver/bluetooth_bond.h"
+#include "driver/bluetooth_low_energy.h"
+
+/**
+ * Tell if a host is connected.
+ * @return True if connected.
+ */
+STATIC mp_obj_t bluetooth_connected(void)
+{
+    return mp_obj_new_bool(ble_is_connected());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(bluetooth_connected_obj, bluetooth_connected);
+
+/**
+ * Get the transfer statistics of a logical channel.
+ * @param channel_in One of bluetooth.REPL or MEDIA.
+ * @return A dict with the byte and packet counts and the latencies.
+ */
+STATIC mp_obj_t bluetooth_stats(mp_obj_t channel_in)
+{
+    ble_channel_stats_t stats;
+    mp_int_t channel = mp_obj_get_int(channel_in);
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    if (channel < 0 || channel >= BLE_CHANNEL_NUM)
+        mp_raise_ValueError(MP_ERROR_TEXT("channel must be bluetooth.REPL or MEDIA"));
+
+    ble_channel_get_stats(channel, &stats);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_bytes), mp_obj_new_int_from_uint(stats.bytes));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_packets), mp_obj_new_int_from_uint(stats.packets));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_latency_max_ms), mp_obj_new_int_from_uint(stats.latency_max_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_latency_avg_ms), mp_obj_new_int_from_uint(
+            stats.latency_count ? stats.latency_sum_ms / stats.latency_count : 0));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(bluetooth_stats_obj, bluetooth_stats);
+
+/**
+ * Get statistics about the connection parameters.
+ * @return A dict with the current state and parameters, and the time spent in each state.
+ */
+STATIC mp_obj_t bluetooth_conn_stats(void)
+{
+    ble_conn_stats_t stats;
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    ble_conn_get_stats(&stats);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_state), MP_OBJ_NEW_SMALL_INT(stats.state));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_interval_us), mp_obj_new_int_from_uint(stats.interval_us));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_latency), MP_OBJ_NEW_SMALL_INT(stats.latency));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_fast_ms), mp_obj_new_int_from_uint(stats.time_ms[BLE_CONN_FAST]));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_slow_ms), mp_obj_new_int_from_uint(stats.time_ms[BLE_CONN_SLOW]));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_fast_count), mp_obj_new_int_from_uint(stats.count[BLE_CONN_FAST]));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_slow_count), mp_obj_new_int_from_uint(stats.count[BLE_CONN_SLOW]));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_rejected), mp_obj_new_int_from_uint(stats.rejected));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(bluetooth_conn_stats_obj, bluetooth_conn_stats);
+
+/**
+ * Get or set how long the link must stay quiet before going to slow intervals.
+ * @param args Optional new quiet period in milliseconds.
+ * @return The quiet period in milliseconds.
+ */
+STATIC mp_obj_t bluetooth_idle_timeout(size_t n_args, const mp_obj_t *args)
+{
+    if (n_args > 0)
+    {
+        mp_int_t ms = mp_obj_get_int(args[0]);
+
+        if (ms < 0)
+            mp_raise_ValueError(MP_ERROR_TEXT("timeout must be positive"));
+        ble_conn_set_idle_ms(ms);
+    }
+    return mp_obj_new_int_from_uint(ble_conn_get_idle_ms());
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(bluetooth_idle_timeout_obj, 0, 1, bluetooth_idle_timeout);
+
+/**
+ * Forget the bonded host, which will have to pair again.
+ */
+STATIC mp_obj_t bluetooth_forget(void)
+{
+    ble_bond_clear();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(bluetooth_forget_obj, bluetooth_forget);
+
+STATIC const mp_rom_map_elem_t bluetooth_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__),            MP_ROM_QSTR(MP_QSTR_bluetooth) },
+
+    // methods
+    { MP_ROM_QSTR(MP_QSTR_connected),           MP_ROM_PTR(&bluetooth_connected_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),               MP_ROM_PTR(&bluetooth_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_conn_stats),          MP_ROM_PTR(&bluetooth_conn_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_idle_timeout),        MP_ROM_PTR(&bluetooth_idle_timeout_obj) },
+    { MP_ROM_QSTR(MP_QSTR_forget),              MP_ROM_PTR(&bluetooth_forget_obj) },
+
+    // constants
+    { MP_ROM_QSTR(MP_QSTR_REPL),                MP_OBJ_NEW_SMALL_INT(BLE_CHANNEL_REPL) },
+    { MP_ROM_QSTR(MP_QSTR_MEDIA),               MP_OBJ_NEW_SMALL_INT(BLE_CHANNEL_MEDIA) },
+    { MP_ROM_QSTR(MP_QSTR_FAST),                MP_OBJ_NEW_SMALL_INT(BLE_CONN_FAST) },
+    { MP_ROM_QSTR(MP_QSTR_SLOW),                MP_OBJ_NEW_SMALL_INT(BLE_CONN_SLOW) },
+};
+STATIC MP_DEFINE_CONST_DICT(bluetooth_module_globals, bluetooth_module_globals_table);
+
+const mp_obj_module_t bluetooth_module = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&bluetooth_module_globals,
+};
+MP_REGISTER_MODULE(MP_QSTR_bluetooth, bluetooth_module);
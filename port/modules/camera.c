@@ -21,6 +21,8 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define LOG_MODULE CAMERA
+
 #include <stddef.h>
 
 #include "py/obj.h"
@@ -28,14 +30,41 @@
 #include "py/runtime.h"
 
 #include "nrfx_log.h"
+#include "nrfx_systick.h"
 #include "nrfx_twi.h"
 
 #include "driver/fpga.h"
 #include "driver/i2c.h"
+#include "driver/jpeg.h"
 #include "driver/ov5640.h"
 #include "driver/max77654.h"
 #include "driver/config.h"
 #include "driver/bluetooth_data_protocol.h"
+#include "driver/bluetooth_low_energy.h"
+#include "driver/capture_queue.h"
+#include "driver/timer.h"
+
+#define CAMERA_FULL_WIDTH       640
+#define CAMERA_FULL_HEIGHT      400
+#define CAMERA_PREVIEW_WIDTH    160
+#define CAMERA_PREVIEW_HEIGHT   100
+
+/** Largest transfer of the SPI peripheral. */
+#define CAMERA_READ_MAX_SIZE    255
+
+/** Size of the chunks the JPEG output is grown by. */
+#define CAMERA_JPEG_CHUNK_SIZE  256
+
+/** Longest wait for the FPGA to signal the end of a capture, a few frames. */
+#define CAMERA_CAPTURE_TIMEOUT_MS   200
+
+/** Metadata of the last capture, with the white balance not sent to the host. */
+static struct
+{
+    bool valid;
+    bluetooth_data_frame_info_t info;
+    ov5640_stats_t stats;
+} camera_last_frame;
 
 STATIC mp_obj_t mod_camera___init__(void)
 {
@@ -46,30 +75,378 @@ STATIC mp_obj_t mod_camera___init__(void)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_camera___init___obj, mod_camera___init__);
 
-STATIC mp_obj_t camera_capture(void)
+/**
+ * Wait for the sensor to output a few frames, so that a new configuration,
+ * latched at the frame boundary, reaches the FPGA.
+ */
+static void camera_wait_frames(uint32_t frames)
 {
-    fpga_camera_start();
+    nrfx_systick_delay_ms(frames * 1000 / OV5640_FPS);
+}
+
+/**
+ * Get the sensor out of standby if it went idle, and let its output resume.
+ */
+static void camera_wake(void)
+{
+    if (ov5640_use())
+        camera_wait_frames(2);
+}
+
+/**
+ * Capture a frame, and wait for the FPGA to signal it complete in the capture
+ * buffer rather than polling the capture status.
+ */
+static void camera_capture_frame(void)
+{
+    fpga_event_clear(FPGA_EVENT_CAPTURE_DONE);
     fpga_camera_capture();
-    LOG("capture=0x%02X", fpga_capture_get_status());
+    if (!fpga_event_wait(FPGA_EVENT_CAPTURE_DONE, CAMERA_CAPTURE_TIMEOUT_MS))
+        LOG_WARNING("capture timeout");
+}
+
+/**
+ * Read the next bytes of the frame captured by the FPGA, raw pixels or
+ * compressed, in as many transfers as needed.
+ */
+static void camera_read_raw(uint8_t *buf, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = len < CAMERA_READ_MAX_SIZE ? len : CAMERA_READ_MAX_SIZE;
+
+        fpga_capture_get_data(buf, n);
+        buf += n;
+        len -= n;
+    }
+}
+
+/**
+ * Capture a thumbnail, and send it right away, while the full image is being
+ * captured. Skipped if the previous thumbnail is still being sent, or if it
+ * is too big.
+ */
+static void camera_capture_preview(void)
+{
+    uint8_t *buf = bluetooth_data_get_preview_buffer();
+    size_t len;
+
+    if (buf == NULL)
+        return;
+
+    ov5640_reduce_size(CAMERA_PREVIEW_WIDTH, CAMERA_PREVIEW_HEIGHT);
+    camera_wait_frames(2);
+    camera_capture_frame();
+
+    // The capture status holds the size of the capture in bytes
+    len = fpga_capture_get_status();
+    LOG_DEBUG("preview=%d", len);
+    if (len > 0 && len <= DATA_PREVIEW_MAX_SIZE)
+    {
+        camera_read_raw(buf, len);
+        bluetooth_data_set_preview(len);
+        bluetooth_data_operation(DATA_OP_CAMERA_PREVIEW);
+    }
+
+    ov5640_reduce_size(CAMERA_FULL_WIDTH, CAMERA_FULL_HEIGHT);
+    camera_wait_frames(2);
+}
+
+/**
+ * Restrict the next captures to a region of the frame, so that only that
+ * region gets transferred.
+ * @param roi Tuple (x, y, width, height) in pixels of the full frame.
+ * @param scale Factor the region gets reduced by.
+ */
+static void camera_set_roi(mp_obj_t roi, mp_int_t scale, uint16_t *width, uint16_t *height)
+{
+    mp_obj_t *items;
+    mp_int_t x, y, w, h;
+
+    mp_obj_get_array_fixed_n(roi, 4, &items);
+    x = mp_obj_get_int(items[0]);
+    y = mp_obj_get_int(items[1]);
+    w = mp_obj_get_int(items[2]);
+    h = mp_obj_get_int(items[3]);
+
+    if (x < 0 || y < 0 || w <= 0 || h <= 0 ||
+            x + w > CAMERA_FULL_WIDTH || y + h > CAMERA_FULL_HEIGHT)
+        mp_raise_ValueError(MP_ERROR_TEXT("roi must be within the 640x400 frame"));
+    if (w / scale < 2 || h / scale < 1 || (w / scale) % 2 != 0)
+        mp_raise_ValueError(MP_ERROR_TEXT("roi width divided by scale must be even"));
+
+    ov5640_set_window(x, y, w, h, w / scale, h / scale);
+    *width = w / scale;
+    *height = h / scale;
+    camera_wait_frames(2);
+}
+
+/**
+ * Record the metadata of the frame just captured, queued along with it and
+ * sent ahead of it.
+ */
+static void camera_frame_info(uint16_t width, uint16_t height, uint8_t scale)
+{
+    bluetooth_data_frame_info_t *info = &camera_last_frame.info;
+
+    info->seq = camera_last_frame.valid ? info->seq + 1 : 0;
+    info->captured_ms = timer_get_uptime_ms();
+    ov5640_get_stats(&camera_last_frame.stats);
+    info->exposure = camera_last_frame.stats.exposure;
+    info->gain = camera_last_frame.stats.gain;
+    info->luma = camera_last_frame.stats.luma;
+    info->scale = scale;
+    info->width = width;
+    info->height = height;
+    camera_last_frame.valid = true;
+}
+
+/**
+ * Keep the frame just captured in the capture queue, until the host
+ * acknowledges it. The same frame as the one queued last is not queued again.
+ */
+static void camera_queue_frame(void)
+{
+    switch (capture_queue_store(camera_read_raw, fpga_capture_get_status(), &camera_last_frame.info))
+    {
+    case CAPTURE_QUEUE_FULL:
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("capture queue full"));
+
+    case CAPTURE_QUEUE_TOO_LARGE:
+        mp_raise_ValueError(MP_ERROR_TEXT("capture too large for the queue"));
 
-    bluetooth_data_operation(DATA_OP_CAMERA_CAPTURE);
+    default:
+        break;
+    }
+}
+
+/**
+ * Capture an image and keep it in the flash, from where it is sent to the
+ * host right away, or once it can get it, such as after a disconnection.
+ * @param preview If true, a small thumbnail is sent first, for the host to
+ *        show it while the full image is being sent.
+ * @param roi Optional tuple (x, y, width, height): only capture that region
+ *        of the 640x400 frame, cropped by the sensor itself.
+ * @param scale Factor the region is reduced by, 1, 2 or 4.
+ */
+STATIC mp_obj_t camera_capture(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_preview, ARG_roi, ARG_scale };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_preview, MP_ARG_BOOL, {.u_bool = false} },
+        { MP_QSTR_roi, MP_ARG_KW_ONLY | MP_ARG_OBJ, {.u_obj = MP_OBJ_NULL} },
+        { MP_QSTR_scale, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 1} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    uint16_t width = CAMERA_FULL_WIDTH, height = CAMERA_FULL_HEIGHT;
+    mp_int_t scale;
+    bool roi;
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    roi = args[ARG_roi].u_obj != MP_OBJ_NULL && args[ARG_roi].u_obj != mp_const_none;
+    scale = args[ARG_scale].u_int;
+    if (scale != 1 && scale != 2 && scale != 4)
+        mp_raise_ValueError(MP_ERROR_TEXT("scale must be 1, 2 or 4"));
+    if (scale != 1 && !roi)
+        mp_raise_ValueError(MP_ERROR_TEXT("scale requires a roi"));
+
+    camera_wake();
+    fpga_camera_start();
+    if (args[ARG_preview].u_bool)
+        camera_capture_preview();
+    if (roi)
+        camera_set_roi(args[ARG_roi].u_obj, scale, &width, &height);
+    camera_capture_frame();
+    LOG_DEBUG("capture=%d", fpga_capture_get_status());
+    camera_frame_info(width, height, scale);
+
+    // Back to the full frame for the live view and the next captures
+    if (roi)
+    {
+        ov5640_set_window(0, 0, CAMERA_FULL_WIDTH, CAMERA_FULL_HEIGHT,
+                CAMERA_FULL_WIDTH, CAMERA_FULL_HEIGHT);
+        camera_wait_frames(2);
+    }
+
+    // Sent from the queue, so that the host gets the captures in order
+    camera_queue_frame();
+    if (ble_is_connected())
+        bluetooth_data_operation(DATA_OP_CAMERA_CAPTURE);
 
     return mp_const_none;
 }
-MP_DEFINE_CONST_FUN_OBJ_0(camera_capture_obj, &camera_capture);
+MP_DEFINE_CONST_FUN_OBJ_KW(camera_capture_obj, 0, &camera_capture);
+
+/**
+ * Capture a frame of raw YUV422 pixels and compress it on the MCU, for when
+ * the FPGA does not compress the frames itself.
+ * @param quality From 1 to 100, as with most JPEG encoders.
+ * @return The JPEG file as bytes.
+ */
+STATIC mp_obj_t camera_jpeg(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_quality };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_quality, MP_ARG_INT, {.u_int = 50} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    jpeg_t *jpeg;
+    uint8_t *rows;
+    vstr_t vstr;
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    if (args[ARG_quality].u_int < 1 || args[ARG_quality].u_int > 100)
+        mp_raise_ValueError(MP_ERROR_TEXT("quality must be between 1 and 100"));
+
+    jpeg = m_new_obj(jpeg_t);
+    rows = m_new(uint8_t, JPEG_ROWS_SIZE(CAMERA_FULL_WIDTH));
+    vstr_init(&vstr, CAMERA_JPEG_CHUNK_SIZE);
+
+    camera_wake();
+    fpga_camera_start();
+    camera_capture_frame();
+
+    jpeg_init(jpeg, CAMERA_FULL_WIDTH, CAMERA_FULL_HEIGHT, args[ARG_quality].u_int,
+            camera_read_raw, rows);
+    while (!jpeg_is_done(jpeg))
+    {
+        uint8_t *buf = (uint8_t *)vstr_add_len(&vstr, CAMERA_JPEG_CHUNK_SIZE);
+
+        vstr.len -= CAMERA_JPEG_CHUNK_SIZE - jpeg_encode(jpeg, buf, CAMERA_JPEG_CHUNK_SIZE);
+    }
+    LOG_DEBUG("jpeg=%d", vstr.len);
+
+    m_del(uint8_t, rows, JPEG_ROWS_SIZE(CAMERA_FULL_WIDTH));
+    m_del_obj(jpeg_t, jpeg);
+    return mp_obj_new_bytes_from_vstr(&vstr);
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(camera_jpeg_obj, 0, &camera_jpeg);
+
+/**
+ * Get the metadata of the last capture, also sent to the host ahead of it.
+ * @return A dict with the sequence number, the capture time, the exposure,
+ *         gain and white balance of the sensor, the average luminance, and
+ *         the size of the frame, or None if nothing was captured yet.
+ */
+STATIC mp_obj_t camera_last_frame_info(void)
+{
+    bluetooth_data_frame_info_t const *info = &camera_last_frame.info;
+    ov5640_stats_t const *stats = &camera_last_frame.stats;
+    mp_obj_t dict;
+    mp_obj_t awb[3];
+
+    if (!camera_last_frame.valid)
+        return mp_const_none;
+
+    awb[0] = MP_OBJ_NEW_SMALL_INT(stats->awb_red);
+    awb[1] = MP_OBJ_NEW_SMALL_INT(stats->awb_green);
+    awb[2] = MP_OBJ_NEW_SMALL_INT(stats->awb_blue);
+
+    dict = mp_obj_new_dict(0);
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_seq), MP_OBJ_NEW_SMALL_INT(info->seq));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_time_ms), mp_obj_new_int_from_uint(info->captured_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_exposure), mp_obj_new_int_from_uint(info->exposure));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_gain), MP_OBJ_NEW_SMALL_INT(info->gain));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_awb), mp_obj_new_tuple(3, awb));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_luma), MP_OBJ_NEW_SMALL_INT(info->luma));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_scale), MP_OBJ_NEW_SMALL_INT(info->scale));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_width), MP_OBJ_NEW_SMALL_INT(info->width));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_height), MP_OBJ_NEW_SMALL_INT(info->height));
+    return dict;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(camera_last_frame_info_obj, &camera_last_frame_info);
 
 STATIC mp_obj_t camera_live(void)
 {
+    ov5640_hold(true);
+    fpga_batch_begin();
     fpga_camera_start();
     fpga_live_video_start();
     fpga_live_video_replay();
+    fpga_batch_flush();
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_0(camera_live_obj, &camera_live);
 
+/**
+ * Stream the newest frames to the host, dropping those it has no time for.
+ * @param fps Frames per second to capture.
+ */
+STATIC mp_obj_t camera_stream(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_fps };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_fps, MP_ARG_INT, {.u_int = 10} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    if (args[ARG_fps].u_int < 1 || args[ARG_fps].u_int > 30)
+        mp_raise_ValueError(MP_ERROR_TEXT("fps must be between 1 and 30"));
+
+    bluetooth_data_stream_period(1000 / args[ARG_fps].u_int);
+    ov5640_hold(true);
+    fpga_camera_start();
+    if (!bluetooth_data_operation(DATA_OP_CAMERA_STREAM))
+    {
+        ov5640_hold(false);
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("another transfer is in progress"));
+    }
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_KW(camera_stream_obj, 0, &camera_stream);
+
+/**
+ * Get the statistics of the last stream.
+ * @return A dict with the frames captured, sent and dropped, the achieved
+ *         frame rate, the latency of the last frame, the captures whose end
+ *         the FPGA did not signal, and the frames too large to be sent.
+ */
+STATIC mp_obj_t camera_stream_stats(void)
+{
+    bluetooth_data_stream_stats_t stats;
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    bluetooth_data_stream_stats(&stats);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_captured), mp_obj_new_int_from_uint(stats.captured));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_sent), mp_obj_new_int_from_uint(stats.sent));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_dropped), mp_obj_new_int_from_uint(stats.dropped));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_capture_timeouts), mp_obj_new_int_from_uint(stats.capture_timeouts));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_oversized), mp_obj_new_int_from_uint(stats.oversized));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_latency_ms), mp_obj_new_int_from_uint(stats.latency_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_fps), mp_obj_new_float(
+            stats.elapsed_ms ? stats.sent * 1000.0f / stats.elapsed_ms : 0.0f));
+    return dict;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(camera_stream_stats_obj, &camera_stream_stats);
+
+/**
+ * Get the counters of the capture queue, which keeps the frames captured
+ * while the host cannot get them, until it acknowledged them.
+ * @return Dict of the frames pending, and since the start: stored, delivered,
+ *         duplicates of the previous one not stored, and dropped for lack of room.
+ */
+STATIC mp_obj_t camera_queue_stats(void)
+{
+    capture_queue_stats_t stats = capture_queue_get_stats();
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_pending), mp_obj_new_int_from_uint(stats.pending));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_stored), mp_obj_new_int_from_uint(stats.stored));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_delivered), mp_obj_new_int_from_uint(stats.delivered));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_duplicates), mp_obj_new_int_from_uint(stats.duplicates));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_dropped), mp_obj_new_int_from_uint(stats.dropped));
+    return dict;
+}
+MP_DEFINE_CONST_FUN_OBJ_0(camera_queue_stats_obj, &camera_queue_stats);
+
 STATIC mp_obj_t camera_stop(void)
 {
     fpga_camera_stop();
+    bluetooth_data_operation(DATA_OP_CAMERA_STOP);
+    ov5640_hold(false);
     return mp_const_none;
 }
 MP_DEFINE_CONST_FUN_OBJ_0(camera_stop_obj, &camera_stop);
@@ -80,8 +457,13 @@ STATIC const mp_rom_map_elem_t camera_module_globals_table[] = {
 
     // methods
     { MP_ROM_QSTR(MP_QSTR_capture),     MP_ROM_PTR(&camera_capture_obj) },
+    { MP_ROM_QSTR(MP_QSTR_jpeg),        MP_ROM_PTR(&camera_jpeg_obj) },
+    { MP_ROM_QSTR(MP_QSTR_last_frame_info), MP_ROM_PTR(&camera_last_frame_info_obj) },
     { MP_ROM_QSTR(MP_QSTR_stop),        MP_ROM_PTR(&camera_stop_obj) },
     { MP_ROM_QSTR(MP_QSTR_live),        MP_ROM_PTR(&camera_live_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream),      MP_ROM_PTR(&camera_stream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stream_stats), MP_ROM_PTR(&camera_stream_stats_obj) },
+    { MP_ROM_QSTR(MP_QSTR_queue_stats), MP_ROM_PTR(&camera_queue_stats_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(camera_module_globals, camera_module_globals_table);
 
@@ -26,6 +26,7 @@
  * THE SOFTWARE.
  */
 #include <stdio.h>
+#include <string.h>
 
 #include "py/gc.h"
 #include "py/runtime.h"
@@ -33,6 +34,7 @@
 #include "py/objstr.h"
 #include "genhdr/mpversion.h"
 
+#include "nrfx_log.h"
 #include "nrfx_reset_reason.h"
 
 #include "lib/oofatfs/ff.h"
@@ -40,6 +42,7 @@
 
 #include "driver/dfu.h"
 #include "driver/battery.h"
+#include "driver/settings.h"
 #include "ble_gap.h"
 
 /** Current version as a string object. */
@@ -60,6 +63,7 @@ STATIC mp_obj_t mod_device___init__(void)
 
     // dependencies:
     battery_init();
+    settings_init();
 
     if (state & POWER_RESETREAS_RESETPIN_Msk)
     {
@@ -140,6 +144,243 @@ STATIC mp_obj_t device_reset_cause(void)
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(device_reset_cause_obj, device_reset_cause);
 
+/**
+ * Get or set the modules that log to RTT, one bit each in the order of
+ * log_id_t, kept across resets. Their errors are always logged.
+ */
+STATIC mp_obj_t device_log_modules(size_t n_args, const mp_obj_t *args)
+{
+    if (n_args == 0)
+        return mp_obj_new_int_from_uint(log_modules);
+
+    log_modules = mp_obj_get_int_truncated(args[0]) & LOG_MODULES_ALL;
+    settings_set_int("log.modules", log_modules);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(device_log_modules_obj, 0, 1, device_log_modules);
+
+STATIC size_t device_settings_key(mp_obj_t key_in, char const **key)
+{
+    size_t len;
+
+    *key = mp_obj_str_get_data(key_in, &len);
+    if (len == 0 || len > SETTINGS_KEY_MAX_LEN)
+        mp_raise_ValueError(MP_ERROR_TEXT("setting names are 1 to 15 bytes long"));
+    return len;
+}
+
+STATIC mp_obj_t device_settings_load(mp_obj_t key_in)
+{
+    uint8_t buf[SETTINGS_VALUE_MAX_LEN];
+    size_t len = sizeof buf;
+    char const *key;
+    size_t key_len = device_settings_key(key_in, &key);
+
+    if (!settings_get(key, key_len, buf, &len) || len == 0)
+        return MP_OBJ_NULL;
+
+    switch (buf[0])
+    {
+        case SETTINGS_TYPE_NONE:
+            return mp_const_none;
+        case SETTINGS_TYPE_BOOL:
+            return mp_obj_new_bool(buf[1]);
+        case SETTINGS_TYPE_INT:
+        {
+            int32_t i;
+            memcpy(&i, buf + 1, sizeof i);
+            return mp_obj_new_int(i);
+        }
+        case SETTINGS_TYPE_FLOAT:
+        {
+            float f;
+            memcpy(&f, buf + 1, sizeof f);
+            return mp_obj_new_float(f);
+        }
+        case SETTINGS_TYPE_STR:
+            return mp_obj_new_str((char *)buf + 1, len - 1);
+        case SETTINGS_TYPE_BYTES:
+            return mp_obj_new_bytes(buf + 1, len - 1);
+    }
+    return MP_OBJ_NULL;
+}
+
+STATIC void device_settings_store(mp_obj_t key_in, mp_obj_t value)
+{
+    uint8_t buf[SETTINGS_VALUE_MAX_LEN];
+    size_t len = 1;
+    char const *key;
+    size_t key_len = device_settings_key(key_in, &key);
+
+    if (value == mp_const_none)
+    {
+        buf[0] = SETTINGS_TYPE_NONE;
+    }
+    else if (mp_obj_is_bool(value))
+    {
+        buf[0] = SETTINGS_TYPE_BOOL;
+        buf[len++] = value == mp_const_true;
+    }
+    else if (mp_obj_is_int(value))
+    {
+        int32_t i = mp_obj_get_int(value);
+
+        buf[0] = SETTINGS_TYPE_INT;
+        memcpy(buf + len, &i, sizeof i);
+        len += sizeof i;
+    }
+    else if (mp_obj_is_float(value))
+    {
+        float f = mp_obj_get_float(value);
+
+        buf[0] = SETTINGS_TYPE_FLOAT;
+        memcpy(buf + len, &f, sizeof f);
+        len += sizeof f;
+    }
+    else
+    {
+        mp_buffer_info_t info;
+
+        buf[0] = mp_obj_is_str(value) ? SETTINGS_TYPE_STR : SETTINGS_TYPE_BYTES;
+        mp_get_buffer_raise(value, &info, MP_BUFFER_READ);
+        if (info.len > sizeof buf - 1)
+            mp_raise_ValueError(MP_ERROR_TEXT("setting values are up to 127 bytes long"));
+        memcpy(buf + len, info.buf, info.len);
+        len += info.len;
+    }
+
+    if (!settings_set(key, key_len, buf, len))
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("too many settings"));
+}
+
+/**
+ * Settings saved to the flash, kept across resets, such as
+ * device.settings["name"] = value.
+ * The values can be None, bool, int, float, str or bytes.
+ */
+STATIC mp_obj_t device_settings_subscr(mp_obj_t self_in, mp_obj_t key_in, mp_obj_t value)
+{
+    mp_obj_t obj;
+    char const *key;
+
+    if (value == MP_OBJ_SENTINEL)
+    {
+        obj = device_settings_load(key_in);
+        if (obj == MP_OBJ_NULL)
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_KeyError, key_in));
+        return obj;
+    }
+    if (value == MP_OBJ_NULL)
+    {
+        size_t key_len = device_settings_key(key_in, &key);
+
+        if (!settings_delete(key, key_len))
+            nlr_raise(mp_obj_new_exception_arg1(&mp_type_KeyError, key_in));
+        return mp_const_none;
+    }
+    device_settings_store(key_in, value);
+    return mp_const_none;
+}
+
+STATIC mp_obj_t device_settings_keys(mp_obj_t self_in)
+{
+    size_t n = settings_count();
+    mp_obj_t list = mp_obj_new_list(0, NULL);
+    char key[SETTINGS_KEY_MAX_LEN];
+
+    for (size_t i = 0; i < n; i++)
+    {
+        size_t len = settings_key(i, key);
+        mp_obj_list_append(list, mp_obj_new_str(key, len));
+    }
+    return list;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(device_settings_keys_obj, device_settings_keys);
+
+STATIC mp_obj_t device_settings_get(size_t n_args, const mp_obj_t *args)
+{
+    mp_obj_t obj = device_settings_load(args[1]);
+
+    if (obj == MP_OBJ_NULL)
+        return n_args > 2 ? args[2] : mp_const_none;
+    return obj;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_VAR_BETWEEN(device_settings_get_obj, 2, 3, device_settings_get);
+
+/**
+ * @return A dict with the number of keys, the bytes they use in the flash,
+ *         and the records written and sectors erased since the start.
+ */
+STATIC mp_obj_t device_settings_stats(mp_obj_t self_in)
+{
+    settings_stats_t stats = settings_get_stats();
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_keys), mp_obj_new_int_from_uint(stats.keys));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_used), mp_obj_new_int_from_uint(stats.used));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_writes), mp_obj_new_int_from_uint(stats.writes));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_erases), mp_obj_new_int_from_uint(stats.erases));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_1(device_settings_stats_obj, device_settings_stats);
+
+STATIC mp_obj_t device_settings_unary_op(mp_unary_op_t op, mp_obj_t self_in)
+{
+    switch (op)
+    {
+        case MP_UNARY_OP_BOOL:
+            return mp_obj_new_bool(settings_count() > 0);
+        case MP_UNARY_OP_LEN:
+            return MP_OBJ_NEW_SMALL_INT(settings_count());
+        default:
+            return MP_OBJ_NULL;
+    }
+}
+
+STATIC mp_obj_t device_settings_getiter(mp_obj_t self_in, mp_obj_iter_buf_t *iter_buf)
+{
+    return mp_getiter(device_settings_keys(self_in), iter_buf);
+}
+
+STATIC void device_settings_print(const mp_print_t *print, mp_obj_t self_in, mp_print_kind_t kind)
+{
+    mp_obj_t keys = device_settings_keys(self_in);
+    size_t n;
+    mp_obj_t *items;
+
+    mp_obj_list_get(keys, &n, &items);
+    mp_print_str(print, "{");
+    for (size_t i = 0; i < n; i++)
+    {
+        if (i > 0)
+            mp_print_str(print, ", ");
+        mp_obj_print_helper(print, items[i], PRINT_REPR);
+        mp_print_str(print, ": ");
+        mp_obj_print_helper(print, device_settings_load(items[i]), PRINT_REPR);
+    }
+    mp_print_str(print, "}");
+}
+
+STATIC const mp_rom_map_elem_t device_settings_locals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR_keys),                MP_ROM_PTR(&device_settings_keys_obj) },
+    { MP_ROM_QSTR(MP_QSTR_get),                 MP_ROM_PTR(&device_settings_get_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),               MP_ROM_PTR(&device_settings_stats_obj) },
+};
+STATIC MP_DEFINE_CONST_DICT(device_settings_locals, device_settings_locals_table);
+
+STATIC MP_DEFINE_CONST_OBJ_TYPE(
+    device_settings_type,
+    MP_QSTR_Settings,
+    MP_TYPE_FLAG_ITER_IS_GETITER,
+    print, device_settings_print,
+    unary_op, device_settings_unary_op,
+    subscr, device_settings_subscr,
+    iter, device_settings_getiter,
+    locals_dict, &device_settings_locals
+);
+
+STATIC const mp_obj_base_t device_settings_obj = { &device_settings_type };
+
 STATIC const mp_rom_map_elem_t device_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___name__),            MP_ROM_QSTR(MP_QSTR_device) },
     { MP_ROM_QSTR(MP_QSTR___init__),            MP_ROM_PTR(&mod_device___init___obj) },
@@ -150,6 +391,8 @@ STATIC const mp_rom_map_elem_t device_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR_battery_level),       MP_ROM_PTR(&device_battery_level_obj) },
     { MP_ROM_QSTR(MP_QSTR_reset),               MP_ROM_PTR(&device_reset_obj) },
     { MP_ROM_QSTR(MP_QSTR_reset_cause),         MP_ROM_PTR(&device_reset_cause_obj) },
+    { MP_ROM_QSTR(MP_QSTR_settings),            MP_ROM_PTR(&device_settings_obj) },
+    { MP_ROM_QSTR(MP_QSTR_log_modules),         MP_ROM_PTR(&device_log_modules_obj) },
 
     // constants
     { MP_ROM_QSTR(MP_QSTR_GIT_TAG),             MP_ROM_PTR(&device_git_tag_obj) },
@@ -22,6 +22,7 @@
  */
 
 #include <stddef.h>
+#include <string.h>
 
 #include "py/obj.h"
 #include "py/objarray.h"
@@ -32,32 +33,277 @@
 #include "driver/bluetooth_data_protocol.h"
 #include "driver/config.h"
 #include "driver/ecx336cn.h"
+#include "driver/flash.h"
+#include "driver/font.h"
 #include "driver/fpga.h"
+#include "driver/frame.h"
+#include "driver/graphics.h"
 #include "driver/max77654.h"
 #include "driver/spi.h"
 
+STATIC void display_font_read(uint32_t addr, uint8_t *buf, size_t len)
+{
+    flash_read(FLASH_FONTS_ADDR + addr, buf, len);
+}
+
 STATIC mp_obj_t mod_display___init__(void)
 {
     // dependencies:
     ecx336cn_init();
+    flash_init();
+    frame_init();
+
+    MP_STATE_PORT(display_frame_callback) = mp_const_none;
+
+    font_init(display_font_read);
+
+    // Start from transparent buffers, whichever one clear acts on.
+    fpga_graphics_clear();
+    fpga_graphics_swap_buffer();
+    fpga_graphics_clear();
+    graphics_cleared();
 
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_display___init___obj, mod_display___init__);
 
+/**
+ * Raise an exception if the display list could not take one more item.
+ */
+STATIC mp_obj_t display_check(bool ok)
+{
+    if (!ok)
+        mp_raise_msg(&mp_type_MemoryError, MP_ERROR_TEXT("too many items on the display, call display.clear()"));
+    return mp_const_none;
+}
+
+STATIC mp_obj_t display_clear(void)
+{
+    graphics_clear();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(display_clear_obj, &display_clear);
+
+STATIC mp_obj_t display_rect(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_x, ARG_y, ARG_width, ARG_height, ARG_color, ARG_layer };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_y, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_width, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_height, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_color, MP_ARG_INT, {.u_int = 0xFF} },
+        { MP_QSTR_layer, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    return display_check(graphics_rect(args[ARG_x].u_int, args[ARG_y].u_int,
+            args[ARG_width].u_int, args[ARG_height].u_int,
+            args[ARG_color].u_int, args[ARG_layer].u_int));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_rect_obj, 4, &display_rect);
+
+STATIC mp_obj_t display_line(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_x0, ARG_y0, ARG_x1, ARG_y1, ARG_color, ARG_layer };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_x0, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_y0, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_x1, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_y1, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_color, MP_ARG_INT, {.u_int = 0xFF} },
+        { MP_QSTR_layer, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    return display_check(graphics_line(args[ARG_x0].u_int, args[ARG_y0].u_int,
+            args[ARG_x1].u_int, args[ARG_y1].u_int,
+            args[ARG_color].u_int, args[ARG_layer].u_int));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_line_obj, 4, &display_line);
+
+STATIC mp_obj_t display_text(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_string, ARG_x, ARG_y, ARG_color, ARG_font, ARG_layer };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_string, MP_ARG_REQUIRED | MP_ARG_OBJ },
+        { MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_y, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_color, MP_ARG_INT, {.u_int = 0xFF} },
+        { MP_QSTR_font, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+        { MP_QSTR_layer, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_int_t font;
+    char const *str;
+    size_t len;
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    str = mp_obj_str_get_data(args[ARG_string].u_obj, &len);
+    font = args[ARG_font].u_int;
+    if (font < 0 || font > FONT_MAX || (font > 0 && font_line_height(font - 1) == 0))
+        mp_raise_ValueError(MP_ERROR_TEXT("no such font, see display.font_write()"));
+    return display_check(graphics_text(args[ARG_x].u_int, args[ARG_y].u_int, str, len,
+            args[ARG_color].u_int, font, args[ARG_layer].u_int));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_text_obj, 3, &display_text);
+
+STATIC mp_obj_t display_bitmap(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_x, ARG_y, ARG_width, ARG_height, ARG_data, ARG_layer };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_x, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_y, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_width, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_height, MP_ARG_REQUIRED | MP_ARG_INT },
+        { MP_QSTR_data, MP_ARG_REQUIRED | MP_ARG_OBJ },
+        { MP_QSTR_layer, MP_ARG_KW_ONLY | MP_ARG_INT, {.u_int = 0} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+    mp_buffer_info_t bufinfo;
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    mp_get_buffer_raise(args[ARG_data].u_obj, &bufinfo, MP_BUFFER_READ);
+    if (args[ARG_width].u_int <= 0 || args[ARG_height].u_int <= 0
+      || bufinfo.len != (size_t)(args[ARG_width].u_int * args[ARG_height].u_int))
+        mp_raise_ValueError(MP_ERROR_TEXT("data must hold width * height bytes"));
+    return display_check(graphics_bitmap(args[ARG_x].u_int, args[ARG_y].u_int,
+            args[ARG_width].u_int, args[ARG_height].u_int,
+            bufinfo.buf, args[ARG_layer].u_int));
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_bitmap_obj, 5, &display_bitmap);
+
+/**
+ * Write a part of a font atlas made with tools/font_atlas.py to the flash,
+ * the sectors being erased as they get written from their start.
+ * @param font Number of the font, from 1 to FONT_MAX.
+ * @param offset Position of the data in the atlas, multiple of the flash page size.
+ * @param data Content of the atlas.
+ */
+STATIC mp_obj_t display_font_write(mp_obj_t font_in, mp_obj_t offset_in, mp_obj_t data_in)
+{
+    mp_int_t font = mp_obj_get_int(font_in);
+    mp_int_t offset = mp_obj_get_int(offset_in);
+    mp_buffer_info_t bufinfo;
+    uint8_t page[FLASH_PAGE_SIZE];
+    uint32_t addr;
+
+    mp_get_buffer_raise(data_in, &bufinfo, MP_BUFFER_READ);
+    if (font < 1 || font > FONT_MAX)
+        mp_raise_ValueError(MP_ERROR_TEXT("font must be between 1 and 8"));
+    if (offset < 0 || offset % FLASH_PAGE_SIZE != 0 || offset + bufinfo.len > FONT_SLOT_SIZE)
+        mp_raise_ValueError(MP_ERROR_TEXT("offset must be a multiple of 256 within the font"));
+
+    addr = FLASH_FONTS_ADDR + (font - 1) * FONT_SLOT_SIZE + offset;
+    for (size_t i = 0; i < bufinfo.len; i += FLASH_PAGE_SIZE, addr += FLASH_PAGE_SIZE)
+    {
+        size_t len = MIN(bufinfo.len - i, FLASH_PAGE_SIZE);
+
+        if (addr % FLASH_SECTOR_SIZE == 0)
+            flash_erase_sector(addr);
+        memset(page, 0xFF, sizeof page);
+        memcpy(page, (uint8_t *)bufinfo.buf + i, len);
+        flash_program_page(addr, page);
+    }
+
+    font_flush();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_3(display_font_write_obj, &display_font_write);
+
+STATIC mp_obj_t display_font_stats(void)
+{
+    font_stats_t stats = font_get_stats();
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_hits), mp_obj_new_int_from_uint(stats.hits));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_misses), mp_obj_new_int_from_uint(stats.misses));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(display_font_stats_obj, &display_font_stats);
+
+STATIC void display_write(uint32_t base, uint8_t *buf, size_t len)
+{
+    fpga_graphics_set_write_base(base);
+    fpga_graphics_write_data(buf, len);
+}
+
+/**
+ * Only the tiles that changed since the last time the back buffer was
+ * written get sent to the FPGA, once the previous frame is on the display,
+ * their rows queued in batches of commands.
+ * @return The number of tiles sent.
+ */
 STATIC mp_obj_t display_show(void)
 {
-    uint8_t buf[128];
+    size_t written;
 
-    memset(buf, 0x55, sizeof buf);
+    frame_wait();
+    fpga_batch_begin();
     fpga_graphics_on();
-    fpga_graphics_set_write_base(0x0000);
-    fpga_graphics_write_data(buf, sizeof buf);
-    fpga_graphics_swap_buffer();
-    return mp_const_none;
+    written = graphics_render(display_write);
+    fpga_batch_flush();
+    frame_swap();
+    return MP_OBJ_NEW_SMALL_INT(written);
 }
 MP_DEFINE_CONST_FUN_OBJ_0(display_show_obj, &display_show);
 
+/**
+ * Overriding the default callback implemented in driver/frame.c
+ * @param seq Number of the frame to draw.
+ */
+void frame_callback(uint32_t seq)
+{
+    if (MP_STATE_PORT(display_frame_callback) != mp_const_none)
+        mp_sched_schedule(MP_STATE_PORT(display_frame_callback), MP_OBJ_NEW_SMALL_INT(seq));
+}
+
+/**
+ * Call a function at a steady rate to draw the next frame, which should end
+ * with display.show(). The frames not shown by the next deadline are counted
+ * as missed in display.frame_stats().
+ * @param callback Function called with the number of the frame, or None to stop.
+ * @param fps Frames per second to aim for.
+ */
+STATIC mp_obj_t display_on_frame(size_t n_args, const mp_obj_t *pos_args, mp_map_t *kw_args)
+{
+    enum { ARG_callback, ARG_fps };
+    static const mp_arg_t allowed_args[] = {
+        { MP_QSTR_callback, MP_ARG_REQUIRED | MP_ARG_OBJ },
+        { MP_QSTR_fps, MP_ARG_INT, {.u_int = 30} },
+    };
+    mp_arg_val_t args[MP_ARRAY_SIZE(allowed_args)];
+
+    mp_arg_parse_all(n_args, pos_args, kw_args, MP_ARRAY_SIZE(allowed_args), allowed_args, args);
+    if (args[ARG_fps].u_int < 1 || args[ARG_fps].u_int > 60)
+        mp_raise_ValueError(MP_ERROR_TEXT("fps must be between 1 and 60"));
+
+    frame_stop();
+    MP_STATE_PORT(display_frame_callback) = args[ARG_callback].u_obj;
+    if (MP_STATE_PORT(display_frame_callback) != mp_const_none)
+        frame_start(1000 / args[ARG_fps].u_int);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_KW(display_on_frame_obj, 1, &display_on_frame);
+
+STATIC mp_obj_t display_frame_stats(void)
+{
+    frame_stats_t stats = frame_get_stats();
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_frames), mp_obj_new_int_from_uint(stats.frames));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_missed), mp_obj_new_int_from_uint(stats.missed));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_fps), MP_OBJ_NEW_SMALL_INT(stats.fps));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_frame_time_ms), MP_OBJ_NEW_SMALL_INT(stats.frame_time_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_frame_time_max_ms), MP_OBJ_NEW_SMALL_INT(stats.frame_time_max_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_swap_latency_ms), MP_OBJ_NEW_SMALL_INT(stats.swap_latency_ms));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_swap_timeouts), mp_obj_new_int_from_uint(stats.swap_timeouts));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(display_frame_stats_obj, &display_frame_stats);
+
 STATIC mp_obj_t display_brightness(mp_obj_t brightness_in)
 {
     uint32_t brightness = mp_obj_get_int(brightness_in);
@@ -81,7 +327,16 @@ STATIC const mp_rom_map_elem_t display_module_globals_table[] = {
     { MP_ROM_QSTR(MP_QSTR___init__),    MP_ROM_PTR(&mod_display___init___obj) },
 
     // methods
+    { MP_ROM_QSTR(MP_QSTR_clear),       MP_ROM_PTR(&display_clear_obj) },
+    { MP_ROM_QSTR(MP_QSTR_rect),        MP_ROM_PTR(&display_rect_obj) },
+    { MP_ROM_QSTR(MP_QSTR_line),        MP_ROM_PTR(&display_line_obj) },
+    { MP_ROM_QSTR(MP_QSTR_text),        MP_ROM_PTR(&display_text_obj) },
+    { MP_ROM_QSTR(MP_QSTR_bitmap),      MP_ROM_PTR(&display_bitmap_obj) },
+    { MP_ROM_QSTR(MP_QSTR_font_write),  MP_ROM_PTR(&display_font_write_obj) },
+    { MP_ROM_QSTR(MP_QSTR_font_stats),  MP_ROM_PTR(&display_font_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_show),        MP_ROM_PTR(&display_show_obj) },
+    { MP_ROM_QSTR(MP_QSTR_on_frame),    MP_ROM_PTR(&display_on_frame_obj) },
+    { MP_ROM_QSTR(MP_QSTR_frame_stats), MP_ROM_PTR(&display_frame_stats_obj) },
     { MP_ROM_QSTR(MP_QSTR_brightness),  MP_ROM_PTR(&display_brightness_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(display_module_globals, display_module_globals_table);
@@ -91,3 +346,6 @@ const mp_obj_module_t display_module = {
     .globals = (mp_obj_dict_t*)&display_module_globals,
 };
 MP_REGISTER_MODULE(MP_QSTR_display, display_module);
+
+// Kept alive by the garbage collector, which only scans the stack and the root pointers
+MP_REGISTER_ROOT_POINTER(mp_obj_t display_frame_callback);
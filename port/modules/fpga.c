@@ -61,10 +61,10 @@ STATIC mp_obj_t fpga_read(mp_obj_t addr_in, mp_obj_t len_in)
     mp_obj_t return_list = mp_obj_new_list(0, NULL);
 
     // Read on the SPI using the command and address given
-    spi_chip_select(SPI_FPGA_CS_PIN);
+    spi_chip_select(SPI_DEVICE_FPGA);
     spi_write_u16(addr);
     spi_read(out_data, len);
-    spi_chip_deselect(SPI_FPGA_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_FPGA);
 
     // Copy the read bytes into the list object
     for (size_t i = 0; i < len; i++)
@@ -98,10 +98,10 @@ STATIC mp_obj_t fpga_write(mp_obj_t addr_in, mp_obj_t list_in)
         in_data[i] = mp_obj_get_int(list[i]);
     }
 
-    spi_chip_select(SPI_FPGA_CS_PIN);
+    spi_chip_select(SPI_DEVICE_FPGA);
     spi_write_u16(addr);
     spi_write(in_data, len);
-    spi_chip_deselect(SPI_FPGA_CS_PIN);
+    spi_chip_deselect(SPI_DEVICE_FPGA);
 
     // Free the temporary buffer
     m_free(in_data);
@@ -110,6 +110,60 @@ STATIC mp_obj_t fpga_write(mp_obj_t addr_in, mp_obj_t list_in)
 }
 MP_DEFINE_CONST_FUN_OBJ_2(fpga_write_obj, &fpga_write);
 
+/**
+ * Parse one command of a batch: the address alone, or a tuple of the address
+ * and the list of bytes to write.
+ */
+STATIC size_t fpga_batch_parse(mp_obj_t item, uint16_t *addr, uint8_t *buf)
+{
+    mp_obj_t *pair;
+    mp_obj_t *list = NULL;
+    size_t len = 0;
+
+    if (mp_obj_is_int(item))
+    {
+        *addr = mp_obj_get_int(item);
+        return 0;
+    }
+
+    mp_obj_get_array_fixed_n(item, 2, &pair);
+    *addr = mp_obj_get_int(pair[0]);
+    mp_obj_get_array(pair[1], &len, &list);
+    if (len > FPGA_BATCH_SIZE - 3)
+        mp_raise_ValueError(MP_ERROR_TEXT("command too long for a batch"));
+    for (size_t i = 0; i < len; i++)
+        buf[i] = mp_obj_get_int(list[i]);
+    return len;
+}
+
+/**
+ * Send several commands back to back, without any other transfer between.
+ * They are all checked before sending any, so that none is sent on error.
+ * @param commands List of addresses, or of tuples (address, [bytes]).
+ */
+STATIC mp_obj_t fpga_batch(mp_obj_t commands_in)
+{
+    uint8_t buf[FPGA_BATCH_SIZE];
+    mp_obj_t *commands;
+    uint16_t addr;
+    size_t n, len;
+
+    mp_obj_get_array(commands_in, &n, &commands);
+    for (size_t i = 0; i < n; i++)
+        fpga_batch_parse(commands[i], &addr, buf);
+
+    fpga_batch_begin();
+    for (size_t i = 0; i < n; i++)
+    {
+        len = fpga_batch_parse(commands[i], &addr, buf);
+        fpga_write(addr, buf, len);
+    }
+    fpga_batch_flush();
+
+    return mp_const_none;
+}
+MP_DEFINE_CONST_FUN_OBJ_1(fpga_batch_obj, &fpga_batch);
+
 STATIC mp_obj_t fpga_status(void)
 {
     return MP_OBJ_NEW_SMALL_INT(fpga_system_id());
@@ -123,6 +177,7 @@ STATIC const mp_rom_map_elem_t fpga_module_globals_table[] = {
     // methods
     { MP_ROM_QSTR(MP_QSTR_write),       MP_ROM_PTR(&fpga_write_obj) },
     { MP_ROM_QSTR(MP_QSTR_read),        MP_ROM_PTR(&fpga_read_obj) },
+    { MP_ROM_QSTR(MP_QSTR_batch),       MP_ROM_PTR(&fpga_batch_obj) },
     { MP_ROM_QSTR(MP_QSTR_status),      MP_ROM_PTR(&fpga_status_obj) },
 };
 STATIC MP_DEFINE_CONST_DICT(fpga_module_globals, fpga_module_globals_table);
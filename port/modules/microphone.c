@@ -0,0 +1,105 @@
+/*
+ * This file is part of the MicroPython for Monocle:
+ *      https://github.com/Itsbrilliantlabs/monocle-micropython
+ *
+ * ISC Licence
+ *
+ * Copyright © 2023 Brilliant Labs Inc.
+ *
+ * Permission to use, copy, modify, and/or distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES WITH
+ * REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY
+ * AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT,
+ * INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM
+ * LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR
+ * OTHER TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR
+ * PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#include "py/obj.h"
+#include "py/qstr.h"
+#include "py/runtime.h"
+
+#include "driver/bluetooth_data_protocol.h"
+#include "driver/microphone.h"
+
+STATIC mp_obj_t mod_microphone___init__(void)
+{
+    // dependencies:
+    microphone_init();
+
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(mod_microphone___init___obj, mod_microphone___init__);
+
+/**
+ * Start streaming compressed audio over the media channel.
+ */
+STATIC mp_obj_t microphone_stream(void)
+{
+    if (!bluetooth_data_operation(DATA_OP_MICROPHONE_STREAM))
+        mp_raise_msg(&mp_type_OSError, MP_ERROR_TEXT("another transfer is in progress"));
+
+    microphone_start();
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(microphone_stream_obj, microphone_stream);
+
+/**
+ * Stop the audio stream.
+ */
+STATIC mp_obj_t microphone_stop_stream(void)
+{
+    if (!microphone_is_running())
+        return mp_const_none;
+
+    microphone_stop();
+    bluetooth_data_operation(DATA_OP_MICROPHONE_STOP);
+    return mp_const_none;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(microphone_stop_obj, microphone_stop_stream);
+
+/**
+ * Get statistics about the audio stream.
+ * @return A dict with the blocks read, the blocks dropped, and the frames sent.
+ */
+STATIC mp_obj_t microphone_stats(void)
+{
+    microphone_stats_t stats;
+    mp_obj_t dict = mp_obj_new_dict(0);
+
+    microphone_get_stats(&stats);
+
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_blocks), mp_obj_new_int_from_uint(stats.blocks));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_dropped), mp_obj_new_int_from_uint(stats.dropped));
+    mp_obj_dict_store(dict, MP_ROM_QSTR(MP_QSTR_frames), mp_obj_new_int_from_uint(stats.frames));
+    return dict;
+}
+STATIC MP_DEFINE_CONST_FUN_OBJ_0(microphone_stats_obj, microphone_stats);
+
+STATIC const mp_rom_map_elem_t microphone_module_globals_table[] = {
+    { MP_ROM_QSTR(MP_QSTR___name__),    MP_ROM_QSTR(MP_QSTR_microphone) },
+    { MP_ROM_QSTR(MP_QSTR___init__),    MP_ROM_PTR(&mod_microphone___init___obj) },
+
+    // methods
+    { MP_ROM_QSTR(MP_QSTR_stream),      MP_ROM_PTR(&microphone_stream_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stop),        MP_ROM_PTR(&microphone_stop_obj) },
+    { MP_ROM_QSTR(MP_QSTR_stats),       MP_ROM_PTR(&microphone_stats_obj) },
+
+    // constants
+    { MP_ROM_QSTR(MP_QSTR_SAMPLE_RATE), MP_OBJ_NEW_SMALL_INT(MICROPHONE_SAMPLE_RATE) },
+};
+STATIC MP_DEFINE_CONST_DICT(microphone_module_globals, microphone_module_globals_table);
+
+const mp_obj_module_t microphone_module = {
+    .base = { &mp_type_module },
+    .globals = (mp_obj_dict_t*)&microphone_module_globals,
+};
+MP_REGISTER_MODULE(MP_QSTR_microphone, microphone_module);
@@ -34,6 +34,7 @@
 #include "nrfx_systick.h"
 
 #include "driver/nrfx.h"
+#include "driver/settings.h"
 #include "driver/timer.h"
 
 uint64_t time_at_init;
@@ -41,8 +42,15 @@ uint64_t time_zone_offset;
 
 STATIC mp_obj_t time___init__(void)
 {
+    int32_t offset;
+
     nrfx_init();
     timer_init();
+    settings_init();
+
+    // Restore the time zone set before the last reset
+    if (settings_get_int("time.zone", &offset))
+        time_zone_offset = offset;
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_0(time___init___obj, time___init__);
@@ -87,6 +95,7 @@ STATIC mp_obj_t time_zone(mp_obj_t hours_in, mp_obj_t minutes_in)
     int16_t minutes = mp_obj_get_int(minutes_in);
 
     time_zone_offset = hours * 3600 + minutes * 60;
+    settings_set_int("time.zone", time_zone_offset);
     return mp_const_none;
 }
 STATIC MP_DEFINE_CONST_FUN_OBJ_2(time_zone_obj, time_zone);
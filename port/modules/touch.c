@@ -21,6 +21,8 @@
  * PERFORMANCE OF THIS SOFTWARE.
  */
 
+#define LOG_MODULE TOUCH
+
 #include "py/obj.h"
 #include "py/qstr.h"
 #include "py/runtime.h"
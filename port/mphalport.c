@@ -36,6 +36,8 @@
 #include "py/stream.h"
 #include "nrfx_errors.h"
 #include "nrfx_config.h"
+#include "nrfx_log.h"
+#include "SEGGER_RTT.h"
 #include "driver/bluetooth_low_energy.h"
 
 #if MICROPY_PY_TIME_TICKS
@@ -279,3 +281,24 @@ const char *nrfx_error_code_lookup(uint32_t err_code)
 
     return nrfx_error_unknown;
 }
+
+uint32_t log_modules = LOG_MODULES_ALL;
+
+/**
+ * Write a record of the deferred logging to RTT, as written by LOG(): the id
+ * of the format string (u16), the number of arguments (u8), and the
+ * arguments (u32 each), little endian. Dropped whole if RTT has no room left.
+ * @param id Offset of the format string in the .log_fmt section.
+ * @param args Arguments of the format string.
+ * @param n Number of arguments, at most LOG_MAX_ARGS.
+ */
+void log_write(uint32_t id, uint32_t const *args, size_t n)
+{
+    uint8_t buf[3 + LOG_MAX_ARGS * sizeof(uint32_t)];
+
+    buf[0] = id >> 0;
+    buf[1] = id >> 8;
+    buf[2] = n;
+    memcpy(buf + 3, args, n * sizeof(uint32_t));
+    SEGGER_RTT_Write(0, buf, 3 + n * sizeof(uint32_t));
+}
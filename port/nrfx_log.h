@@ -27,8 +27,10 @@
 #ifndef NRFX_LOG_H
 #define NRFX_LOG_H
 
-#include <stdio.h>
 #include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
 #include "mphalport.h"
 #include "nrfx_config.h"
 #include "SEGGER_RTT.h"
@@ -41,13 +43,153 @@
 
 static inline void LOG_NONE(void *v, ...) { (void)v; }
 
-#define PRINTF(fmt, ...)        SEGGER_RTT_printf(0, fmt, ## __VA_ARGS__)
-#define LOG(fmt, ...)           PRINTF("%s: " fmt "\n", __func__, ## __VA_ARGS__)
+/*
+ * Deferred logging: the format strings are not formatted on the device, nor
+ * even stored in its flash. Each one goes to the .log_fmt section of the ELF
+ * file, prefixed with its file and line, and its offset in that section
+ * identifies it. Only that id and the raw arguments are written to RTT, to be
+ * turned back into text on the host by tools/log_decode.py, with the ELF file.
+ *
+ * Every argument is sent as 32 bits, so %f is not supported, and %s must be
+ * given a constant string, as the decoder reads it from the ELF file.
+ *
+ * Each source file belongs to a module, set with LOG_MODULE before its
+ * includes, such as "#define LOG_MODULE BLE". The messages above the level of
+ * their module, LOG_LEVEL_BLE, compile to nothing, and that level is changed
+ * from the command line:
+ *
+ *      make CFLAGS_EXTRA=-DLOG_LEVEL_BLE=LOG_LEVEL_DEBUG
+ *
+ * The modules are also enabled at runtime by the bits of log_modules, so that
+ * a unit in use only logs what is being looked into. The errors always pass.
+ */
+
+#define LOG_LEVEL_NONE          0
+#define LOG_LEVEL_ERROR         1
+#define LOG_LEVEL_WARNING       2
+#define LOG_LEVEL_INFO          3
+#define LOG_LEVEL_DEBUG         4
+
+#ifndef LOG_LEVEL_DEFAULT
+#define LOG_LEVEL_DEFAULT       LOG_LEVEL_INFO
+#endif
+
+#ifndef LOG_MODULE
+#define LOG_MODULE              OTHER
+#endif
+
+typedef enum
+{
+    LOG_ID_OTHER,               // nrfx and files without a module
+    LOG_ID_MAIN,                // main loop, DFU
+    LOG_ID_BLE,                 // Bluetooth link and bonds
+    LOG_ID_DATA,                // Bluetooth data protocol
+    LOG_ID_CAMERA,              // camera sensor, captures and their queue
+    LOG_ID_DISPLAY,             // display panel, frames, graphics and fonts
+    LOG_ID_FPGA,
+    LOG_ID_FLASH,               // external flash and settings
+    LOG_ID_POWER,               // PMIC, battery and power-on self test
+    LOG_ID_TOUCH,
+    LOG_ID_I2C,
+    LOG_ID_TIMER,
+    LOG_ID_AUDIO,               // microphone and its stream
+    LOG_ID_SPI,
+    LOG_ID_COUNT,
+} log_id_t;
+
+#ifndef LOG_LEVEL_OTHER
+#define LOG_LEVEL_OTHER         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_MAIN
+#define LOG_LEVEL_MAIN          LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_BLE
+#define LOG_LEVEL_BLE           LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_DATA
+#define LOG_LEVEL_DATA          LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_CAMERA
+#define LOG_LEVEL_CAMERA        LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_DISPLAY
+#define LOG_LEVEL_DISPLAY       LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_FPGA
+#define LOG_LEVEL_FPGA          LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_FLASH
+#define LOG_LEVEL_FLASH         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_POWER
+#define LOG_LEVEL_POWER         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_TOUCH
+#define LOG_LEVEL_TOUCH         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_I2C
+#define LOG_LEVEL_I2C           LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_TIMER
+#define LOG_LEVEL_TIMER         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_AUDIO
+#define LOG_LEVEL_AUDIO         LOG_LEVEL_DEFAULT
+#endif
+#ifndef LOG_LEVEL_SPI
+#define LOG_LEVEL_SPI           LOG_LEVEL_DEFAULT
+#endif
+
+#define LOG_MODULES_ALL         ((1u << LOG_ID_COUNT) - 1)
+
+/** Bit (1 << LOG_ID_...) of every module enabled at runtime. */
+extern uint32_t log_modules;
+
+#define LOG_MAX_ARGS            8
+
+#define LOG_NARGS(...)          LOG_NARGS_(__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, n, ...) n
+
+// The format string leads the arguments, for the comma to go along with them if none
+#define LOG_ARG(x)              (uint32_t)(uintptr_t)(x)
+#define LOG_ARGS_0(f)
+#define LOG_ARGS_1(f, a)        , LOG_ARG(a)
+#define LOG_ARGS_2(f, a, ...)   , LOG_ARG(a) LOG_ARGS_1(f, __VA_ARGS__)
+#define LOG_ARGS_3(f, a, ...)   , LOG_ARG(a) LOG_ARGS_2(f, __VA_ARGS__)
+#define LOG_ARGS_4(f, a, ...)   , LOG_ARG(a) LOG_ARGS_3(f, __VA_ARGS__)
+#define LOG_ARGS_5(f, a, ...)   , LOG_ARG(a) LOG_ARGS_4(f, __VA_ARGS__)
+#define LOG_ARGS_6(f, a, ...)   , LOG_ARG(a) LOG_ARGS_5(f, __VA_ARGS__)
+#define LOG_ARGS_7(f, a, ...)   , LOG_ARG(a) LOG_ARGS_6(f, __VA_ARGS__)
+#define LOG_ARGS_8(f, a, ...)   , LOG_ARG(a) LOG_ARGS_7(f, __VA_ARGS__)
+#define LOG_ARGS_(n, ...)       LOG_ARGS_##n(__VA_ARGS__)
+#define LOG_ARGS(n, ...)        LOG_ARGS_(n, __VA_ARGS__)
+
+#define LOG_PASTE_(a, b)        a ## b
+#define LOG_PASTE(a, b)         LOG_PASTE_(a, b)
+
+// Constant false for the levels compiled out, leaving no code nor format string
+#define LOG_ENABLED(level)      (LOG_PASTE(LOG_LEVEL_, LOG_MODULE) >= (level) \
+        && ((level) == LOG_LEVEL_ERROR || (log_modules & 1u << LOG_PASTE(LOG_ID_, LOG_MODULE))))
+
+#define LOG_AT(level, fmt, ...) do { if (LOG_ENABLED(level)) { \
+    static char const log_fmt[] __attribute__((section(".log_fmt"), aligned(1))) = \
+            __FILE__ ":" VALUE(__LINE__) ": " fmt; \
+    uint32_t const log_args[] = { 0 LOG_ARGS(LOG_NARGS(fmt, ## __VA_ARGS__), fmt, ## __VA_ARGS__) }; \
+    log_write((uintptr_t)log_fmt, log_args + 1, LOG_NARGS(fmt, ## __VA_ARGS__)); \
+} } while (0)
+
+#define LOG_ERROR(fmt, ...)     LOG_AT(LOG_LEVEL_ERROR, fmt, ## __VA_ARGS__)
+#define LOG_WARNING(fmt, ...)   LOG_AT(LOG_LEVEL_WARNING, fmt, ## __VA_ARGS__)
+#define LOG_INFO(fmt, ...)      LOG_AT(LOG_LEVEL_INFO, fmt, ## __VA_ARGS__)
+#define LOG_DEBUG(fmt, ...)     LOG_AT(LOG_LEVEL_DEBUG, fmt, ## __VA_ARGS__)
+#define LOG                     LOG_INFO
+
+void log_write(uint32_t id, uint32_t const *args, size_t n);
 
 #define NRFX_LOG_DEBUG          LOG_NONE
 #define NRFX_LOG_INFO           LOG_NONE
 #define NRFX_LOG_WARNING        LOG_NONE
-#define NRFX_LOG_ERROR          LOG
+#define NRFX_LOG_ERROR          LOG_ERROR
 
 #define NRFX_LOG_ERROR_STRING_GET(error_code) nrfx_error_code_lookup(error_code)
 #define NRFX_LOG_HEXDUMP_ERROR(p_memory, length)
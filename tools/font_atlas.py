@@ -0,0 +1,104 @@
+"""
+Font atlas generator
+--------------------
+Renders the characters of a TrueType font into an anti-aliased atlas, in the
+format read by the firmware from the external flash, see port/driver/font.h.
+
+    python3 font_atlas.py Lato-Regular.ttf 16 lato16.bin --script lato16.py --font 1
+
+The script written with --script holds the display.font_write() calls that
+store the atlas into the flash, to run on the device through the REPL. The
+font is then used with display.text("...", x, y, font=1).
+"""
+
+import argparse
+import struct
+import sys
+
+from PIL import Image, ImageDraw, ImageFont
+
+MAGIC = b"MFNT"
+VERSION = 1
+BPP = 4
+HEADER_SIZE = 16
+INDEX_SIZE = 10
+SLOT_SIZE = 0x10000
+GLYPH_MAX_SIZE = 160
+GLYPH_MARGIN = 8
+PAGE_SIZE = 256
+
+
+def render_glyph(font: ImageFont.FreeTypeFont, char: str) -> tuple:
+    """
+    Render a character, cropped to its ink.
+    Returns the width, height, left, top, advance and 4-bit coverage rows.
+    """
+    advance = round(font.getlength(char))
+    left, top, right, bottom = font.getbbox(char)
+    width, height = right - left, bottom - top
+    if width <= 0 or height <= 0:
+        return 0, 0, 0, 0, advance, b""
+
+    image = Image.new("L", (width, height), 0)
+    ImageDraw.Draw(image).text((-left, -top), char, font=font, fill=255)
+
+    rows = bytearray()
+    for y in range(height):
+        nibbles = [(image.getpixel((x, y)) * 15 + 127) // 255 for x in range(width)]
+        if width % 2:
+            nibbles.append(0)
+        rows += bytes(nibbles[i] << 4 | nibbles[i + 1] for i in range(0, width, 2))
+    return width, height, left, top, advance, bytes(rows)
+
+
+def build_atlas(font: ImageFont.FreeTypeFont, first: int, last: int) -> bytes:
+    ascent, descent = font.getmetrics()
+    count = last - first + 1
+    index = bytearray()
+    bitmaps = bytearray()
+    offset = HEADER_SIZE + count * INDEX_SIZE
+
+    for code in range(first, last + 1):
+        width, height, left, top, advance, rows = render_glyph(font, chr(code))
+        if len(rows) > GLYPH_MAX_SIZE:
+            sys.exit(f"{chr(code)!r}: {width}x{height} glyph over {GLYPH_MAX_SIZE} bytes, use a smaller size")
+        if left < -GLYPH_MARGIN or left + width > advance + GLYPH_MARGIN or advance > 255:
+            sys.exit(f"{chr(code)!r}: glyph too far outside of its advance")
+        index += struct.pack("<IBBbbBx", offset + len(bitmaps), width, height, left, top, advance)
+        bitmaps += rows
+
+    header = struct.pack("<4sBBBxHHI", MAGIC, VERSION, BPP, ascent + descent, first, count, 0)
+    atlas = header + index + bitmaps
+    if len(atlas) > SLOT_SIZE:
+        sys.exit(f"atlas of {len(atlas)} bytes over {SLOT_SIZE}, use fewer characters or a smaller size")
+    return atlas
+
+
+def write_script(path: str, atlas: bytes, font: int) -> None:
+    with open(path, "w") as f:
+        f.write("import display\n")
+        for offset in range(0, len(atlas), PAGE_SIZE):
+            f.write(f"display.font_write({font}, {offset}, {atlas[offset:offset + PAGE_SIZE]!r})\n")
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("ttf", help="TrueType or OpenType font file")
+    parser.add_argument("size", type=int, help="size of the font in pixels")
+    parser.add_argument("output", help="atlas file to write")
+    parser.add_argument("--first", type=lambda s: int(s, 0), default=0x20, help="first character")
+    parser.add_argument("--last", type=lambda s: int(s, 0), default=0x7E, help="last character")
+    parser.add_argument("--script", help="also write a script storing the atlas on the device")
+    parser.add_argument("--font", type=int, default=1, help="number of the font on the device, 1 to 8")
+    args = parser.parse_args()
+
+    atlas = build_atlas(ImageFont.truetype(args.ttf, args.size), args.first, args.last)
+    with open(args.output, "wb") as f:
+        f.write(atlas)
+    if args.script:
+        write_script(args.script, atlas, args.font)
+    print(f"{args.output}: {args.last - args.first + 1} characters, {len(atlas)} bytes")
+
+
+if __name__ == "__main__":
+    main()
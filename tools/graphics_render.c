@@ -0,0 +1,217 @@
+/*
+ * Renderer of the graphics engine of the firmware to a PNG file, on the host.
+ *
+ *   cc -O2 -I../port -o graphics_render graphics_render.c ../port/driver/graphics.c ../port/driver/font.c
+ *   ./graphics_render output.png [font.bin ...] < scene.txt
+ *
+ * The font atlases made with font_atlas.py are numbered from 1 as given.
+ * The scene has one item per line, the layer being optional:
+ *
+ *   rect x y width height color [layer]
+ *   line x0 y0 x1 y1 color [layer]
+ *   font number, for the text that follows, 0 for the built-in one
+ *   text x y color layer string up to the end of the line
+ *   bitmap x y width height layer pixel pixel ...
+ *
+ * The pixels are written as 8-bit grayscale, the transparent ones as black,
+ * as they look on the display.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/font.h"
+#include "driver/graphics.h"
+
+static uint8_t frame[GRAPHICS_HEIGHT][GRAPHICS_WIDTH];
+static uint8_t fonts[FONT_MAX * FONT_SLOT_SIZE];
+
+static void fonts_read(uint32_t addr, uint8_t *buf, size_t len)
+{
+    memcpy(buf, fonts + addr, len);
+}
+
+static bool fonts_load(int argc, char **argv)
+{
+    memset(fonts, 0xFF, sizeof fonts);
+
+    for (int i = 0; i < argc && i < FONT_MAX; i++)
+    {
+        FILE *fp = fopen(argv[i], "rb");
+
+        if (fp == NULL)
+        {
+            perror(argv[i]);
+            return false;
+        }
+        fread(fonts + i * FONT_SLOT_SIZE, 1, FONT_SLOT_SIZE, fp);
+        fclose(fp);
+    }
+    font_init(fonts_read);
+    return true;
+}
+
+static void frame_write(uint32_t base, uint8_t *buf, size_t len)
+{
+    memcpy(&frame[0][0] + base, buf, len);
+}
+
+static uint32_t crc32(uint32_t crc, uint8_t const *buf, size_t len)
+{
+    crc = ~crc;
+    while (len-- > 0)
+    {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static void put32(uint8_t *p, uint32_t u)
+{
+    p[0] = u >> 24;
+    p[1] = u >> 16;
+    p[2] = u >> 8;
+    p[3] = u >> 0;
+}
+
+static void png_chunk(FILE *fp, char const *type, uint8_t const *data, size_t len)
+{
+    uint8_t buf[4];
+    uint32_t crc;
+
+    put32(buf, len);
+    fwrite(buf, 1, 4, fp);
+    fwrite(type, 1, 4, fp);
+    if (len > 0)
+        fwrite(data, 1, len, fp);
+    crc = crc32(crc32(0, (uint8_t const *)type, 4), data, len);
+    put32(buf, crc);
+    fwrite(buf, 1, 4, fp);
+}
+
+/**
+ * Store the frame uncompressed, one deflate block per row.
+ */
+static void png_write(FILE *fp)
+{
+    static uint8_t idat[2 + GRAPHICS_HEIGHT * (5 + 1 + GRAPHICS_WIDTH) + 4];
+    uint8_t ihdr[13] = { 0 };
+    uint8_t *p = idat;
+    uint32_t a = 1, b = 0;
+    uint16_t len = 1 + GRAPHICS_WIDTH;
+
+    put32(ihdr + 0, GRAPHICS_WIDTH);
+    put32(ihdr + 4, GRAPHICS_HEIGHT);
+    ihdr[8] = 8;        // Bit depth
+    ihdr[9] = 0;        // Grayscale
+
+    *p++ = 0x78;
+    *p++ = 0x01;
+    for (size_t y = 0; y < GRAPHICS_HEIGHT; y++)
+    {
+        *p++ = y == GRAPHICS_HEIGHT - 1;
+        *p++ = len;
+        *p++ = len >> 8;
+        *p++ = ~len;
+        *p++ = ~len >> 8;
+        *p++ = 0;       // No filter
+        memcpy(p, frame[y], GRAPHICS_WIDTH);
+        p += GRAPHICS_WIDTH;
+
+        for (size_t i = 0; i < len; i++)
+        {
+            a = (a + (i == 0 ? 0 : frame[y][i - 1])) % 65521;
+            b = (b + a) % 65521;
+        }
+    }
+    put32(p, b << 16 | a);
+    p += 4;
+
+    fwrite("\x89PNG\r\n\x1A\n", 1, 8, fp);
+    png_chunk(fp, "IHDR", ihdr, sizeof ihdr);
+    png_chunk(fp, "IDAT", idat, p - idat);
+    png_chunk(fp, "IEND", NULL, 0);
+}
+
+static bool scene_read(FILE *fp)
+{
+    static uint8_t pixels[GRAPHICS_DATA_SIZE];
+    char line[1024], str[1024];
+    int x, y, w, h, color, layer, n, font = 0;
+
+    for (int lineno = 1; fgets(line, sizeof line, fp) != NULL; lineno++)
+    {
+        bool ok = true;
+
+        line[strcspn(line, "\r\n")] = '\0';
+        layer = 0;
+
+        if (line[0] == '\0' || line[0] == '#')
+            continue;
+        else if (sscanf(line, "rect %d %d %d %d %d %d", &x, &y, &w, &h, &color, &layer) >= 5)
+            ok = graphics_rect(x, y, w, h, color, layer);
+        else if (sscanf(line, "line %d %d %d %d %d %d", &x, &y, &w, &h, &color, &layer) >= 5)
+            ok = graphics_line(x, y, w, h, color, layer);
+        else if (sscanf(line, "font %d", &font) == 1)
+            continue;
+        else if (sscanf(line, "text %d %d %d %d %n", &x, &y, &color, &layer, &n) == 4)
+        {
+            strcpy(str, line + n);
+            ok = graphics_text(x, y, str, strlen(str), color, font, layer);
+        }
+        else if (sscanf(line, "bitmap %d %d %d %d %d %n", &x, &y, &w, &h, &layer, &n) == 5
+                && w > 0 && h > 0 && w * h <= (int)sizeof pixels)
+        {
+            char *s = line + n;
+
+            for (int i = 0; i < w * h; i++)
+                pixels[i] = strtol(s, &s, 0);
+            ok = graphics_bitmap(x, y, w, h, pixels, layer);
+        }
+        else
+        {
+            fprintf(stderr, "line %d: invalid item: %s\n", lineno, line);
+            return false;
+        }
+
+        if (!ok)
+        {
+            fprintf(stderr, "line %d: display list full, or no such font\n", lineno);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    FILE *fp;
+
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s output.png [font.bin ...] <scene.txt\n", argv[0]);
+        return 1;
+    }
+
+    if (!fonts_load(argc - 2, argv + 2) || !scene_read(stdin))
+        return 1;
+    graphics_render(frame_write);
+    fprintf(stderr, "glyph cache: %u hits, %u misses\n",
+            (unsigned)font_get_stats().hits, (unsigned)font_get_stats().misses);
+
+    fp = fopen(argv[1], "wb");
+    if (fp == NULL)
+    {
+        perror(argv[1]);
+        return 1;
+    }
+    png_write(fp);
+    fclose(fp);
+    return 0;
+}
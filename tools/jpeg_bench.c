@@ -0,0 +1,114 @@
+/*
+ * Benchmark of the JPEG encoder of the firmware, on the host.
+ *
+ *   cc -O2 -I../port -o jpeg_bench jpeg_bench.c ../port/driver/jpeg.c
+ *   ./jpeg_bench [quality] [output.jpg]
+ *
+ * A synthetic YUYV frame of the size of the camera output is encoded in
+ * chunks of the size of a Bluetooth payload, as done on the device.
+ */
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "driver/jpeg.h"
+
+#define WIDTH       640
+#define HEIGHT      400
+#define PAYLOAD     125
+#define RUNS        20
+
+static uint8_t frame[WIDTH * HEIGHT * 2];
+static size_t frame_offset;
+
+static void frame_read(uint8_t *buf, size_t len)
+{
+    memcpy(buf, frame + frame_offset, len);
+    frame_offset += len;
+}
+
+/**
+ * Gradients, edges and some noise, for a realistic amount of detail.
+ */
+static void frame_fill(void)
+{
+    uint32_t seed = 1;
+
+    for (size_t y = 0; y < HEIGHT; y++)
+    {
+        for (size_t x = 0; x < WIDTH; x += 2)
+        {
+            uint8_t *p = frame + (y * WIDTH + x) * 2;
+            int luma = (x * 255 / WIDTH + y * 255 / HEIGHT) / 2;
+
+            if ((x / 80 + y / 80) % 2)
+                luma = 255 - luma;
+            seed = seed * 1103515245 + 12345;
+            luma += (seed >> 16) % 16 - 8;
+            luma = luma < 0 ? 0 : luma > 255 ? 255 : luma;
+
+            p[0] = luma;
+            p[1] = 128 + (int)(x * 64 / WIDTH) - 32;
+            p[2] = luma;
+            p[3] = 128 + (int)(y * 64 / HEIGHT) - 32;
+        }
+    }
+}
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char **argv)
+{
+    static jpeg_t jpeg;
+    static uint8_t rows[JPEG_ROWS_SIZE(WIDTH)];
+    static uint8_t out[WIDTH * HEIGHT * 2];
+    uint8_t payload[PAYLOAD];
+    int quality = argc > 1 ? atoi(argv[1]) : 50;
+    size_t size = 0, n, payloads = 0;
+    double start, elapsed;
+
+    frame_fill();
+
+    start = now();
+    for (int run = 0; run < RUNS; run++)
+    {
+        frame_offset = 0;
+        size = payloads = 0;
+        jpeg_init(&jpeg, WIDTH, HEIGHT, quality, frame_read, rows);
+        while ((n = jpeg_encode(&jpeg, payload, sizeof payload)) > 0)
+        {
+            memcpy(out + size, payload, n);
+            size += n;
+            payloads++;
+        }
+    }
+    elapsed = (now() - start) / RUNS;
+
+    printf("%dx%d quality=%d: %zu bytes in %zu payloads, %.2f ms/frame, %.1f Mpixel/s\n",
+            WIDTH, HEIGHT, quality, size, payloads, elapsed * 1e3,
+            WIDTH * HEIGHT / elapsed / 1e6);
+
+    if (argc > 2)
+    {
+        FILE *fp = fopen(argv[2], "wb");
+
+        if (fp == NULL || fwrite(out, 1, size, fp) != size)
+        {
+            perror(argv[2]);
+            return 1;
+        }
+        fclose(fp);
+    }
+    return 0;
+}
@@ -0,0 +1,140 @@
+"""
+Log decoder
+-----------
+Turns the deferred logs of the firmware back into text, see LOG() in
+port/nrfx_log.h. The device only writes the id of each format string and its
+raw arguments to RTT, the strings themselves being in the ELF file.
+
+    make rtt_openocd_jlink           # in one terminal, serves RTT on port 9090
+    python3 log_decode.py build/application.elf
+
+The logs can also be read from a file holding a capture of the RTT channel:
+
+    python3 log_decode.py build/application.elf --input rtt.bin
+
+The ELF file must be the one of the firmware running, or the messages are wrong.
+"""
+
+import argparse
+import re
+import socket
+import struct
+import sys
+from typing import BinaryIO, Iterator, Optional
+
+SHT_PROGBITS = 1
+SHF_ALLOC = 0x2
+CONVERSION = re.compile(r"%([-+ 0#]*)(\d*)(?:\.(\d+))?(hh|h|ll|l|z|j|t)?([diouxXcsp%])")
+
+
+class Elf:
+    """
+    The sections of a 32-bit little endian ELF file needed for decoding.
+    """
+
+    def __init__(self, path: str):
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:6] != b"\x7fELF\x01\x01":
+            sys.exit(f"{path}: not a 32-bit little endian ELF file")
+
+        shoff, = struct.unpack_from("<I", data, 0x20)
+        shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+        headers = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize) for i in range(shnum)]
+        names = headers[shstrndx]
+
+        self.formats = None
+        self.loaded = []
+        for name, type_, flags, addr, offset, size, *_ in headers:
+            name = data[names[4] + name:data.index(b"\0", names[4] + name)].decode()
+            if name == ".log_fmt":
+                self.formats = data[offset:offset + size]
+            elif type_ == SHT_PROGBITS and flags & SHF_ALLOC:
+                self.loaded.append((addr, data[offset:offset + size]))
+        if self.formats is None:
+            sys.exit(f"{path}: no .log_fmt section, not built with deferred logging")
+
+    def format(self, id_: int) -> Optional[str]:
+        if id_ >= len(self.formats):
+            return None
+        return self.formats[id_:self.formats.index(b"\0", id_)].decode(errors="replace")
+
+    def string(self, addr: int) -> str:
+        """
+        A constant string of the firmware, as given to %s.
+        """
+        for start, content in self.loaded:
+            if start <= addr < start + len(content):
+                end = content.find(b"\0", addr - start)
+                return content[addr - start:end if end >= 0 else None].decode(errors="replace")
+        return f"<string at 0x{addr:08X}>"
+
+
+def render(elf: Elf, fmt: str, args: list) -> str:
+    args = iter(args)
+
+    def convert(m: re.Match) -> str:
+        flags, width, precision, _, conv = m.groups()
+        if conv == "%":
+            return "%"
+        value = next(args, None)
+        if value is None:
+            return "<missing>"
+        if conv == "s":
+            spec, value = "s", elf.string(value)
+        elif conv == "p":
+            spec, value = "s", f"{value:08X}"
+        elif conv == "c":
+            spec, value = "c", value & 0xFF
+        elif conv in "di":
+            spec, value = "d", value - (1 << 32) if value & 0x80000000 else value
+        elif conv == "u":
+            spec = "d"
+        else:
+            spec = conv
+        return ("%" + flags + width + ("." + precision if precision else "") + spec) % value
+
+    return CONVERSION.sub(convert, fmt)
+
+
+def records(stream: BinaryIO) -> Iterator[tuple]:
+    """
+    The records of the RTT channel: id (u16), number of arguments (u8),
+    arguments (u32 each), little endian.
+    """
+    while True:
+        header = stream.read(3)
+        if len(header) < 3:
+            return
+        id_, n = struct.unpack("<HB", header)
+        payload = stream.read(4 * n)
+        if len(payload) < 4 * n:
+            return
+        yield id_, list(struct.unpack(f"<{n}I", payload))
+
+
+def main() -> None:
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("elf", help="ELF file of the firmware running")
+    parser.add_argument("--input", help="file holding the RTT data, instead of the OpenOCD RTT server")
+    parser.add_argument("--host", default="localhost", help="address of the OpenOCD RTT server")
+    parser.add_argument("--port", type=int, default=9090, help="port of the OpenOCD RTT server")
+    args = parser.parse_args()
+
+    elf = Elf(args.elf)
+    if args.input:
+        stream = open(args.input, "rb")
+    else:
+        stream = socket.create_connection((args.host, args.port)).makefile("rb")
+
+    with stream:
+        for id_, values in records(stream):
+            fmt = elf.format(id_)
+            if fmt is None:
+                print(f"<unknown id 0x{id_:04X}, wrong ELF file?>", flush=True)
+            else:
+                print(render(elf, fmt, values), flush=True)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,263 @@
+/*
+ * Power-loss test of the settings log of the firmware, on the host.
+ *
+ *   cc -O2 -I../port -o settings_powerfail settings_powerfail.c ../port/driver/settings.c
+ *   ./settings_powerfail [seeds] [operations]
+ *
+ * The settings run on a simulated NOR flash, where programming only clears
+ * bits and erasing sets a whole sector back to 0xFF. Random keys are set and
+ * deleted, and some of the programs and erases are cut at random, including
+ * while recovering from a previous cut:
+ *
+ *   program: the bytes before a random point are written, the byte at that
+ *            point only has some of its bits cleared, the rest is untouched
+ *   erase:   every byte of the sector is either untouched, erased, or has
+ *            some of its bits set
+ *
+ * After every cut, the settings are loaded again as after a reset, and must
+ * match what they were either before or after the interrupted operation.
+ */
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "driver/flash.h"
+#include "driver/settings.h"
+
+#define KEYS        16
+#define AREA_SIZE   (SETTINGS_SECTORS * FLASH_SECTOR_SIZE)
+
+typedef struct
+{
+    bool set[KEYS];
+    uint8_t len[KEYS];
+    uint8_t value[KEYS][SETTINGS_VALUE_MAX_LEN];
+} model_t;
+
+static uint8_t area[AREA_SIZE];
+static uint32_t rng_state;
+
+static jmp_buf cut_jmp;
+static unsigned program_odds;   // Cut one program in that many, 0 for none
+static unsigned erase_odds;     // Cut one erase in that many, 0 for none
+static unsigned cuts, recovery_cuts, programs, erases;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 17;
+    rng_state ^= rng_state << 5;
+    return rng_state;
+}
+
+static uint8_t *area_at(uint32_t addr, size_t len)
+{
+    if (addr < FLASH_SETTINGS_ADDR || addr + len > FLASH_SETTINGS_ADDR + AREA_SIZE)
+    {
+        fprintf(stderr, "access out of the settings at 0x%06X\n", (unsigned)addr);
+        exit(1);
+    }
+    return area + addr - FLASH_SETTINGS_ADDR;
+}
+
+/**
+ * @return True if this flash operation is to be cut.
+ */
+static bool cut_now(unsigned odds)
+{
+    return odds > 0 && rng() % odds == 0;
+}
+
+static void cut_arm(unsigned program, unsigned erase)
+{
+    program_odds = program;
+    erase_odds = erase;
+}
+
+void flash_init(void)
+{
+}
+
+void flash_read(uint32_t addr, uint8_t *buf, size_t len)
+{
+    memcpy(buf, area_at(addr, len), len);
+}
+
+void flash_program(uint32_t addr, uint8_t const *buf, size_t len)
+{
+    while (len > 0)
+    {
+        size_t n = FLASH_PAGE_SIZE - addr % FLASH_PAGE_SIZE;
+        uint8_t *p = area_at(addr, len < n ? len : n);
+
+        if (n > len)
+            n = len;
+        programs++;
+
+        if (cut_now(program_odds))
+        {
+            size_t end = rng() % (n + 1);
+
+            for (size_t i = 0; i < end; i++)
+                p[i] &= buf[i];
+            if (end < n)
+                p[end] &= buf[end] | rng();
+            longjmp(cut_jmp, 1);
+        }
+
+        for (size_t i = 0; i < n; i++)
+            p[i] &= buf[i];
+        addr += n;
+        buf += n;
+        len -= n;
+    }
+}
+
+void flash_erase_sector(uint32_t addr)
+{
+    uint8_t *p = area_at(addr, FLASH_SECTOR_SIZE);
+
+    erases++;
+    if (cut_now(erase_odds))
+    {
+        for (size_t i = 0; i < FLASH_SECTOR_SIZE; i++)
+        {
+            switch (rng() % 3)
+            {
+            case 0: break;
+            case 1: p[i] = 0xFF; break;
+            case 2: p[i] |= rng(); break;
+            }
+        }
+        longjmp(cut_jmp, 1);
+    }
+    memset(p, 0xFF, FLASH_SECTOR_SIZE);
+}
+
+static void key_name(int k, char name[8])
+{
+    snprintf(name, 8, "key%d", k);
+}
+
+static bool model_matches(model_t const *model)
+{
+    uint8_t buf[SETTINGS_VALUE_MAX_LEN];
+    size_t count = 0;
+
+    for (int k = 0; k < KEYS; k++)
+    {
+        char name[8];
+        size_t len = sizeof buf;
+        bool found;
+
+        key_name(k, name);
+        found = settings_get(name, strlen(name), buf, &len);
+        if (found != model->set[k])
+            return false;
+        if (!found)
+            continue;
+        if (len != model->len[k] || memcmp(buf, model->value[k], len) != 0)
+            return false;
+        count++;
+    }
+    return settings_count() == count;
+}
+
+/**
+ * Load the settings as after a reset, which may itself be cut.
+ */
+static void reset(void)
+{
+    for (;;)
+    {
+        cut_arm(3, 3);
+        if (setjmp(cut_jmp) == 0)
+        {
+            settings_init();
+            cut_arm(0, 0);
+            return;
+        }
+        cuts++;
+        recovery_cuts++;
+    }
+}
+
+static bool run(uint32_t seed, unsigned operations)
+{
+    static model_t model, next;
+
+    rng_state = seed;
+    memset(area, 0xFF, sizeof area);
+    memset(&model, 0, sizeof model);
+    settings_init();
+
+    for (unsigned op = 0; op < operations; op++)
+    {
+        static char name[8];
+        static int k;
+
+        k = rng() % KEYS;
+        key_name(k, name);
+        next = model;
+        if (rng() % 5 == 0)
+        {
+            next.set[k] = false;
+        }
+        else
+        {
+            next.set[k] = true;
+            next.len[k] = rng() % 4 == 0 ? rng() % (SETTINGS_VALUE_MAX_LEN + 1) : rng() % 16;
+            for (size_t i = 0; i < next.len[k]; i++)
+                next.value[k][i] = rng();
+        }
+
+        cut_arm(64, 4);
+        if (setjmp(cut_jmp) == 0)
+        {
+            if (next.set[k])
+                settings_set(name, strlen(name), next.value[k], next.len[k]);
+            else
+                settings_delete(name, strlen(name));
+            cut_arm(0, 0);
+            model = next;
+
+            // Also check a clean reset once in a while
+            if (op % 500 != 0)
+                continue;
+            settings_init();
+        }
+        else
+        {
+            cuts++;
+            reset();
+            if (model_matches(&next))
+                model = next;
+        }
+
+        if (!model_matches(&model))
+        {
+            fprintf(stderr, "seed %u: mismatch after operation %u on %s\n", (unsigned)seed, op, name);
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    unsigned seeds = argc > 1 ? atoi(argv[1]) : 4;
+    unsigned operations = argc > 2 ? atoi(argv[2]) : 20000;
+    bool ok = true;
+
+    for (unsigned seed = 1; seed <= seeds; seed++)
+        ok = run(seed * 2654435761u, operations) && ok;
+
+    printf("%s: %u seeds of %u operations, %u cuts (%u while recovering), %u programs, %u erases\n",
+            ok ? "ok" : "FAILED", seeds, operations, cuts, recovery_cuts, programs, erases);
+    return ok ? 0 : 1;
+}